@@ -12,6 +12,12 @@
  *source code based on customizable pattern-matching rules and actions.
  *
  * - Rule-based lexical analysis with matcher/action pairs
+ * - Declarative regex rules, all compiled into a single table-driven DFA
+ * - Keyword tables classified with a perfect hash
+ * - Operator/punctuator sets matched through a byte trie
+ * - Built-in SIMD scanners for the most common tokens (whitespace,
+ *   identifiers, string literals, comments, numbers)
+ * - UTF-8 identifiers (XID_Start/XID_Continue) with an ASCII fast path
  * - Support for stateful lexing via user contexts
  * - Token flags for filtering/ignoring tokens (useful for identation-aware
  *languages)
@@ -35,8 +41,8 @@
 #ifndef PLEXTRUM_H
 #define PLEXTRUM_H
 
-#include "dynarr.h"
 #include <assert.h>
+#include <locale.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -44,6 +50,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Dynamic array stuff
 #ifndef ASSERT
 #define ASSERT assert
@@ -84,38 +94,126 @@ typedef struct lexer_rule_t lexer_rule_t;
 typedef enum token_flag_t {
   TOKEN_FLAG_NONE = 0,
   TOKEN_FLAG_IGNORE = 1 << 0,
+  TOKEN_FLAG_HAS_ESCAPES = 1 << 1, // String literal containing escapes
+  TOKEN_FLAG_INVALID = 1 << 2,     // Malformed literal, lexed as one token
 } token_flag_t;
 
 typedef enum lexer_flags_t {
   LEXER_FLAG_NONE,
   LEXER_FLAG_KEEP_IGNORABLE = 1 << 0,
+  // Pick the longest match among all rules (ties go to the earliest rule)
+  // instead of the first rule that matches
+  LEXER_FLAG_LONGEST_MATCH = 1 << 1,
+  // Count successful matches per rule (see lexer_optimize_rules)
+  LEXER_FLAG_PROFILE = 1 << 2,
+  // Only track byte offsets while lexing. Tokens get line = column = 0, and
+  // locations are computed on demand (lexer_offset_to_location)
+  LEXER_FLAG_LAZY_LOCATION = 1 << 3,
+  // Count columns in UTF-8 code points instead of bytes
+  LEXER_FLAG_UTF8_COLUMNS = 1 << 4,
 } lexer_flags_t;
 
+typedef enum lexer_rule_flags_t {
+  LEXER_RULE_FLAG_NONE = 0,
+  // The rule never competes with another rule on the same input, so it may be
+  // tried before rules registered earlier
+  LEXER_RULE_FLAG_ORDER_INDEPENDENT = 1 << 0,
+} lexer_rule_flags_t;
+
 typedef enum internal_token_kind_t {
   INTERNAL_TOKEN_EOF,
   INTERNAL_TOKEN_ERROR,
   // ...
 } token_kind_t;
 
+// Index of a source in a lexer's source registry
+typedef uint32_t source_id_t;
+
+#define LEXER_SOURCE_INVALID UINT32_MAX
+
 // Token structure (generic)
 typedef struct token_t {
   uint32_t kind;
-  const char *lexeme; // Points to start of token in source
-  size_t length;      // Length of the token
-  const char *filename;
+  const char *lexeme;   // Points to start of token in source
+  size_t length;        // Length of the token
+  const char *filename; // Owned by the lexer's source registry
   size_t line;
   size_t column;
   uint32_t flags;
+  source_id_t source;
 } token_t;
 
+// Struct-of-arrays token storage filled by lexer_tokenize_all. Token i is
+// kinds[i], offsets[i] (byte offset in the source), lengths[i] and flags[i],
+// plus lines[i] and columns[i] when `locations` is set. Sources are limited to
+// 4 GiB. The arrays are kept when the buffer is refilled, so a reused buffer
+// stops allocating once it has grown to the largest input.
+typedef struct token_buffer_t {
+  uint32_t *kinds;
+  uint32_t *offsets;
+  uint32_t *lengths;
+  uint32_t *flags;
+  uint32_t *lines;   // NULL unless `locations`
+  uint32_t *columns; // NULL unless `locations`
+  size_t count;
+  size_t capacity;
+  size_t cursor; // Next token for token_buffer_next
+  bool locations;
+} token_buffer_t;
+
+// Compact token (16 bytes): the lexeme, filename and location are recovered
+// from the lexer's source registry (see lexer_compact_lexeme and friends).
+// Offsets and lengths are 32 bits, kinds and flags 16 bits. A token whose
+// kind or flags do not fit is returned as an INTERNAL_TOKEN_ERROR token with
+// the same offset and length. A source of 4 GiB or more is skipped as a
+// single INTERNAL_TOKEN_ERROR token of length 0, followed by EOF.
+typedef struct compact_token_t {
+  uint32_t offset; // Byte offset in the source
+  uint32_t length;
+  uint16_t kind;
+  uint16_t flags;
+  source_id_t source;
+} compact_token_t;
+
 // Function pointer types for lexer operations
 typedef bool (*token_matcher_fn)(lexer_t *lexer, token_t *token);
 typedef void (*token_action_fn)(lexer_t *lexer, token_t *token);
 typedef void (*context_destructor_fn)(void *context);
+// Read-only matcher: gets the remaining input and returns the length of the
+// match (0 if it does not match)
+typedef size_t (*token_span_fn)(const char *input, size_t length);
+
+// 256-bit set of bytes (used to declare what a rule can start with)
+typedef struct lexer_charset_t {
+  uint64_t bits[4];
+} lexer_charset_t;
+
+typedef enum lexer_rule_type_t {
+  LEXER_RULE_MATCHER,  // Hand-written token_matcher_fn
+  LEXER_RULE_REGEX,    // Part of the lexer's DFA
+  LEXER_RULE_KEYWORDS, // Perfect-hashed keyword table
+  LEXER_RULE_LITERALS, // Byte trie of literal strings
+  LEXER_RULE_SPAN,     // Read-only token_span_fn
+  LEXER_RULE_SPACE,    // Built-in whitespace run
+  LEXER_RULE_IDENT,    // Built-in identifier
+  LEXER_RULE_XID,      // Built-in UTF-8 identifier
+  LEXER_RULE_STRING,   // Built-in string literal
+  LEXER_RULE_COMMENT,  // Built-in line or block comment
+  LEXER_RULE_NUMBER,   // Built-in numeric literal
+} lexer_rule_type_t;
 
 struct lexer_rule_t {
+  lexer_rule_type_t type;
   token_matcher_fn matcher;
+  token_span_fn span;
   token_action_fn action;
+  lexer_charset_t first; // Bytes a match can start with
+  uint32_t kind;         // Token kind (declarative rules)
+  uint32_t id;           // Index in the lexer's regex/keyword/literal/...
+                         // tables
+  uint32_t flags;        // lexer_rule_flags_t
+  uint32_t modes;        // Bit m set if the rule is active in mode m
+  uint64_t hits;         // Successful matches (with LEXER_FLAG_PROFILE)
 };
 
 typedef struct lexer_rules_t {
@@ -124,6 +222,290 @@ typedef struct lexer_rules_t {
   size_t capacity;
 } lexer_rules_t;
 
+// Regex rules are compiled (Thompson construction) into a shared NFA when they
+// are added, and the NFA is turned into a DFA along with the dispatch lists.
+typedef struct lexer_nfa_state_t {
+  lexer_charset_t set; // Bytes consumed (only if `consumes`)
+  int32_t out;         // Next state, -1 if none
+  int32_t out1;        // Second epsilon transition, -1 if none
+  int32_t accept;      // Regex accepted in this state, -1 if none
+  bool consumes;
+} lexer_nfa_state_t;
+
+typedef struct lexer_nfa_t {
+  lexer_nfa_state_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_nfa_t;
+
+typedef struct lexer_regex_t {
+  int32_t start; // NFA start state
+  uint32_t rule; // Index of the owning rule
+} lexer_regex_t;
+
+typedef struct lexer_regexes_t {
+  lexer_regex_t *items;
+  size_t count;
+  size_t capacity;
+  lexer_nfa_t nfa;
+  // Longest match of every regex at `cached_position`, filled by one DFA scan
+  size_t *matches;
+  size_t cached_position;
+  // Longest match among all regexes at `cached_position` (and the earliest
+  // regex reaching it)
+  size_t longest;
+  uint32_t longest_regex;
+} lexer_regexes_t;
+
+typedef struct lexer_keyword_t {
+  const char *word; // NULL for an empty slot
+  uint32_t length;
+  uint32_t kind;
+} lexer_keyword_t;
+
+// Keywords placed by a collision-free hash: a keyword can only live in
+// slots[lexer_keyword_hash(word, seed) & mask]
+typedef struct lexer_keyword_table_t {
+  lexer_keyword_t *slots;
+  uint32_t mask;
+  uint32_t seed;
+  size_t max_length;
+  char *storage; // Owned copy of the words
+} lexer_keyword_table_t;
+
+typedef struct lexer_keyword_tables_t {
+  lexer_keyword_table_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_keyword_tables_t;
+
+// Literal string and the kind of the token it produces
+typedef struct lexer_literal_t {
+  const char *text;
+  uint32_t kind;
+} lexer_literal_t;
+
+typedef struct lexer_trie_node_t {
+  uint32_t edges;      // First outgoing edge
+  uint32_t edge_count; // Edges are sorted by byte
+  uint32_t kind;       // Kind of the literal ending here (if `accept`)
+  bool accept;
+} lexer_trie_node_t;
+
+// Trie of literals; the root is a full jump table since every token starts
+// there, deeper nodes keep their edges in compact sorted arrays
+typedef struct lexer_literal_table_t {
+  uint32_t root[256]; // Node reached from the root by each byte, 0 if none
+  lexer_trie_node_t *nodes;
+  uint8_t *edge_bytes;
+  uint32_t *edge_targets;
+} lexer_literal_table_t;
+
+typedef struct lexer_literal_tables_t {
+  lexer_literal_table_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_literal_tables_t;
+
+// Offsets of every '\n' in the source, built on the first location query
+typedef struct lexer_newlines_t {
+  size_t *items;
+  size_t count;
+  size_t capacity;
+  bool built;
+} lexer_newlines_t;
+
+// Bytes of a whitespace rule, compared 16/32 at a time. Sets larger than
+// LEXER_SPACE_SIMD_MAX are scanned with the rule's first-byte set instead.
+#define LEXER_SPACE_SIMD_MAX 8
+
+typedef struct lexer_space_set_t {
+  uint8_t bytes[LEXER_SPACE_SIMD_MAX];
+  uint32_t count; // 0 if the set is too large for the SIMD path
+} lexer_space_set_t;
+
+typedef struct lexer_space_sets_t {
+  lexer_space_set_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_space_sets_t;
+
+// Delimiters of a string literal rule
+typedef struct lexer_string_config_t {
+  char quote;          // Opening and closing quote
+  char escape;         // Escapes the next byte ('\0' for no escapes)
+  bool allow_newlines; // Whether a raw '\n' may appear inside the literal
+} lexer_string_config_t;
+
+typedef struct lexer_string_configs_t {
+  lexer_string_config_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_string_configs_t;
+
+// Delimiters of a comment rule (close is NULL for line comments)
+typedef struct lexer_comment_t {
+  char *open;
+  char *close;
+  size_t open_length;
+  size_t close_length;
+  bool nested;
+} lexer_comment_t;
+
+typedef struct lexer_comments_t {
+  lexer_comment_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_comments_t;
+
+// Syntax accepted by a number rule (decimal integers are always accepted)
+typedef enum lexer_number_flags_t {
+  LEXER_NUMBER_HEX = 1 << 0,     // 0x1F
+  LEXER_NUMBER_OCTAL = 1 << 1,   // 0o17
+  // 017. A leading 0 followed by 8 or 9 (e.g. 09) still gives one token,
+  // flagged TOKEN_FLAG_INVALID and decoded as decimal.
+  LEXER_NUMBER_C_OCTAL = 1 << 2,
+  LEXER_NUMBER_BINARY = 1 << 3,  // 0b101
+  LEXER_NUMBER_FLOAT = 1 << 4,   // 1.5, .5, 1e9, 2.5E-3
+  LEXER_NUMBER_DECODE = 1 << 5,  // Decode the value (see lexer_get_number)
+} lexer_number_flags_t;
+
+typedef struct lexer_number_config_t {
+  uint32_t flags;       // lexer_number_flags_t
+  char separator;       // Digit separator such as '_' or '\'' ('\0' for none)
+  const char *suffixes; // Bytes allowed after the number, e.g. "uUlL" (or NULL)
+} lexer_number_config_t;
+
+typedef struct lexer_number_rule_t {
+  uint32_t flags;
+  char separator;
+  lexer_charset_t suffixes;
+} lexer_number_rule_t;
+
+typedef struct lexer_number_rules_t {
+  lexer_number_rule_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_number_rules_t;
+
+// Value of the last token produced by a number rule with LEXER_NUMBER_DECODE
+typedef struct lexer_number_t {
+  bool is_float;
+  bool overflow; // Integer too large for 64 bits (`integer` is saturated)
+  uint64_t integer;
+  double real;
+} lexer_number_t;
+
+#define LEXER_DFA_DEAD 0
+#define LEXER_DFA_START 1
+
+// Table-driven DFA over byte equivalence classes
+typedef struct lexer_dfa_t {
+  uint8_t classes[256]; // Byte -> equivalence class
+  uint32_t class_count;
+  uint32_t state_count;
+  uint32_t *transitions; // state_count * class_count entries
+  // Regexes accepted by state s are accepts[accept_offsets[s]] ..
+  // accepts[accept_offsets[s + 1] - 1]
+  uint32_t *accept_offsets;
+  uint32_t *accepts;
+} lexer_dfa_t;
+
+// Per-byte candidate lists, rebuilt when the rules change.
+// Candidates for byte c are items[offsets[c]] .. items[offsets[c + 1] - 1],
+// stored as rule indices in registration order.
+typedef struct lexer_dispatch_t {
+  uint32_t offsets[257];
+  uint32_t *items;
+  size_t capacity;
+  lexer_dfa_t dfa;
+  // Bytes whose first candidate is an ignored whitespace rule: runs of them
+  // are skipped before dispatching (rule `skip_rule`)
+  lexer_charset_t skip;
+  uint32_t skip_rule;
+  bool dirty;
+} lexer_dispatch_t;
+
+// Character classes. Every byte maps to the bitmask of the classes it belongs
+// to, so a membership test is a single lookup. The built-in classes are
+// followed by the ones added with lexer_define_class.
+typedef enum lexer_class_id_t {
+  LEXER_CLASS_DIGIT,  // 0-9
+  LEXER_CLASS_ALPHA,  // a-z A-Z _
+  LEXER_CLASS_ALNUM,  // alpha and digit
+  LEXER_CLASS_SPACE,  // ' ' \n \t \b \r \v
+  LEXER_CLASS_XDIGIT, // 0-9 a-f A-F
+  LEXER_CLASS_UPPER,  // A-Z
+  LEXER_CLASS_LOWER,  // a-z
+  LEXER_CLASS_BUILTIN_COUNT,
+} lexer_class_id_t;
+
+#define LEXER_CLASS_MAX 32
+
+// Built-in classes of every byte
+extern const uint32_t lexer_class_table[256];
+
+// Lexer modes (start conditions). Every mode has its own dispatch, built from
+// the rules active in it.
+#define LEXER_MODE_DEFAULT 0
+#define LEXER_MODE_MAX 32
+#define LEXER_MODE_STACK_MAX 16
+
+typedef struct lexer_mode_t {
+  char *name;
+  lexer_dispatch_t dispatch;
+} lexer_mode_t;
+
+typedef struct lexer_modes_t {
+  lexer_mode_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_modes_t;
+
+// Checkpoint taken by lexer_mark: the lexer state before the next token to be
+// returned. Modes are below LEXER_MODE_MAX, so the stack fits in bytes.
+typedef struct lexer_mark_t {
+  size_t position;
+  size_t line;
+  size_t column;
+  size_t token; // Index of the next token since the source was set
+  uint32_t mode;
+  uint32_t mode_depth;
+  uint8_t mode_stack[LEXER_MODE_STACK_MAX];
+} lexer_mark_t;
+
+// Number of tokens lexer_peek_token can look ahead
+#define LEXER_LOOKAHEAD_MAX 8
+
+// Token lexed ahead by lexer_peek_token, with its byte offset, the number
+// decoded along with it and the lexer state before it
+typedef struct lexer_lookahead_t {
+  token_t token;
+  size_t offset;
+  lexer_number_t number;
+  lexer_mark_t start;
+} lexer_lookahead_t;
+
+// Registered input buffer, with its newline index (built on the first
+// location query). The filename is copied; the text is not.
+typedef struct lexer_source_t {
+  char *filename;
+  const char *text;
+  size_t length;
+  lexer_newlines_t newlines;
+} lexer_source_t;
+
+// Entries are never removed, so ids and filename copies stay valid for the
+// lifetime of the lexer. `slots` indexes them by text, length and filename
+// with linear probing (id + 1, 0 for an empty slot).
+typedef struct lexer_sources_t {
+  lexer_source_t *items;
+  size_t count;
+  size_t capacity;
+  uint32_t *slots;
+  size_t slot_count; // Power of two, at most half full
+} lexer_sources_t;
+
 typedef struct lexer_t {
   // Input management
   const char *source;
@@ -135,8 +517,38 @@ typedef struct lexer_t {
   size_t column;
   const char *filename;
 
+  // Every source registered or lexed so far, so that tokens can be resolved
+  lexer_sources_t sources;
+  source_id_t source_id; // Current source
+
   // Rule management
   lexer_rules_t rules;
+  lexer_modes_t modes;
+  uint32_t mode; // Current mode
+  uint32_t mode_stack[LEXER_MODE_STACK_MAX];
+  size_t mode_depth;
+  lexer_regexes_t regexes;
+  lexer_keyword_tables_t keywords;
+  lexer_literal_tables_t literals;
+  lexer_space_sets_t spaces;
+  lexer_string_configs_t strings;
+  lexer_comments_t comments;
+  lexer_number_rules_t numbers;
+  lexer_number_t number;
+
+  // Ring of tokens lexed by lexer_peek_token, numbered from the start of the
+  // source: token i, for i in [lookahead_first, lookahead_end), is in slot
+  // i % LEXER_LOOKAHEAD_MAX. Tokens before token_index were returned already
+  // and stay until overwritten, so lexer_rewind can replay them.
+  lexer_lookahead_t lookahead[LEXER_LOOKAHEAD_MAX];
+  size_t lookahead_first;
+  size_t lookahead_end;
+  size_t token_index; // Next token to return
+
+  // Character classes (the built-in ones plus lexer_define_class)
+  uint32_t classes[256];
+  char *class_names[LEXER_CLASS_MAX]; // NULL for the built-in classes
+  uint32_t class_count;
 
   // Error tracking
   char *error_message;
@@ -158,22 +570,222 @@ void *lexer_get_context(lexer_t *lexer);
 // Rule management
 bool lexer_add_rule(lexer_t *lexer, token_matcher_fn matcher,
                     token_action_fn action);
+// Same as lexer_add_rule, but the matcher is only tried on bytes in `first`
+// (NULL means any byte)
+bool lexer_add_rule_ex(lexer_t *lexer, token_matcher_fn matcher,
+                       token_action_fn action, const lexer_charset_t *first);
+// Adds a rule producing `kind` tokens from a read-only span matcher. The
+// lexer only moves (and updates line/column) once the match is chosen, and a
+// failed attempt has nothing to roll back. `first` works as in
+// lexer_add_rule_ex.
+bool lexer_add_span_rule(lexer_t *lexer, token_span_fn span, uint32_t kind,
+                         token_action_fn action, const lexer_charset_t *first);
+// Adds a rule matching a run of the bytes in `bytes` (NULL for the
+// lexer_is_space set), scanned 16/32 bytes at a time. When `action` is
+// lexer_action_ignore, runs are skipped before rule dispatch wherever the
+// rule would be tried first anyway.
+bool lexer_add_whitespace_rule(lexer_t *lexer, const char *bytes,
+                               uint32_t kind, token_action_fn action);
+// Adds a rule matching an identifier ([A-Za-z_][A-Za-z0-9_]*), scanned with
+// lexer_scan_ident
+bool lexer_add_identifier_rule(lexer_t *lexer, uint32_t kind,
+                               token_action_fn action);
+// Adds a rule matching a UTF-8 identifier (see lexer_scan_xid)
+bool lexer_add_utf8_identifier_rule(lexer_t *lexer, uint32_t kind,
+                                    token_action_fn action);
+// Adds a rule matching a string literal, from the opening quote to the
+// closing one included. The body is searched 16/32 bytes at a time for the
+// quote, escape and newline bytes. Tokens containing escapes get
+// TOKEN_FLAG_HAS_ESCAPES. An unterminated literal does not match.
+bool lexer_add_string_rule(lexer_t *lexer,
+                           const lexer_string_config_t *config, uint32_t kind,
+                           token_action_fn action);
+// Adds a rule matching a comment from `prefix` (e.g. "//", "#", "--") up to,
+// but not including, the next newline or the end of the input
+bool lexer_add_line_comment_rule(lexer_t *lexer, const char *prefix,
+                                 uint32_t kind, token_action_fn action);
+// Adds a rule matching a comment from `open` to `close` included. The
+// terminator is searched 16/32 positions at a time by checking its first and
+// last bytes. When `nested` is set, every `open` inside the comment needs its
+// own `close`. An unterminated comment does not match.
+bool lexer_add_block_comment_rule(lexer_t *lexer, const char *open,
+                                  const char *close, bool nested,
+                                  uint32_t kind, token_action_fn action);
+// Adds a rule matching a numeric literal: decimal integers plus the forms
+// enabled in `config->flags`, digit separators between digits, then a run of
+// suffix bytes. Decimal digits are consumed 8 at a time. With
+// LEXER_NUMBER_DECODE, the value is computed during the same scan and read
+// back with lexer_get_number.
+bool lexer_add_number_rule(lexer_t *lexer,
+                           const lexer_number_config_t *config, uint32_t kind,
+                           token_action_fn action);
+// Adds a rule matching the longest prefix accepted by `pattern`.
+// Supported syntax: literals, `.`, `[...]`/`[^...]` classes, `( )`, `|`,
+// `*`, `+`, `?`, `{m}`, `{m,}`, `{m,n}` and the escapes \n \t \r \f \v \0
+// \xHH \d \D \w \W \s \S. Inside a class, `[:name:]` stands for the bytes of
+// a character class (built-in or from lexer_define_class). Patterns are
+// implicitly anchored at the current position. Returns false if the pattern
+// is invalid or expands to more than LEXER_REGEX_MAX_STATES NFA states.
+bool lexer_add_regex_rule(lexer_t *lexer, const char *pattern, uint32_t kind,
+                          token_action_fn action);
+
+// Adds a rule matching an identifier ([A-Za-z_][A-Za-z0-9_]*) only if it is
+// one of `words`, producing the matching entry of `kinds`. The identifier is
+// scanned once and looked up in a perfect hash table built here. Returns false
+// if a word is not an identifier or appears twice.
+bool lexer_add_keywords(lexer_t *lexer, const char **words,
+                        const uint32_t *kinds, size_t count,
+                        token_action_fn action);
+
+// Adds a rule matching the longest of `literals` at the current position.
+// Returns false if a literal is empty or appears twice.
+bool lexer_add_literals(lexer_t *lexer, const lexer_literal_t *literals,
+                        size_t count, token_action_fn action);
+
+// Rules are numbered in registration order, starting at 0
+size_t lexer_rule_count(const lexer_t *lexer);
+bool lexer_set_rule_flags(lexer_t *lexer, size_t rule, uint32_t flags);
+
+// Defines the mode `name` (or finds it if it exists). Returns the mode id, or
+// -1 if LEXER_MODE_MAX modes already exist. Mode LEXER_MODE_DEFAULT, named
+// "default", is the one every lexer starts in and where the lexer_add_*
+// functions register their rules.
+int32_t lexer_define_mode(lexer_t *lexer, const char *name);
+// Id of the mode `name`, or -1
+int32_t lexer_find_mode(const lexer_t *lexer, const char *name);
+// Same as lexer_add_rule, but the rule is only active in `mode`
+bool lexer_add_rule_in_mode(lexer_t *lexer, uint32_t mode,
+                            token_matcher_fn matcher, token_action_fn action);
+// Sets the modes a rule is active in (bit m for mode m), e.g. to move a
+// declarative rule (see lexer_rule_count) or share it between modes
+bool lexer_set_rule_modes(lexer_t *lexer, size_t rule, uint32_t modes);
+// Mode switching, typically from actions. The new mode applies from the next
+// token. The stack holds up to LEXER_MODE_STACK_MAX saved modes; push fails
+// when it is full and pop when it is empty.
+bool lexer_set_mode(lexer_t *lexer, uint32_t mode);
+bool lexer_push_mode(lexer_t *lexer, uint32_t mode);
+bool lexer_pop_mode(lexer_t *lexer);
+uint32_t lexer_get_mode(const lexer_t *lexer);
+
+// Reorders the per-byte candidate lists so that the rules that matched most
+// often (as counted with LEXER_FLAG_PROFILE) are tried first. A rule only
+// moves ahead of an earlier one if either is LEXER_RULE_FLAG_ORDER_INDEPENDENT
+// (rules with disjoint first-byte sets never share a list anyway), so the
+// tokens produced do not change. Adding rules afterwards restores the
+// registration order.
+void lexer_optimize_rules(lexer_t *lexer);
+
+// Action marking the token as ignorable (for declarative rules)
+void lexer_action_ignore(lexer_t *lexer, token_t *token);
+
+// Byte set helpers
+void lexer_charset_clear(lexer_charset_t *set);
+void lexer_charset_fill(lexer_charset_t *set);
+void lexer_charset_add(lexer_charset_t *set, unsigned char c);
+void lexer_charset_add_range(lexer_charset_t *set, unsigned char low,
+                             unsigned char high);
+void lexer_charset_add_string(lexer_charset_t *set, const char *bytes);
+bool lexer_charset_has(const lexer_charset_t *set, unsigned char c);
+// Adds every byte of a character class (e.g. to build a `first` set)
+void lexer_charset_add_class(lexer_charset_t *set, const lexer_t *lexer,
+                             uint32_t class_id);
 
 // Core lexing operations
 token_t lexer_next_token(lexer_t *lexer);
+// Same as lexer_next_token, producing a compact token. Combine with
+// LEXER_FLAG_LAZY_LOCATION to skip line/column tracking entirely.
+compact_token_t lexer_next_compact_token(lexer_t *lexer);
+// Token `k` positions ahead (0 is the one lexer_next_token returns next),
+// or NULL if k >= LEXER_LOOKAHEAD_MAX. Tokens are lexed once, into a ring that
+// lexer_next_token, lexer_next_compact_token and lexer_tokenize_all consume
+// first; the pointer stays valid until that token is consumed. Actions run
+// when a token is lexed, so a mode switch made by a peeked token's action
+// applies to the tokens after it, and the lexer position, line and column are
+// those after the last token lexed. lexer_get_number still describes the last
+// token returned.
+const token_t *lexer_peek_token(lexer_t *lexer, size_t k);
+// Lexes from the current position to the end of the input into `out`,
+// replacing its contents and resetting its cursor. The last entry is the EOF
+// token. Returns false if the source does not fit 32-bit offsets.
+bool lexer_tokenize_all(lexer_t *lexer, token_buffer_t *out);
+
+// Checkpoints for backtracking. A mark is a small value holding the position,
+// location and modes before the next token. Rewinding to a mark taken since
+// the oldest token still in the lookahead ring only moves an index; otherwise
+// the state is restored and the tokens are lexed again (running their actions
+// again). Marks are invalidated by lexer_set_source and lexer_reset.
+lexer_mark_t lexer_mark(const lexer_t *lexer);
+void lexer_rewind(lexer_t *lexer, lexer_mark_t mark);
+
+// Token buffer management
+void token_buffer_init(token_buffer_t *buffer, bool locations);
+void token_buffer_free(token_buffer_t *buffer);
+// Cursor over a filled buffer: token_buffer_next returns the index of the
+// next token and moves past it, token_buffer_peek the index `k` tokens ahead.
+// Both stop at the final EOF entry. A mark is just the cursor.
+size_t token_buffer_next(token_buffer_t *buffer);
+size_t token_buffer_peek(const token_buffer_t *buffer, size_t k);
+size_t token_buffer_mark(const token_buffer_t *buffer);
+void token_buffer_rewind(token_buffer_t *buffer, size_t mark);
 void lexer_reset(lexer_t *lexer, const char *source, size_t length,
                  const char *filename);
 
+// Source registry. A lexer owns a copy of each filename and a lazily built
+// line index per source; the text must outlive the tokens that refer to it.
+// lexer_create and lexer_reset register their source too: the same text,
+// length and filename map to the same id, found by hashing. Sources stay
+// registered, and filenames valid, until lexer_destroy.
+source_id_t lexer_register_source(lexer_t *lexer, const char *filename,
+                                  const char *text, size_t length);
+// Restarts lexing at the beginning of a registered source
+bool lexer_set_source(lexer_t *lexer, source_id_t id);
+source_id_t lexer_get_source_id(const lexer_t *lexer);
+size_t lexer_source_count(const lexer_t *lexer);
+const char *lexer_source_filename(const lexer_t *lexer, source_id_t id);
+const char *lexer_source_text(const lexer_t *lexer, source_id_t id,
+                              size_t *length);
+// Line and column of a byte offset in any registered source
+bool lexer_source_location(const lexer_t *lexer, source_id_t id,
+                           size_t offset, size_t *line, size_t *column);
+
 // Source inspection utilities
 char lexer_peek(const lexer_t *lexer, size_t offset);
 char lexer_current(const lexer_t *lexer);
 void lexer_advance(lexer_t *lexer);
+// Bulk versions of lexer_advance: newlines in the skipped range are counted
+// with SIMD when available, and line/column are updated once.
+// lexer_advance_n stops at the end of the source, and lexer_advance_to
+// ignores pointers outside [current position, end of source].
+void lexer_advance_n(lexer_t *lexer, size_t count);
+void lexer_advance_to(lexer_t *lexer, const char *ptr);
 bool lexer_is_eof(const lexer_t *lexer);
+// Length of the run of [A-Za-z0-9_] bytes at the current position, scanned
+// 16/32 bytes at a time. The _utf8 variant also accepts every byte of a
+// multi-byte UTF-8 sequence (>= 0x80).
+size_t lexer_scan_ident(const lexer_t *lexer);
+size_t lexer_scan_ident_utf8(const lexer_t *lexer);
+// Length of the identifier at the current position, where the first code
+// point is XID_Start (or '_') and the others XID_Continue. ASCII runs are
+// scanned by blocks and only sequences starting with a high byte are decoded.
+size_t lexer_scan_xid(const lexer_t *lexer);
 
 // Location information
 size_t lexer_get_position(const lexer_t *lexer);
 size_t lexer_get_line(const lexer_t *lexer);
 size_t lexer_get_column(const lexer_t *lexer);
+// Value of the last number decoded by a number rule
+const lexer_number_t *lexer_get_number(const lexer_t *lexer);
+// Line and column (1-based) of a byte offset, found by binary search in the
+// newline index. Returns false if the offset is past the end of the source.
+bool lexer_offset_to_location(const lexer_t *lexer, size_t offset,
+                              size_t *line, size_t *column);
+
+// Compact token accessors. The source a token refers to must still be alive.
+const char *lexer_compact_lexeme(const lexer_t *lexer, compact_token_t token);
+const char *lexer_compact_filename(const lexer_t *lexer,
+                                   compact_token_t token);
+bool lexer_compact_location(const lexer_t *lexer, compact_token_t token,
+                            size_t *line, size_t *column);
 
 // Lexeme management
 const char *lexer_get_lexeme(const lexer_t *lexer, size_t start, size_t length);
@@ -188,216 +800,3244 @@ typedef struct lexer_error_t {
 lexer_error_t *lexer_get_error(const lexer_t *lexer);
 
 // Character classification helpers (for implementing matchers)
-bool lexer_is_digit(char c);
-bool lexer_is_alpha(char c);
-bool lexer_is_alnum(char c);
-bool lexer_is_space(char c);
+static inline bool lexer_is_digit(char c) {
+  return lexer_class_table[(unsigned char)c] & (1u << LEXER_CLASS_DIGIT);
+}
 
-token_t create_token(uint32_t kind, const char *lexeme, size_t length,
-                     size_t line, size_t column, const char *filename,
-                     uint32_t flags);
+static inline bool lexer_is_alpha(char c) {
+  return lexer_class_table[(unsigned char)c] & (1u << LEXER_CLASS_ALPHA);
+}
 
-#ifdef LEXER_IMPL
+static inline bool lexer_is_alnum(char c) {
+  return lexer_class_table[(unsigned char)c] & (1u << LEXER_CLASS_ALNUM);
+}
 
-lexer_t *lexer_create(const char *source, size_t length, const char *filename,
-                      uint32_t flags) {
-  if (source == NULL) {
-    return NULL;
-  }
-  lexer_t *lexer = malloc(sizeof(lexer_t));
-  if (lexer == NULL) {
-    return NULL;
-  }
-  if (length == 0) {
-    length = strlen(source);
-  }
+static inline bool lexer_is_space(char c) {
+  return lexer_class_table[(unsigned char)c] & (1u << LEXER_CLASS_SPACE);
+}
 
-  lexer->source = source;
-  lexer->source_length = length;
-  lexer->position = 0;
+// Decodes the UTF-8 sequence at `p` into `code_point`. Returns its length, or
+// 0 if it is invalid (truncated, overlong, surrogate or above U+10FFFF).
+size_t lexer_utf8_decode(const char *p, size_t length, uint32_t *code_point);
+// Unicode identifier properties (XID_Start also accepts '_')
+bool lexer_is_xid_start(uint32_t code_point);
+bool lexer_is_xid_continue(uint32_t code_point);
 
-  lexer->filename = filename;
-  lexer->line = 1;
-  lexer->column = 1;
+// Adds the bytes of `bytes` to the class `name`, creating it if needed.
+// Changes only affect this lexer. The built-in classes (digit, alpha, alnum,
+// space, xdigit, upper and lower) cannot be changed, as the lexer_is_*
+// helpers, the built-in rules and the regex escapes read the shared table.
+// Returns the class id, or -1 if `name` is a built-in class or
+// LEXER_CLASS_MAX classes already exist.
+int32_t lexer_define_class(lexer_t *lexer, const char *name,
+                           const char *bytes);
+// Id of the class `name`, or -1
+int32_t lexer_find_class(const lexer_t *lexer, const char *name);
 
-  lexer->rules = (lexer_rules_t){0};
+static inline bool lexer_in_class(const lexer_t *lexer, unsigned char c,
+                                  uint32_t class_id) {
+  return (lexer->classes[c] >> class_id) & 1;
+}
 
-  lexer->context = NULL;
+token_t create_token(uint32_t kind, const char *lexeme, size_t length,
+                     size_t line, size_t column, const char *filename,
+                     uint32_t flags);
 
-  lexer->flags = flags;
+#ifdef __cplusplus
+}
+#endif
 
-  return lexer;
+#ifdef LEXER_IMPL
+
+// Define LEXER_NO_SIMD to force the scalar code paths
+#ifndef LEXER_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LEXER_SIMD_AVX2
+#define LEXER_SIMD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEXER_SIMD_SSE2
+#endif
+#endif // LEXER_NO_SIMD
+
+static inline unsigned lexer_popcount32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_popcount(x);
+#else
+  x = x - ((x >> 1) & 0x55555555u);
+  x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+  return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+#endif
 }
 
-void lexer_destroy(lexer_t *lexer) {
-  if (lexer == NULL) {
-    return;
+// Index of the lowest set bit (x != 0)
+static inline unsigned lexer_lowest_bit32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_ctz(x);
+#else
+  unsigned i = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    i++;
   }
-  da_free(lexer->rules);
-  free(lexer);
+  return i;
+#endif
 }
 
-bool lexer_add_rule(lexer_t *lexer, token_matcher_fn matcher,
-                    token_action_fn action) {
-  if (lexer == NULL || matcher == NULL) {
-    return false;
+// Index of the highest set bit (x != 0)
+static inline unsigned lexer_highest_bit32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 31u - (unsigned)__builtin_clz(x);
+#else
+  unsigned i = 0;
+  while (x >>= 1) {
+    i++;
   }
-  lexer_rule_t new_rule;
-  new_rule.matcher = matcher;
-  new_rule.action = action;
-  da_append(&lexer->rules, new_rule);
-  return true;
+  return i;
+#endif
 }
 
-void lexer_reset(lexer_t *lexer, const char *source, size_t length,
-                 const char *filename) {
-  if (lexer == NULL || source == NULL) {
-    return;
+// Counts the '\n' in [p, p + count) and stores the last one in `last`
+// (untouched if there is none)
+static size_t lexer_count_newlines(const char *p, size_t count,
+                                   const char **last) {
+  size_t newlines = 0;
+  size_t i = 0;
+#if defined(LEXER_SIMD_AVX2)
+  const __m256i newline32 = _mm256_set1_epi8('\n');
+  for (; i + 32 <= count; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+    uint32_t mask =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline32));
+    if (mask != 0) {
+      newlines += lexer_popcount32(mask);
+      *last = p + i + lexer_highest_bit32(mask);
+    }
   }
-  if (length == 0) {
-    length = strlen(source);
+#endif
+#if defined(LEXER_SIMD_SSE2)
+  const __m128i newline16 = _mm_set1_epi8('\n');
+  for (; i + 16 <= count; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+    uint32_t mask =
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline16));
+    if (mask != 0) {
+      newlines += lexer_popcount32(mask);
+      *last = p + i + lexer_highest_bit32(mask);
+    }
   }
-  lexer->source = source;
-  lexer->source_length = length;
-  lexer->position = 0;
+#endif
+  for (; i < count; ++i) {
+    if (p[i] == '\n') {
+      newlines++;
+      *last = p + i;
+    }
+  }
+  return newlines;
+}
 
-  lexer->filename = filename;
-  lexer->line = 1;
-  lexer->column = 1;
+#if defined(LEXER_SIMD_SSE2)
+// Lanes of `block` in [low, high] (unsigned), using the signed comparison
+// available in SSE2: c is in range iff (c - low) ^ 0x80 <= (high - low) ^ 0x80
+static inline __m128i lexer_in_range16(__m128i block, char low, char high) {
+  __m128i shifted = _mm_add_epi8(block, _mm_set1_epi8((char)(0x80 - low)));
+  __m128i limit = _mm_set1_epi8((char)((high - low) ^ 0x80));
+  return _mm_andnot_si128(_mm_cmpgt_epi8(shifted, limit),
+                          _mm_set1_epi8((char)0xFF));
 }
 
-char lexer_current(const lexer_t *lexer) {
-  if (lexer == NULL || lexer->position >= lexer->source_length) {
-    return 0;
+// Identifier bytes of a 16-byte block, as a movemask
+static inline uint32_t lexer_ident_mask16(__m128i block, bool utf8) {
+  __m128i letters =
+      lexer_in_range16(_mm_or_si128(block, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i digits = lexer_in_range16(block, '0', '9');
+  __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+  __m128i ident = _mm_or_si128(_mm_or_si128(letters, digits), underscore);
+  uint32_t mask = (uint32_t)_mm_movemask_epi8(ident);
+  if (utf8) {
+    mask |= (uint32_t)_mm_movemask_epi8(block);
   }
-  return lexer->source[lexer->position];
+  return mask;
 }
+#endif
 
-char lexer_peek(const lexer_t *lexer, size_t offset) {
-  if (lexer == NULL || lexer->position + offset >= lexer->source_length) {
-    return '\0';
-  }
-  return lexer->source[lexer->position + offset];
+#if defined(LEXER_SIMD_AVX2)
+static inline __m256i lexer_in_range32(__m256i block, char low, char high) {
+  __m256i shifted =
+      _mm256_add_epi8(block, _mm256_set1_epi8((char)(0x80 - low)));
+  __m256i limit = _mm256_set1_epi8((char)((high - low) ^ 0x80));
+  return _mm256_andnot_si256(_mm256_cmpgt_epi8(shifted, limit),
+                             _mm256_set1_epi8((char)0xFF));
 }
 
-void lexer_advance(lexer_t *lexer) {
-  if (lexer == NULL || lexer->position >= lexer->source_length) {
-    return;
+static inline uint32_t lexer_ident_mask32(__m256i block, bool utf8) {
+  __m256i letters = lexer_in_range32(
+      _mm256_or_si256(block, _mm256_set1_epi8(0x20)), 'a', 'z');
+  __m256i digits = lexer_in_range32(block, '0', '9');
+  __m256i underscore = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+  __m256i ident =
+      _mm256_or_si256(_mm256_or_si256(letters, digits), underscore);
+  uint32_t mask = (uint32_t)_mm256_movemask_epi8(ident);
+  if (utf8) {
+    mask |= (uint32_t)_mm256_movemask_epi8(block);
   }
-  char current = lexer->source[lexer->position++];
+  return mask;
+}
+#endif
 
-  if (current == '\n') {
-    lexer->line++;
-    lexer->column = 1;
-  } else {
-    lexer->column++;
+// Length of the run of identifier bytes at `p`
+static size_t lexer_ident_run(const char *p, size_t length, bool utf8) {
+  size_t i = 0;
+#if defined(LEXER_SIMD_AVX2)
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+    uint32_t mask = lexer_ident_mask32(block, utf8);
+    if (mask != 0xFFFFFFFFu) {
+      return i + lexer_lowest_bit32(~mask);
+    }
+  }
+#endif
+#if defined(LEXER_SIMD_SSE2)
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+    uint32_t mask = lexer_ident_mask16(block, utf8);
+    if (mask != 0xFFFFu) {
+      return i + lexer_lowest_bit32(~mask);
+    }
+  }
+#endif
+  while (i < length &&
+         (lexer_is_alnum(p[i]) || (utf8 && (unsigned char)p[i] >= 0x80))) {
+    i++;
   }
+  return i;
 }
 
-bool lexer_is_eof(const lexer_t *lexer) {
-  return lexer == NULL || lexer->position >= lexer->source_length;
+// Offset of the first of the bytes `a`, `b` and `c` at `p`, or `length`
+static size_t lexer_find_byte3(const char *p, size_t length, char a, char b,
+                               char c) {
+  size_t i = 0;
+#if defined(LEXER_SIMD_AVX2)
+  const __m256i wide_a = _mm256_set1_epi8(a);
+  const __m256i wide_b = _mm256_set1_epi8(b);
+  const __m256i wide_c = _mm256_set1_epi8(c);
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i hits = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, wide_a),
+                        _mm256_cmpeq_epi8(block, wide_b)),
+        _mm256_cmpeq_epi8(block, wide_c));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+    if (mask != 0) {
+      return i + lexer_lowest_bit32(mask);
+    }
+  }
+#endif
+#if defined(LEXER_SIMD_SSE2)
+  const __m128i narrow_a = _mm_set1_epi8(a);
+  const __m128i narrow_b = _mm_set1_epi8(b);
+  const __m128i narrow_c = _mm_set1_epi8(c);
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, narrow_a),
+                                             _mm_cmpeq_epi8(block, narrow_b)),
+                                _mm_cmpeq_epi8(block, narrow_c));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+    if (mask != 0) {
+      return i + lexer_lowest_bit32(mask);
+    }
+  }
+#endif
+  while (i < length && p[i] != a && p[i] != b && p[i] != c) {
+    i++;
+  }
+  return i;
 }
 
-void *lexer_get_context(lexer_t *lexer) {
-  if (lexer == NULL) {
-    return NULL;
+// Length of the string literal at `p` (which starts with the quote), or 0 if
+// it is not terminated
+static size_t lexer_scan_string(const lexer_string_config_t *config,
+                                const char *p, size_t length,
+                                bool *has_escapes) {
+  // Unused stops fall back to the quote so a single search covers them all
+  const char escape = config->escape != '\0' ? config->escape : config->quote;
+  const char newline = config->allow_newlines ? config->quote : '\n';
+  size_t i = 1;
+  *has_escapes = false;
+  while (i < length) {
+    i += lexer_find_byte3(p + i, length - i, config->quote, escape, newline);
+    if (i >= length) {
+      break;
+    }
+    if (p[i] == config->quote) {
+      return i + 1;
+    }
+    if (p[i] == escape) {
+      // The escaped byte is skipped, whatever it is
+      *has_escapes = true;
+      i += 2;
+      continue;
+    }
+    // Raw newline
+    return 0;
   }
-  return lexer->context;
+  return 0;
 }
 
-token_t create_token(uint32_t kind, const char *lexeme, size_t length,
-                     size_t line, size_t column, const char *filename,
-                     uint32_t flags) {
-  token_t token;
-  token.kind = kind;
-  token.lexeme = lexeme;
-  token.line = line;
-  token.column = column;
-  token.length = length;
-  token.filename = filename;
-  token.flags = flags;
-  return token;
+// Whether `delimiter` starts at p[i]
+static inline bool lexer_delimiter_at(const char *p, size_t length, size_t i,
+                                      const char *delimiter,
+                                      size_t delimiter_length) {
+  return delimiter != NULL && length - i >= delimiter_length &&
+         memcmp(p + i, delimiter, delimiter_length) == 0;
 }
 
-token_t lexer_next_token(lexer_t *lexer) {
-
-  if (lexer == NULL || lexer_is_eof(lexer)) {
-    return create_token(INTERNAL_TOKEN_EOF, "EOF", 0, lexer ? lexer->line : 0,
-                        lexer ? lexer->column : 0, lexer ? lexer->filename : 0,
-                        0);
-  }
-
-  token_t token = {0};
-  int reset = false;
-
-  while (true) {
-    // Save starting position for each token attempt
-    size_t start_position = lexer->position;
-    size_t start_line = lexer->line;
-    size_t start_column = lexer->column;
-
-    for (size_t i = 0; i < lexer->rules.count; ++i) {
-      // Set initial token position for each rule attempt
-      token.line = start_line;
-      token.column = start_column;
-      token.lexeme = lexer->source + start_position;
-      // printf("Trying rule %ld\n", i);
-      if (reset) {
-        i = 0;
-      }
-      lexer_rule_t rule = lexer->rules.items[i];
-      if (rule.matcher(lexer, &token)) {
-        // Successful match
-
-        if (rule.action) {
-          rule.action(lexer, &token);
+// Offset of the first occurrence of `a` or `b` (which may be NULL) at `p`, or
+// `length`. Blocks of positions are filtered by the first and last bytes of
+// the delimiters, and only the survivors are compared in full.
+static size_t lexer_find_delimiters(const char *p, size_t length,
+                                    const char *a, size_t a_length,
+                                    const char *b, size_t b_length) {
+  size_t i = 0;
+#if defined(LEXER_SIMD_SSE2)
+  // Positions whose last-byte load stays inside the input
+  size_t reach = b != NULL && b_length > a_length ? b_length : a_length;
+  size_t limit = length >= reach - 1 ? length - (reach - 1) : 0;
+#if defined(LEXER_SIMD_AVX2)
+  {
+    const __m256i a_first = _mm256_set1_epi8(a[0]);
+    const __m256i a_last = _mm256_set1_epi8(a[a_length - 1]);
+    const __m256i b_first = _mm256_set1_epi8(b != NULL ? b[0] : a[0]);
+    const __m256i b_last =
+        _mm256_set1_epi8(b != NULL ? b[b_length - 1] : a[a_length - 1]);
+    const size_t b_gap = b != NULL ? b_length - 1 : a_length - 1;
+    for (; i + 32 <= limit; i += 32) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+      __m256i a_tail =
+          _mm256_loadu_si256((const __m256i *)(p + i + a_length - 1));
+      __m256i b_tail = _mm256_loadu_si256((const __m256i *)(p + i + b_gap));
+      __m256i hits = _mm256_or_si256(
+          _mm256_and_si256(_mm256_cmpeq_epi8(block, a_first),
+                           _mm256_cmpeq_epi8(a_tail, a_last)),
+          _mm256_and_si256(_mm256_cmpeq_epi8(block, b_first),
+                           _mm256_cmpeq_epi8(b_tail, b_last)));
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+      for (; mask != 0; mask &= mask - 1) {
+        size_t at = i + lexer_lowest_bit32(mask);
+        if (lexer_delimiter_at(p, length, at, a, a_length) ||
+            lexer_delimiter_at(p, length, at, b, b_length)) {
+          return at;
         }
-        if (token.flags & TOKEN_FLAG_IGNORE &&
-            !(lexer->flags & LEXER_FLAG_KEEP_IGNORABLE)) {
-          // For ignorable tokens, continue outer loop
-          reset = true;
-          break;
+      }
+    }
+  }
+#endif
+  {
+    const __m128i a_first = _mm_set1_epi8(a[0]);
+    const __m128i a_last = _mm_set1_epi8(a[a_length - 1]);
+    const __m128i b_first = _mm_set1_epi8(b != NULL ? b[0] : a[0]);
+    const __m128i b_last =
+        _mm_set1_epi8(b != NULL ? b[b_length - 1] : a[a_length - 1]);
+    const size_t b_gap = b != NULL ? b_length - 1 : a_length - 1;
+    for (; i + 16 <= limit; i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+      __m128i a_tail = _mm_loadu_si128((const __m128i *)(p + i + a_length - 1));
+      __m128i b_tail = _mm_loadu_si128((const __m128i *)(p + i + b_gap));
+      __m128i hits =
+          _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(block, a_first),
+                                     _mm_cmpeq_epi8(a_tail, a_last)),
+                       _mm_and_si128(_mm_cmpeq_epi8(block, b_first),
+                                     _mm_cmpeq_epi8(b_tail, b_last)));
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+      for (; mask != 0; mask &= mask - 1) {
+        size_t at = i + lexer_lowest_bit32(mask);
+        if (lexer_delimiter_at(p, length, at, a, a_length) ||
+            lexer_delimiter_at(p, length, at, b, b_length)) {
+          return at;
         }
-        // Return copy of successful token
-        return create_token(token.kind, token.lexeme, token.length, token.line,
-                            token.column, token.filename, token.flags);
       }
-
-      // Rule didn't match, reset position
-      lexer->position = start_position;
-      lexer->line = start_line;
-      lexer->column = start_column;
     }
+  }
+#endif
+  for (; i < length; ++i) {
+    if (lexer_delimiter_at(p, length, i, a, a_length) ||
+        lexer_delimiter_at(p, length, i, b, b_length)) {
+      return i;
+    }
+  }
+  return length;
+}
 
-    // If we're not resetting to handle an ignorable token, break
-    if (!reset) {
+// Length of the comment at `p` (which starts with the opening delimiter), or
+// 0 if a block comment is not terminated
+static size_t lexer_scan_comment(const lexer_comment_t *comment, const char *p,
+                                 size_t length) {
+  size_t i = comment->open_length;
+  if (comment->close == NULL) {
+    const char *newline = memchr(p + i, '\n', length - i);
+    return newline != NULL ? (size_t)(newline - p) : length;
+  }
+  const char *open = comment->nested ? comment->open : NULL;
+  size_t depth = 1;
+  while (i < length) {
+    i += lexer_find_delimiters(p + i, length - i, comment->close,
+                               comment->close_length, open,
+                               comment->open_length);
+    if (i >= length) {
       break;
     }
-    reset = false;
+    // The terminator wins when both delimiters start here
+    if (lexer_delimiter_at(p, length, i, comment->close,
+                           comment->close_length)) {
+      i += comment->close_length;
+      if (--depth == 0) {
+        return i;
+      }
+    } else {
+      i += comment->open_length;
+      depth++;
+    }
   }
+  return 0;
+}
 
-  // No rules matched - handle error case
-  if (lexer_is_eof(lexer)) {
-    return create_token(INTERNAL_TOKEN_EOF, "EOF", 0, lexer->line,
-                        lexer->column, lexer->filename, 0);
+// Value of a digit in bases up to 16, or 255
+static inline uint32_t lexer_digit_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return (uint32_t)(c - '0');
   }
-  token_t error =
-      create_token(INTERNAL_TOKEN_ERROR, lexer->source + lexer->position, 1,
-                   lexer->line, lexer->column, lexer->filename, 0);
-  lexer_advance(lexer);
-  return error;
+  c = (char)(c | 0x20);
+  if (c >= 'a' && c <= 'f') {
+    return (uint32_t)(c - 'a' + 10);
+  }
+  return 255;
 }
 
-size_t lexer_get_position(const lexer_t *lexer) {
-  return lexer ? lexer->position : 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LEXER_SWAR_DIGITS
+// Whether the 8 bytes of `chunk` are all ASCII digits
+static inline bool lexer_swar_is_digits(uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0u) |
+          (((chunk + 0x0606060606060606u) & 0xF0F0F0F0F0F0F0F0u) >> 4)) ==
+         0x3333333333333333u;
+}
+
+// Value of 8 ASCII digits (first digit in the low byte)
+static inline uint32_t lexer_swar_parse_digits(uint64_t chunk) {
+  chunk -= 0x3030303030303030u;
+  chunk = (chunk * 10) + (chunk >> 8); // Pairs of digits
+  chunk = (((chunk & 0x000000FF000000FFu) * (100 + (1000000ull << 32))) +
+           (((chunk >> 16) & 0x000000FF000000FFu) * (1 + (10000ull << 32)))) >>
+          32;
+  return (uint32_t)chunk;
+}
+#endif
+
+// Accumulated digits of a number
+typedef struct lexer_digits_t {
+  uint64_t value;
+  size_t count;
+  bool overflow;
+} lexer_digits_t;
+
+// value = value * scale + addend, saturating on overflow
+static inline void lexer_digits_push(lexer_digits_t *digits, uint64_t scale,
+                                     uint64_t addend, size_t count) {
+  if (!digits->overflow && digits->value > (UINT64_MAX - addend) / scale) {
+    digits->overflow = true;
+  }
+  digits->value =
+      digits->overflow ? UINT64_MAX : digits->value * scale + addend;
+  digits->count += count;
+}
+
+// Scans the digits of `base` from p[i], with single separators allowed
+// between two digits. Returns the offset after the last digit.
+static size_t lexer_scan_digits(const char *p, size_t length, size_t i,
+                                uint32_t base, char separator,
+                                lexer_digits_t *digits) {
+  const size_t first = i;
+  while (i < length) {
+#if defined(LEXER_SWAR_DIGITS)
+    if (base == 10) {
+      while (length - i >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p + i, 8);
+        if (!lexer_swar_is_digits(chunk)) {
+          break;
+        }
+        lexer_digits_push(digits, 100000000, lexer_swar_parse_digits(chunk),
+                          8);
+        i += 8;
+      }
+      if (i >= length) {
+        break;
+      }
+    }
+#endif
+    uint32_t value = lexer_digit_value(p[i]);
+    if (value < base) {
+      lexer_digits_push(digits, base, value, 1);
+      i++;
+    } else if (separator != '\0' && p[i] == separator && i > first &&
+               i + 1 < length && lexer_digit_value(p[i + 1]) < base) {
+      i++;
+    } else {
+      break;
+    }
+  }
+  return i;
+}
+
+// Exactly representable powers of ten
+static const double lexer_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Converts p[0 .. length - 1] (a decimal float, separators included) with
+// strtod, for the cases the fast path cannot round correctly. strtod reads the
+// decimal point of the current LC_NUMERIC locale, so '.' is replaced by it.
+static double lexer_slow_float(const char *p, size_t length, char separator) {
+  const char *point = localeconv()->decimal_point;
+  size_t point_length = strlen(point);
+  size_t size = length * (point_length > 1 ? point_length : 1) + 1;
+  char buffer[128];
+  char *text = size <= sizeof(buffer) ? buffer : malloc(size);
+  ASSERT(text != NULL && "No more memory");
+  size_t n = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (p[i] == '.') {
+      memcpy(text + n, point, point_length);
+      n += point_length;
+    } else if (separator == '\0' || p[i] != separator) {
+      text[n++] = p[i];
+    }
+  }
+  text[n] = '\0';
+  double value = strtod(text, NULL);
+  if (text != buffer) {
+    free(text);
+  }
+  return value;
+}
+
+// Length of the number at `p`, or 0. The value is stored in `number` when the
+// rule decodes.
+static size_t lexer_scan_number(const lexer_number_rule_t *rule, const char *p,
+                                size_t length, lexer_number_t *number,
+                                uint32_t *flags) {
+  lexer_digits_t digits = {0};
+  size_t i = 0;
+  uint32_t base = 10;
+  if (length >= 3 && p[0] == '0') {
+    char prefix = (char)(p[1] | 0x20);
+    if (prefix == 'x' && rule->flags & LEXER_NUMBER_HEX) {
+      base = 16;
+    } else if (prefix == 'o' && rule->flags & LEXER_NUMBER_OCTAL) {
+      base = 8;
+    } else if (prefix == 'b' && rule->flags & LEXER_NUMBER_BINARY) {
+      base = 2;
+    }
+    // A prefix needs at least one digit after it
+    if (base != 10 && lexer_digit_value(p[2]) >= base) {
+      base = 10;
+    }
+  }
+
+  bool is_float = false;
+  *flags = 0;
+  if (base != 10) {
+    i = lexer_scan_digits(p, length, 2, base, rule->separator, &digits);
+  } else {
+    i = lexer_scan_digits(p, length, 0, 10, rule->separator, &digits);
+    size_t integer_digits = digits.count;
+    int64_t exponent = 0;
+    if (rule->flags & LEXER_NUMBER_FLOAT) {
+      if (i + 1 < length && p[i] == '.' && lexer_is_digit(p[i + 1])) {
+        is_float = true;
+        i = lexer_scan_digits(p, length, i + 1, 10, rule->separator, &digits);
+        exponent = -(int64_t)(digits.count - integer_digits);
+      }
+      if (digits.count > 0 && i < length && (p[i] | 0x20) == 'e') {
+        size_t j = i + 1;
+        bool negative = false;
+        if (j < length && (p[j] == '+' || p[j] == '-')) {
+          negative = p[j] == '-';
+          j++;
+        }
+        // Without digits, the 'e' is not part of the number
+        if (j < length && lexer_is_digit(p[j])) {
+          lexer_digits_t power = {0};
+          i = lexer_scan_digits(p, length, j, 10, rule->separator, &power);
+          is_float = true;
+          if (power.overflow || power.value > 100000) {
+            digits.overflow = true; // Left to strtod
+          } else {
+            exponent += negative ? -(int64_t)power.value : (int64_t)power.value;
+          }
+        }
+      }
+    }
+    if (digits.count == 0) {
+      return 0;
+    }
+    if (!is_float && rule->flags & LEXER_NUMBER_C_OCTAL && p[0] == '0' &&
+        integer_digits > 1) {
+      lexer_digits_t octal = {0};
+      if (lexer_scan_digits(p, i, 1, 8, rule->separator, &octal) == i) {
+        digits = octal;
+      } else {
+        *flags = TOKEN_FLAG_INVALID; // 8 or 9 in an octal literal
+      }
+    }
+    if (is_float && rule->flags & LEXER_NUMBER_DECODE) {
+      // Clinger's fast path: exact mantissa and power of ten give a
+      // correctly rounded product or quotient
+      if (!digits.overflow && digits.value <= ((uint64_t)1 << 53) &&
+          exponent >= -22 && exponent <= 22) {
+        double mantissa = (double)digits.value;
+        number->real = exponent < 0 ? mantissa / lexer_pow10[-exponent]
+                                    : mantissa * lexer_pow10[exponent];
+      } else {
+        number->real = lexer_slow_float(p, i, rule->separator);
+      }
+    }
+  }
+
+  while (i < length &&
+         lexer_charset_has(&rule->suffixes, (unsigned char)p[i])) {
+    i++;
+  }
+  if (rule->flags & LEXER_NUMBER_DECODE) {
+    number->is_float = is_float;
+    number->overflow = !is_float && digits.overflow;
+    number->integer = is_float ? 0 : digits.value;
+    if (!is_float) {
+      number->real = (double)digits.value;
+    }
+  }
+  return i;
+}
+
+// Length of the UTF-8 identifier at `p`, or 0
+static size_t lexer_xid_length(const char *p, size_t length) {
+  uint32_t code_point = (unsigned char)p[0];
+  size_t i = 1;
+  if (code_point >= 0x80) {
+    i = lexer_utf8_decode(p, length, &code_point);
+    if (i == 0) {
+      return 0;
+    }
+  }
+  if (!lexer_is_xid_start(code_point)) {
+    return 0;
+  }
+  while (i < length) {
+    i += lexer_ident_run(p + i, length - i, false);
+    if (i >= length || (unsigned char)p[i] < 0x80) {
+      break;
+    }
+    size_t sequence = lexer_utf8_decode(p + i, length - i, &code_point);
+    if (sequence == 0 || !lexer_is_xid_continue(code_point)) {
+      break;
+    }
+    i += sequence;
+  }
+  return i;
+}
+
+// Number of UTF-8 code points in p[0 .. count - 1] (bytes that are not
+// continuation bytes)
+static size_t lexer_count_code_points(const char *p, size_t count) {
+  size_t code_points = 0;
+  size_t i = 0;
+#if defined(LEXER_SIMD_AVX2)
+  // Continuation bytes 0x80-0xBF are the signed values -128..-65
+  const __m256i wide_limit = _mm256_set1_epi8(-65);
+  for (; i + 32 <= count; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+    code_points += lexer_popcount32(
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(block, wide_limit)));
+  }
+#endif
+#if defined(LEXER_SIMD_SSE2)
+  const __m128i narrow_limit = _mm_set1_epi8(-65);
+  for (; i + 16 <= count; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+    code_points += lexer_popcount32(
+        (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(block, narrow_limit)));
+  }
+#endif
+  for (; i < count; ++i) {
+    code_points += ((unsigned char)p[i] & 0xC0) != 0x80;
+  }
+  return code_points;
+}
+
+static void lexer_dfa_free(lexer_dfa_t *dfa) {
+  free(dfa->transitions);
+  free(dfa->accept_offsets);
+  free(dfa->accepts);
+  *dfa = (lexer_dfa_t){0};
+}
+
+// Hash of the key a source is found by in the registry (FNV-1a)
+static uint32_t lexer_source_hash(const char *text, size_t length,
+                                  const char *filename) {
+  uint64_t words[2] = {(uint64_t)(uintptr_t)text, (uint64_t)length};
+  const unsigned char *bytes = (const unsigned char *)words;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(words); ++i) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  for (const char *c = filename; c != NULL && *c != '\0'; ++c) {
+    hash = (hash ^ (unsigned char)*c) * 16777619u;
+  }
+  return hash ^ (hash >> 16);
+}
+
+static void lexer_sources_insert(lexer_sources_t *sources, source_id_t id) {
+  const lexer_source_t *source = &sources->items[id];
+  const size_t mask = sources->slot_count - 1;
+  size_t slot =
+      lexer_source_hash(source->text, source->length, source->filename) & mask;
+  while (sources->slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  sources->slots[slot] = id + 1;
+}
+
+// Rebuilds the index of the registry with `slot_count` slots
+static void lexer_sources_rehash(lexer_sources_t *sources,
+                                 size_t slot_count) {
+  free(sources->slots);
+  sources->slots = calloc(slot_count, sizeof(uint32_t));
+  ASSERT(sources->slots != NULL && "No more memory");
+  sources->slot_count = slot_count;
+  for (size_t id = 0; id < sources->count; ++id) {
+    lexer_sources_insert(sources, (source_id_t)id);
+  }
+}
+
+source_id_t lexer_register_source(lexer_t *lexer, const char *filename,
+                                  const char *text, size_t length) {
+  if (lexer == NULL || text == NULL ||
+      lexer->sources.count >= LEXER_SOURCE_INVALID) {
+    return LEXER_SOURCE_INVALID;
+  }
+  if (length == 0) {
+    length = strlen(text);
+  }
+  lexer_source_t source = {NULL, text, length, {0}};
+  if (filename != NULL) {
+    size_t filename_length = strlen(filename);
+    source.filename = malloc(filename_length + 1);
+    ASSERT(source.filename != NULL && "No more memory");
+    memcpy(source.filename, filename, filename_length + 1);
+  }
+  da_append(&lexer->sources, source);
+  lexer_sources_t *sources = &lexer->sources;
+  if (sources->count * 2 > sources->slot_count) {
+    lexer_sources_rehash(sources, sources->slot_count ? sources->slot_count * 2
+                                                      : 64);
+  } else {
+    lexer_sources_insert(sources, (source_id_t)(sources->count - 1));
+  }
+  return (source_id_t)(sources->count - 1);
+}
+
+// Id of a source in the registry, registered if it is new. A known source
+// may have been rewritten in place, so its newline index is dropped.
+static source_id_t lexer_track_source(lexer_t *lexer, const char *text,
+                                      size_t length, const char *filename) {
+  const lexer_sources_t *sources = &lexer->sources;
+  if (sources->slot_count > 0) {
+    const size_t mask = sources->slot_count - 1;
+    for (size_t slot = lexer_source_hash(text, length, filename) & mask;
+         sources->slots[slot] != 0; slot = (slot + 1) & mask) {
+      lexer_source_t *source = &sources->items[sources->slots[slot] - 1];
+      bool same_name = source->filename == NULL || filename == NULL
+                           ? source->filename == filename
+                           : strcmp(source->filename, filename) == 0;
+      if (source->text == text && source->length == length && same_name) {
+        source->newlines.built = false;
+        return sources->slots[slot] - 1;
+      }
+    }
+  }
+  return lexer_register_source(lexer, filename, text, length);
+}
+
+lexer_t *lexer_create(const char *source, size_t length, const char *filename,
+                      uint32_t flags) {
+  if (source == NULL) {
+    return NULL;
+  }
+  lexer_t *lexer = malloc(sizeof(lexer_t));
+  if (lexer == NULL) {
+    return NULL;
+  }
+  if (length == 0) {
+    length = strlen(source);
+  }
+
+  lexer->source = source;
+  lexer->source_length = length;
+  lexer->position = 0;
+
+  lexer->filename = filename;
+  lexer->line = flags & LEXER_FLAG_LAZY_LOCATION ? 0 : 1;
+  lexer->column = flags & LEXER_FLAG_LAZY_LOCATION ? 0 : 1;
+  lexer->sources = (lexer_sources_t){0};
+  lexer->source_id = lexer_track_source(lexer, source, length, filename);
+  lexer->filename = lexer->sources.items[lexer->source_id].filename;
+
+  lexer->rules = (lexer_rules_t){0};
+  lexer->modes = (lexer_modes_t){0};
+  lexer->mode = LEXER_MODE_DEFAULT;
+  lexer->mode_depth = 0;
+  lexer->regexes = (lexer_regexes_t){0};
+  lexer->regexes.cached_position = SIZE_MAX;
+  lexer->keywords = (lexer_keyword_tables_t){0};
+  lexer->literals = (lexer_literal_tables_t){0};
+  lexer->spaces = (lexer_space_sets_t){0};
+  lexer->strings = (lexer_string_configs_t){0};
+  lexer->comments = (lexer_comments_t){0};
+  lexer->numbers = (lexer_number_rules_t){0};
+  lexer->number = (lexer_number_t){0};
+  lexer->lookahead_first = 0;
+  lexer->lookahead_end = 0;
+  lexer->token_index = 0;
+
+  memcpy(lexer->classes, lexer_class_table, sizeof(lexer->classes));
+  memset(lexer->class_names, 0, sizeof(lexer->class_names));
+  lexer->class_count = LEXER_CLASS_BUILTIN_COUNT;
+
+  lexer->context = NULL;
+
+  lexer->flags = flags;
+
+  lexer_define_mode(lexer, "default");
+
+  return lexer;
+}
+
+void lexer_destroy(lexer_t *lexer) {
+  if (lexer == NULL) {
+    return;
+  }
+  da_free(lexer->rules);
+  for (size_t i = 0; i < lexer->sources.count; ++i) {
+    free(lexer->sources.items[i].filename);
+    da_free(lexer->sources.items[i].newlines);
+  }
+  da_free(lexer->sources);
+  free(lexer->sources.slots);
+  for (size_t i = 0; i < lexer->modes.count; ++i) {
+    free(lexer->modes.items[i].name);
+    free(lexer->modes.items[i].dispatch.items);
+    lexer_dfa_free(&lexer->modes.items[i].dispatch.dfa);
+  }
+  da_free(lexer->modes);
+  da_free(lexer->regexes);
+  da_free(lexer->regexes.nfa);
+  free(lexer->regexes.matches);
+  for (size_t i = 0; i < lexer->keywords.count; ++i) {
+    free(lexer->keywords.items[i].slots);
+    free(lexer->keywords.items[i].storage);
+  }
+  da_free(lexer->keywords);
+  for (size_t i = 0; i < lexer->literals.count; ++i) {
+    free(lexer->literals.items[i].nodes);
+    free(lexer->literals.items[i].edge_bytes);
+    free(lexer->literals.items[i].edge_targets);
+  }
+  da_free(lexer->literals);
+  da_free(lexer->spaces);
+  da_free(lexer->strings);
+  for (size_t i = 0; i < lexer->comments.count; ++i) {
+    free(lexer->comments.items[i].open);
+    free(lexer->comments.items[i].close);
+  }
+  da_free(lexer->comments);
+  da_free(lexer->numbers);
+  for (uint32_t i = 0; i < lexer->class_count; ++i) {
+    free(lexer->class_names[i]);
+  }
+  free(lexer);
+}
+
+// Marks every mode's dispatch for rebuilding
+static void lexer_invalidate_dispatch(lexer_t *lexer) {
+  for (size_t i = 0; i < lexer->modes.count; ++i) {
+    lexer->modes.items[i].dispatch.dirty = true;
+  }
+}
+
+// Registers a rule in the default mode
+static void lexer_append_rule(lexer_t *lexer, lexer_rule_t rule) {
+  rule.modes = (uint32_t)1 << LEXER_MODE_DEFAULT;
+  da_append(&lexer->rules, rule);
+  lexer_invalidate_dispatch(lexer);
+}
+
+bool lexer_add_rule(lexer_t *lexer, token_matcher_fn matcher,
+                    token_action_fn action) {
+  return lexer_add_rule_ex(lexer, matcher, action, NULL);
+}
+
+bool lexer_add_rule_ex(lexer_t *lexer, token_matcher_fn matcher,
+                       token_action_fn action, const lexer_charset_t *first) {
+  if (lexer == NULL || matcher == NULL) {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_MATCHER;
+  new_rule.matcher = matcher;
+  new_rule.action = action;
+  if (first == NULL) {
+    lexer_charset_fill(&new_rule.first);
+  } else {
+    new_rule.first = *first;
+  }
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_span_rule(lexer_t *lexer, token_span_fn span, uint32_t kind,
+                         token_action_fn action, const lexer_charset_t *first) {
+  if (lexer == NULL || span == NULL) {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_SPAN;
+  new_rule.span = span;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  if (first == NULL) {
+    lexer_charset_fill(&new_rule.first);
+  } else {
+    new_rule.first = *first;
+  }
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_whitespace_rule(lexer_t *lexer, const char *bytes,
+                               uint32_t kind, token_action_fn action) {
+  if (lexer == NULL) {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_SPACE;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  new_rule.id = (uint32_t)lexer->spaces.count;
+  lexer_charset_clear(&new_rule.first);
+  if (bytes == NULL) {
+    for (unsigned c = 0; c < 256; ++c) {
+      if (lexer_is_space((char)c)) {
+        lexer_charset_add(&new_rule.first, (unsigned char)c);
+      }
+    }
+  } else {
+    lexer_charset_add_string(&new_rule.first, bytes);
+  }
+
+  lexer_space_set_t set = {0};
+  for (unsigned c = 0; c < 256; ++c) {
+    if (!lexer_charset_has(&new_rule.first, (unsigned char)c)) {
+      continue;
+    }
+    if (set.count == LEXER_SPACE_SIMD_MAX) {
+      set.count = 0;
+      break;
+    }
+    set.bytes[set.count++] = (uint8_t)c;
+  }
+
+  da_append(&lexer->spaces, set);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_identifier_rule(lexer_t *lexer, uint32_t kind,
+                               token_action_fn action) {
+  if (lexer == NULL) {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_IDENT;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  lexer_charset_clear(&new_rule.first);
+  lexer_charset_add_range(&new_rule.first, 'a', 'z');
+  lexer_charset_add_range(&new_rule.first, 'A', 'Z');
+  lexer_charset_add(&new_rule.first, '_');
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_string_rule(lexer_t *lexer,
+                           const lexer_string_config_t *config, uint32_t kind,
+                           token_action_fn action) {
+  if (lexer == NULL || config == NULL || config->quote == '\0') {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_STRING;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  new_rule.id = (uint32_t)lexer->strings.count;
+  lexer_charset_clear(&new_rule.first);
+  lexer_charset_add(&new_rule.first, (unsigned char)config->quote);
+  da_append(&lexer->strings, *config);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+// Registers a comment rule, copying the delimiters
+static bool lexer_add_comment_rule(lexer_t *lexer, const char *open,
+                                   const char *close, bool nested,
+                                   uint32_t kind, token_action_fn action) {
+  if (lexer == NULL || open == NULL || open[0] == '\0' ||
+      (close != NULL && close[0] == '\0')) {
+    return false;
+  }
+  lexer_comment_t comment = {0};
+  comment.open_length = strlen(open);
+  comment.open = malloc(comment.open_length + 1);
+  ASSERT(comment.open != NULL && "No more memory");
+  memcpy(comment.open, open, comment.open_length + 1);
+  if (close != NULL) {
+    comment.close_length = strlen(close);
+    comment.close = malloc(comment.close_length + 1);
+    ASSERT(comment.close != NULL && "No more memory");
+    memcpy(comment.close, close, comment.close_length + 1);
+    // Nesting is meaningless when both delimiters are the same
+    comment.nested = nested && strcmp(open, close) != 0;
+  }
+
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_COMMENT;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  new_rule.id = (uint32_t)lexer->comments.count;
+  lexer_charset_clear(&new_rule.first);
+  lexer_charset_add(&new_rule.first, (unsigned char)open[0]);
+  da_append(&lexer->comments, comment);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_line_comment_rule(lexer_t *lexer, const char *prefix,
+                                 uint32_t kind, token_action_fn action) {
+  return lexer_add_comment_rule(lexer, prefix, NULL, false, kind, action);
+}
+
+bool lexer_add_block_comment_rule(lexer_t *lexer, const char *open,
+                                  const char *close, bool nested,
+                                  uint32_t kind, token_action_fn action) {
+  if (close == NULL) {
+    return false;
+  }
+  return lexer_add_comment_rule(lexer, open, close, nested, kind, action);
+}
+
+bool lexer_add_number_rule(lexer_t *lexer,
+                           const lexer_number_config_t *config, uint32_t kind,
+                           token_action_fn action) {
+  if (lexer == NULL || config == NULL) {
+    return false;
+  }
+  lexer_number_rule_t number = {0};
+  number.flags = config->flags;
+  number.separator = config->separator;
+  lexer_charset_clear(&number.suffixes);
+  if (config->suffixes != NULL) {
+    lexer_charset_add_string(&number.suffixes, config->suffixes);
+  }
+
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_NUMBER;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  new_rule.id = (uint32_t)lexer->numbers.count;
+  lexer_charset_clear(&new_rule.first);
+  lexer_charset_add_range(&new_rule.first, '0', '9');
+  if (config->flags & LEXER_NUMBER_FLOAT) {
+    lexer_charset_add(&new_rule.first, '.');
+  }
+  da_append(&lexer->numbers, number);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+bool lexer_add_utf8_identifier_rule(lexer_t *lexer, uint32_t kind,
+                                    token_action_fn action) {
+  if (lexer == NULL) {
+    return false;
+  }
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_XID;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  lexer_charset_clear(&new_rule.first);
+  lexer_charset_add_range(&new_rule.first, 'a', 'z');
+  lexer_charset_add_range(&new_rule.first, 'A', 'Z');
+  lexer_charset_add(&new_rule.first, '_');
+  // Lead bytes of valid multi-byte sequences
+  lexer_charset_add_range(&new_rule.first, 0xC2, 0xF4);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+void lexer_charset_clear(lexer_charset_t *set) {
+  memset(set->bits, 0, sizeof(set->bits));
+}
+
+void lexer_charset_fill(lexer_charset_t *set) {
+  memset(set->bits, 0xFF, sizeof(set->bits));
+}
+
+void lexer_charset_add(lexer_charset_t *set, unsigned char c) {
+  set->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+void lexer_charset_add_range(lexer_charset_t *set, unsigned char low,
+                             unsigned char high) {
+  for (unsigned c = low; c <= high; ++c) {
+    lexer_charset_add(set, (unsigned char)c);
+  }
+}
+
+void lexer_charset_add_string(lexer_charset_t *set, const char *bytes) {
+  while (*bytes) {
+    lexer_charset_add(set, (unsigned char)*bytes++);
+  }
+}
+
+void lexer_charset_add_class(lexer_charset_t *set, const lexer_t *lexer,
+                             uint32_t class_id) {
+  for (unsigned c = 0; c < 256; ++c) {
+    if (lexer_in_class(lexer, (unsigned char)c, class_id)) {
+      lexer_charset_add(set, (unsigned char)c);
+    }
+  }
+}
+
+bool lexer_charset_has(const lexer_charset_t *set, unsigned char c) {
+  return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+void lexer_action_ignore(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->flags |= TOKEN_FLAG_IGNORE;
+}
+
+// Regex compilation
+
+typedef struct lexer_nfa_frag_t {
+  int32_t start;
+  int32_t end; // Epsilon state whose `out` is still free
+} lexer_nfa_frag_t;
+
+typedef struct lexer_regex_parser_t {
+  const lexer_t *lexer;
+  lexer_nfa_t *nfa;
+  const char *cursor;
+  bool error;
+  size_t start; // First NFA state of the pattern
+} lexer_regex_parser_t;
+
+#define LEXER_REGEX_MAX_REPEAT 255
+
+// Most NFA states one pattern may expand to. Counted repetitions multiply the
+// states of their atom, so nesting them grows exponentially.
+#ifndef LEXER_REGEX_MAX_STATES
+#define LEXER_REGEX_MAX_STATES 16384
+#endif
+
+static int32_t lexer_nfa_state(lexer_nfa_t *nfa, bool consumes) {
+  lexer_nfa_state_t state = {0};
+  state.out = -1;
+  state.out1 = -1;
+  state.accept = -1;
+  state.consumes = consumes;
+  da_append(nfa, state);
+  return (int32_t)nfa->count - 1;
+}
+
+static lexer_nfa_frag_t lexer_nfa_set(lexer_nfa_t *nfa,
+                                      const lexer_charset_t *set) {
+  int32_t start = lexer_nfa_state(nfa, true);
+  int32_t end = lexer_nfa_state(nfa, false);
+  nfa->items[start].set = *set;
+  nfa->items[start].out = end;
+  return (lexer_nfa_frag_t){start, end};
+}
+
+static lexer_nfa_frag_t lexer_nfa_empty(lexer_nfa_t *nfa) {
+  int32_t state = lexer_nfa_state(nfa, false);
+  return (lexer_nfa_frag_t){state, state};
+}
+
+static lexer_nfa_frag_t lexer_nfa_concat(lexer_nfa_t *nfa, lexer_nfa_frag_t a,
+                                         lexer_nfa_frag_t b) {
+  nfa->items[a.end].out = b.start;
+  return (lexer_nfa_frag_t){a.start, b.end};
+}
+
+static lexer_nfa_frag_t lexer_nfa_alt(lexer_nfa_t *nfa, lexer_nfa_frag_t a,
+                                      lexer_nfa_frag_t b) {
+  int32_t start = lexer_nfa_state(nfa, false);
+  int32_t end = lexer_nfa_state(nfa, false);
+  nfa->items[start].out = a.start;
+  nfa->items[start].out1 = b.start;
+  nfa->items[a.end].out = end;
+  nfa->items[b.end].out = end;
+  return (lexer_nfa_frag_t){start, end};
+}
+
+static lexer_nfa_frag_t lexer_nfa_star(lexer_nfa_t *nfa, lexer_nfa_frag_t a) {
+  int32_t start = lexer_nfa_state(nfa, false);
+  int32_t end = lexer_nfa_state(nfa, false);
+  nfa->items[start].out = a.start;
+  nfa->items[start].out1 = end;
+  nfa->items[a.end].out = a.start;
+  nfa->items[a.end].out1 = end;
+  return (lexer_nfa_frag_t){start, end};
+}
+
+static lexer_nfa_frag_t lexer_nfa_plus(lexer_nfa_t *nfa, lexer_nfa_frag_t a) {
+  int32_t end = lexer_nfa_state(nfa, false);
+  nfa->items[a.end].out = a.start;
+  nfa->items[a.end].out1 = end;
+  return (lexer_nfa_frag_t){a.start, end};
+}
+
+static lexer_nfa_frag_t lexer_nfa_quest(lexer_nfa_t *nfa, lexer_nfa_frag_t a) {
+  int32_t start = lexer_nfa_state(nfa, false);
+  int32_t end = lexer_nfa_state(nfa, false);
+  nfa->items[start].out = a.start;
+  nfa->items[start].out1 = end;
+  nfa->items[a.end].out = end;
+  return (lexer_nfa_frag_t){start, end};
+}
+
+// Appends a copy of a fragment whose states were [base, base + count) when
+// `states` was snapshotted from them. A fragment's states are always
+// contiguous since it only links states created while parsing it.
+static lexer_nfa_frag_t lexer_nfa_clone(lexer_nfa_t *nfa, lexer_nfa_frag_t a,
+                                        const lexer_nfa_state_t *states,
+                                        int32_t base, int32_t count) {
+  int32_t delta = (int32_t)nfa->count - base;
+  for (int32_t i = 0; i < count; ++i) {
+    lexer_nfa_state_t state = states[i];
+    if (state.out >= 0) {
+      state.out += delta;
+    }
+    if (state.out1 >= 0) {
+      state.out1 += delta;
+    }
+    da_append(nfa, state);
+  }
+  return (lexer_nfa_frag_t){a.start + delta, a.end + delta};
+}
+
+static int lexer_hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static void lexer_charset_negate(lexer_charset_t *set) {
+  for (size_t i = 0; i < 4; ++i) {
+    set->bits[i] = ~set->bits[i];
+  }
+}
+
+static void lexer_charset_union(lexer_charset_t *set,
+                                const lexer_charset_t *other) {
+  for (size_t i = 0; i < 4; ++i) {
+    set->bits[i] |= other->bits[i];
+  }
+}
+
+// Parses the escape after a '\', returns true if it is a single byte
+// (stored in `byte`), false if it is a class (stored in `set`)
+static bool lexer_regex_escape(lexer_regex_parser_t *parser,
+                               lexer_charset_t *set, unsigned char *byte) {
+  char c = *parser->cursor;
+  if (c == '\0') {
+    parser->error = true;
+    return false;
+  }
+  parser->cursor++;
+  lexer_charset_clear(set);
+  switch (c) {
+  case 'n':
+    *byte = '\n';
+    return true;
+  case 't':
+    *byte = '\t';
+    return true;
+  case 'r':
+    *byte = '\r';
+    return true;
+  case 'f':
+    *byte = '\f';
+    return true;
+  case 'v':
+    *byte = '\v';
+    return true;
+  case '0':
+    *byte = '\0';
+    return true;
+  case 'x': {
+    int high = lexer_hex_value(parser->cursor[0]);
+    int low = high < 0 ? -1 : lexer_hex_value(parser->cursor[1]);
+    if (low < 0) {
+      parser->error = true;
+      return false;
+    }
+    parser->cursor += 2;
+    *byte = (unsigned char)(high * 16 + low);
+    return true;
+  }
+  case 'd':
+  case 'D':
+    lexer_charset_add_range(set, '0', '9');
+    break;
+  case 'w':
+  case 'W':
+    lexer_charset_add_range(set, 'a', 'z');
+    lexer_charset_add_range(set, 'A', 'Z');
+    lexer_charset_add_range(set, '0', '9');
+    lexer_charset_add(set, '_');
+    break;
+  case 's':
+  case 'S':
+    for (unsigned b = 0; b < 256; ++b) {
+      if (lexer_is_space((char)b)) {
+        lexer_charset_add(set, (unsigned char)b);
+      }
+    }
+    break;
+  default:
+    *byte = (unsigned char)c;
+    return true;
+  }
+  if (c == 'D' || c == 'W' || c == 'S') {
+    lexer_charset_negate(set);
+  }
+  return false;
+}
+
+static void lexer_regex_class(lexer_regex_parser_t *parser,
+                              lexer_charset_t *set) {
+  bool negate = false;
+  lexer_charset_clear(set);
+  if (*parser->cursor == '^') {
+    negate = true;
+    parser->cursor++;
+  }
+  bool first = true;
+  while (first || *parser->cursor != ']') {
+    first = false;
+    char c = *parser->cursor;
+    if (c == '\0') {
+      parser->error = true;
+      return;
+    }
+    parser->cursor++;
+
+    if (c == '[' && *parser->cursor == ':') {
+      // Named class: [:name:]
+      const char *name = parser->cursor + 1;
+      const char *name_end = strstr(name, ":]");
+      char buffer[64];
+      size_t name_length = name_end != NULL ? (size_t)(name_end - name) : 0;
+      if (name_length == 0 || name_length >= sizeof(buffer)) {
+        parser->error = true;
+        return;
+      }
+      memcpy(buffer, name, name_length);
+      buffer[name_length] = '\0';
+      int32_t class_id = lexer_find_class(parser->lexer, buffer);
+      if (class_id < 0) {
+        parser->error = true;
+        return;
+      }
+      lexer_charset_add_class(set, parser->lexer, (uint32_t)class_id);
+      parser->cursor = name_end + 2;
+      continue;
+    }
+
+    unsigned char low = (unsigned char)c;
+    if (c == '\\') {
+      lexer_charset_t escaped;
+      if (!lexer_regex_escape(parser, &escaped, &low)) {
+        if (parser->error) {
+          return;
+        }
+        lexer_charset_union(set, &escaped);
+        continue;
+      }
+    }
+
+    if (parser->cursor[0] == '-' && parser->cursor[1] != ']' &&
+        parser->cursor[1] != '\0') {
+      parser->cursor++;
+      unsigned char high = (unsigned char)*parser->cursor++;
+      if (high == '\\') {
+        lexer_charset_t escaped;
+        if (!lexer_regex_escape(parser, &escaped, &high)) {
+          parser->error = true;
+          return;
+        }
+      }
+      if (high < low) {
+        parser->error = true;
+        return;
+      }
+      lexer_charset_add_range(set, low, high);
+    } else {
+      lexer_charset_add(set, low);
+    }
+  }
+  parser->cursor++; // ']'
+  if (negate) {
+    lexer_charset_negate(set);
+  }
+}
+
+static lexer_nfa_frag_t lexer_regex_alternation(lexer_regex_parser_t *parser);
+
+static lexer_nfa_frag_t lexer_regex_atom(lexer_regex_parser_t *parser) {
+  lexer_nfa_t *nfa = parser->nfa;
+  lexer_charset_t set;
+  lexer_charset_clear(&set);
+  char c = *parser->cursor++;
+  switch (c) {
+  case '(': {
+    lexer_nfa_frag_t inner = lexer_regex_alternation(parser);
+    if (*parser->cursor != ')') {
+      parser->error = true;
+      return inner;
+    }
+    parser->cursor++;
+    return inner;
+  }
+  case '[':
+    lexer_regex_class(parser, &set);
+    break;
+  case '.':
+    lexer_charset_fill(&set);
+    set.bits['\n' >> 6] &= ~((uint64_t)1 << ('\n' & 63));
+    break;
+  case '\\': {
+    unsigned char byte;
+    if (lexer_regex_escape(parser, &set, &byte)) {
+      lexer_charset_add(&set, byte);
+    }
+    break;
+  }
+  case '*':
+  case '+':
+  case '?':
+    // Nothing to repeat
+    parser->error = true;
+    break;
+  default:
+    lexer_charset_add(&set, (unsigned char)c);
+    break;
+  }
+  return lexer_nfa_set(nfa, &set);
+}
+
+static bool lexer_regex_count(lexer_regex_parser_t *parser, size_t *count) {
+  if (!lexer_is_digit(*parser->cursor)) {
+    return false;
+  }
+  *count = 0;
+  while (lexer_is_digit(*parser->cursor)) {
+    *count = *count * 10 + (size_t)(*parser->cursor++ - '0');
+    if (*count > LEXER_REGEX_MAX_REPEAT) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Expands a{min,max} (max == SIZE_MAX for a{min,})
+static lexer_nfa_frag_t lexer_regex_bounded(lexer_regex_parser_t *parser,
+                                            lexer_nfa_frag_t atom, int32_t base,
+                                            size_t min, size_t max) {
+  lexer_nfa_t *nfa = parser->nfa;
+  int32_t count = (int32_t)nfa->count - base;
+  size_t copies = max == SIZE_MAX ? (min == 0 ? 1 : min + 1) : max;
+  if (copies == 0) {
+    return lexer_nfa_empty(nfa);
+  }
+  // Each copy is the atom plus at most two states for `?` or `*`
+  if (nfa->count - parser->start + copies * ((size_t)count + 2) >
+      LEXER_REGEX_MAX_STATES) {
+    parser->error = true;
+    return atom;
+  }
+
+  // The copies are made from the atom as parsed: linking the first copy
+  // rewrites the `out` edges of its end state
+  lexer_nfa_state_t *states = NULL;
+  if (copies > 1) {
+    states = malloc((size_t)count * sizeof(lexer_nfa_state_t));
+    ASSERT(states != NULL && "No more memory");
+    memcpy(states, nfa->items + base,
+           (size_t)count * sizeof(lexer_nfa_state_t));
+  }
+
+  lexer_nfa_frag_t result = lexer_nfa_empty(nfa);
+  for (size_t i = 0; i < copies; ++i) {
+    lexer_nfa_frag_t copy =
+        i == 0 ? atom : lexer_nfa_clone(nfa, atom, states, base, count);
+    if (i >= min) {
+      copy = max == SIZE_MAX ? lexer_nfa_star(nfa, copy)
+                             : lexer_nfa_quest(nfa, copy);
+    }
+    result = lexer_nfa_concat(nfa, result, copy);
+  }
+  free(states);
+  return result;
+}
+
+static lexer_nfa_frag_t lexer_regex_repeat(lexer_regex_parser_t *parser) {
+  lexer_nfa_t *nfa = parser->nfa;
+  int32_t base = (int32_t)nfa->count;
+  lexer_nfa_frag_t frag = lexer_regex_atom(parser);
+
+  while (!parser->error) {
+    char c = *parser->cursor;
+    if (c == '*') {
+      frag = lexer_nfa_star(nfa, frag);
+    } else if (c == '+') {
+      frag = lexer_nfa_plus(nfa, frag);
+    } else if (c == '?') {
+      frag = lexer_nfa_quest(nfa, frag);
+    } else if (c == '{') {
+      parser->cursor++;
+      size_t min = 0;
+      size_t max = 0;
+      if (!lexer_regex_count(parser, &min)) {
+        parser->error = true;
+        break;
+      }
+      max = min;
+      if (*parser->cursor == ',') {
+        parser->cursor++;
+        max = SIZE_MAX;
+        if (*parser->cursor != '}' && !lexer_regex_count(parser, &max)) {
+          parser->error = true;
+          break;
+        }
+      }
+      if (*parser->cursor != '}' || max < min) {
+        parser->error = true;
+        break;
+      }
+      frag = lexer_regex_bounded(parser, frag, base, min, max);
+    } else {
+      break;
+    }
+    parser->cursor++;
+  }
+  return frag;
+}
+
+static lexer_nfa_frag_t lexer_regex_concat(lexer_regex_parser_t *parser) {
+  lexer_nfa_frag_t frag = lexer_nfa_empty(parser->nfa);
+  while (!parser->error && *parser->cursor != '\0' &&
+         *parser->cursor != '|' && *parser->cursor != ')') {
+    frag = lexer_nfa_concat(parser->nfa, frag, lexer_regex_repeat(parser));
+  }
+  return frag;
+}
+
+static lexer_nfa_frag_t lexer_regex_alternation(lexer_regex_parser_t *parser) {
+  lexer_nfa_frag_t frag = lexer_regex_concat(parser);
+  while (!parser->error && *parser->cursor == '|') {
+    parser->cursor++;
+    frag = lexer_nfa_alt(parser->nfa, frag, lexer_regex_concat(parser));
+  }
+  return frag;
+}
+
+typedef struct lexer_state_list_t {
+  int32_t *items;
+  size_t count;
+  size_t capacity;
+} lexer_state_list_t;
+
+// Epsilon closure of `states`, keeping only consuming and accepting states.
+// `marks` must hold one entry per NFA state, all different from `generation`
+static void lexer_nfa_closure(const lexer_nfa_t *nfa, lexer_state_list_t *stack,
+                              uint32_t *marks, uint32_t generation,
+                              lexer_state_list_t *out) {
+  out->count = 0;
+  while (stack->count > 0) {
+    int32_t s = stack->items[--stack->count];
+    if (s < 0 || marks[s] == generation) {
+      continue;
+    }
+    marks[s] = generation;
+    const lexer_nfa_state_t *state = &nfa->items[s];
+    if (state->consumes || state->accept >= 0) {
+      da_append(out, s);
+    } else {
+      da_append(stack, state->out);
+      da_append(stack, state->out1);
+    }
+  }
+}
+
+static int lexer_compare_states(const void *a, const void *b) {
+  int32_t x = *(const int32_t *)a;
+  int32_t y = *(const int32_t *)b;
+  return (x > y) - (x < y);
+}
+
+bool lexer_add_regex_rule(lexer_t *lexer, const char *pattern, uint32_t kind,
+                          token_action_fn action) {
+  if (lexer == NULL || pattern == NULL) {
+    return false;
+  }
+  lexer_nfa_t *nfa = &lexer->regexes.nfa;
+  size_t mark = nfa->count;
+
+  lexer_regex_parser_t parser = {lexer, nfa, pattern, false, mark};
+  lexer_nfa_frag_t frag = lexer_regex_alternation(&parser);
+  if (parser.error || *parser.cursor != '\0') {
+    nfa->count = mark;
+    return false;
+  }
+  int32_t accept = lexer_nfa_state(nfa, false);
+  nfa->items[accept].accept = (int32_t)lexer->regexes.count;
+  nfa->items[frag.end].out = accept;
+
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_REGEX;
+  new_rule.action = action;
+  new_rule.kind = kind;
+  new_rule.id = (uint32_t)lexer->regexes.count;
+
+  // The rule can start with any byte consumed from its start closure
+  uint32_t *marks = calloc(nfa->count, sizeof(uint32_t));
+  ASSERT(marks != NULL && "No more memory");
+  lexer_state_list_t stack = {0};
+  lexer_state_list_t closure = {0};
+  da_append(&stack, frag.start);
+  lexer_nfa_closure(nfa, &stack, marks, 1, &closure);
+  lexer_charset_clear(&new_rule.first);
+  for (size_t i = 0; i < closure.count; ++i) {
+    if (nfa->items[closure.items[i]].consumes) {
+      lexer_charset_union(&new_rule.first, &nfa->items[closure.items[i]].set);
+    }
+  }
+  free(marks);
+  da_free(stack);
+  da_free(closure);
+
+  lexer_regex_t regex = {frag.start, (uint32_t)lexer->rules.count};
+  da_append(&lexer->regexes, regex);
+  lexer->regexes.matches =
+      REALLOC(lexer->regexes.matches, lexer->regexes.count * sizeof(size_t));
+  ASSERT(lexer->regexes.matches != NULL && "No more memory");
+  lexer->regexes.cached_position = SIZE_MAX;
+
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+// Splits bytes into classes that no NFA transition distinguishes
+static void lexer_dfa_classes(lexer_dfa_t *dfa, const lexer_nfa_t *nfa) {
+  memset(dfa->classes, 0, sizeof(dfa->classes));
+  dfa->class_count = 1;
+  for (size_t s = 0; s < nfa->count; ++s) {
+    if (!nfa->items[s].consumes) {
+      continue;
+    }
+    int16_t split[256][2];
+    memset(split, -1, sizeof(split));
+    uint32_t count = 0;
+    for (unsigned c = 0; c < 256; ++c) {
+      int in = lexer_charset_has(&nfa->items[s].set, (unsigned char)c);
+      int16_t *id = &split[dfa->classes[c]][in];
+      if (*id < 0) {
+        *id = (int16_t)count++;
+      }
+      dfa->classes[c] = (uint8_t)*id;
+    }
+    dfa->class_count = count;
+  }
+}
+
+// Subset construction from the start states of the regexes active in `mode`
+static void lexer_build_dfa(lexer_dfa_t *dfa, const lexer_regexes_t *regexes,
+                            const lexer_rules_t *rules, uint32_t mode) {
+  lexer_dfa_free(dfa);
+  if (regexes->count == 0) {
+    return;
+  }
+  const lexer_nfa_t *nfa = &regexes->nfa;
+  lexer_dfa_classes(dfa, nfa);
+
+  uint8_t representatives[256];
+  for (int c = 255; c >= 0; --c) {
+    representatives[dfa->classes[c]] = (uint8_t)c;
+  }
+
+  // DFA states are sorted NFA state sets, stored back to back in `sets`
+  lexer_state_list_t sets = {0};
+  struct {
+    size_t *items;
+    size_t count;
+    size_t capacity;
+  } offsets = {0};
+  struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+  } transitions = {0}, accept_offsets = {0}, accepts = {0};
+
+  uint32_t *marks = calloc(nfa->count, sizeof(uint32_t));
+  ASSERT(marks != NULL && "No more memory");
+  uint32_t generation = 0;
+  lexer_state_list_t stack = {0};
+  lexer_state_list_t closure = {0};
+
+  // Dead state (empty set), then start state
+  da_append(&offsets, (size_t)0);
+  da_append(&offsets, (size_t)0);
+  for (size_t i = 0; i < regexes->count; ++i) {
+    if ((rules->items[regexes->items[i].rule].modes >> mode) & 1) {
+      da_append(&stack, regexes->items[i].start);
+    }
+  }
+  lexer_nfa_closure(nfa, &stack, marks, ++generation, &closure);
+  qsort(closure.items, closure.count, sizeof(int32_t), lexer_compare_states);
+  for (size_t i = 0; i < closure.count; ++i) {
+    da_append(&sets, closure.items[i]);
+  }
+  da_append(&offsets, sets.count);
+
+  for (size_t state = 0; state + 1 < offsets.count; ++state) {
+    const size_t begin = offsets.items[state];
+    const size_t end = offsets.items[state + 1];
+
+    da_append(&accept_offsets, (uint32_t)accepts.count);
+    for (size_t i = begin; i < end; ++i) {
+      int32_t accept = nfa->items[sets.items[i]].accept;
+      if (accept >= 0) {
+        da_append(&accepts, (uint32_t)accept);
+      }
+    }
+
+    for (uint32_t k = 0; k < dfa->class_count; ++k) {
+      unsigned char byte = representatives[k];
+      for (size_t i = begin; i < end; ++i) {
+        const lexer_nfa_state_t *nfa_state = &nfa->items[sets.items[i]];
+        if (nfa_state->consumes && lexer_charset_has(&nfa_state->set, byte)) {
+          da_append(&stack, nfa_state->out);
+        }
+      }
+      lexer_nfa_closure(nfa, &stack, marks, ++generation, &closure);
+      qsort(closure.items, closure.count, sizeof(int32_t),
+            lexer_compare_states);
+
+      // Find or add the target state
+      uint32_t target = 0;
+      const size_t state_count = offsets.count - 1;
+      for (size_t t = 0; t < state_count; ++t) {
+        size_t length = offsets.items[t + 1] - offsets.items[t];
+        if (length == closure.count &&
+            memcmp(sets.items + offsets.items[t], closure.items,
+                   length * sizeof(int32_t)) == 0) {
+          target = (uint32_t)t;
+          break;
+        }
+      }
+      if (target == 0 && closure.count > 0) {
+        target = (uint32_t)state_count;
+        for (size_t i = 0; i < closure.count; ++i) {
+          da_append(&sets, closure.items[i]);
+        }
+        da_append(&offsets, sets.count);
+      }
+      da_append(&transitions, target);
+    }
+  }
+  da_append(&accept_offsets, (uint32_t)accepts.count);
+
+  dfa->state_count = (uint32_t)(offsets.count - 1);
+  dfa->transitions = transitions.items;
+  dfa->accept_offsets = accept_offsets.items;
+  dfa->accepts = accepts.items;
+
+  free(marks);
+  da_free(stack);
+  da_free(closure);
+  da_free(sets);
+  da_free(offsets);
+}
+
+// Runs the DFA once from the current position and records the longest match
+// of every regex, so that each regex rule is a table lookup afterwards
+static void lexer_run_dfa(lexer_t *lexer) {
+  const lexer_dfa_t *dfa = &lexer->modes.items[lexer->mode].dispatch.dfa;
+  size_t *matches = lexer->regexes.matches;
+  memset(matches, 0, lexer->regexes.count * sizeof(size_t));
+
+  const unsigned char *start =
+      (const unsigned char *)lexer->source + lexer->position;
+  const unsigned char *end =
+      (const unsigned char *)lexer->source + lexer->source_length;
+  uint32_t state = LEXER_DFA_START;
+  size_t longest = 0;
+  uint32_t longest_regex = 0;
+  for (const unsigned char *p = start; p < end;) {
+    state = dfa->transitions[state * dfa->class_count + dfa->classes[*p++]];
+    if (state == LEXER_DFA_DEAD) {
+      break;
+    }
+    uint32_t a = dfa->accept_offsets[state];
+    const uint32_t accept_end = dfa->accept_offsets[state + 1];
+    if (a == accept_end) {
+      continue;
+    }
+    // Accepts are sorted, so the first one is the earliest regex
+    longest = (size_t)(p - start);
+    longest_regex = dfa->accepts[a];
+    for (; a < accept_end; ++a) {
+      matches[dfa->accepts[a]] = longest;
+    }
+  }
+  lexer->regexes.longest = longest;
+  lexer->regexes.longest_regex = longest_regex;
+  lexer->regexes.cached_position = lexer->position;
+}
+
+// Keyword tables
+
+#define LEXER_KEYWORD_SEED_ATTEMPTS 256
+
+static uint32_t lexer_keyword_hash(const char *word, size_t length,
+                                   uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char)word[i];
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
+  return hash;
+}
+
+static size_t lexer_identifier_length(const char *start, const char *end) {
+  if (start >= end || !lexer_is_alpha(*start)) {
+    return 0;
+  }
+  return 1 + lexer_ident_run(start + 1, (size_t)(end - start - 1), false);
+}
+
+// Looks for a seed placing every keyword in its own slot, growing the table
+// when no seed works
+static bool lexer_keyword_place(lexer_keyword_table_t *table,
+                                const lexer_keyword_t *keywords,
+                                size_t count) {
+  size_t size = 1;
+  while (size < count * 2) {
+    size *= 2;
+  }
+  for (;; size *= 2) {
+    table->slots = REALLOC(table->slots, size * sizeof(lexer_keyword_t));
+    ASSERT(table->slots != NULL && "No more memory");
+    table->mask = (uint32_t)(size - 1);
+    for (uint32_t seed = 0; seed < LEXER_KEYWORD_SEED_ATTEMPTS; ++seed) {
+      memset(table->slots, 0, size * sizeof(lexer_keyword_t));
+      size_t placed = 0;
+      for (; placed < count; ++placed) {
+        uint32_t slot = lexer_keyword_hash(keywords[placed].word,
+                                           keywords[placed].length, seed) &
+                        table->mask;
+        if (table->slots[slot].word != NULL) {
+          break;
+        }
+        table->slots[slot] = keywords[placed];
+      }
+      if (placed == count) {
+        table->seed = seed;
+        return true;
+      }
+    }
+    if (size > (size_t)UINT32_MAX / 2) {
+      return false;
+    }
+  }
+}
+
+bool lexer_add_keywords(lexer_t *lexer, const char **words,
+                        const uint32_t *kinds, size_t count,
+                        token_action_fn action) {
+  if (lexer == NULL || words == NULL || kinds == NULL || count == 0) {
+    return false;
+  }
+
+  lexer_keyword_table_t table = {0};
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_KEYWORDS;
+  new_rule.action = action;
+  new_rule.id = (uint32_t)lexer->keywords.count;
+  lexer_charset_clear(&new_rule.first);
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = strlen(words[i]);
+    if (length == 0 || lexer_identifier_length(words[i], words[i] + length) !=
+                           length) {
+      return false;
+    }
+    total += length + 1;
+    if (length > table.max_length) {
+      table.max_length = length;
+    }
+    lexer_charset_add(&new_rule.first, (unsigned char)words[i][0]);
+  }
+
+  table.storage = malloc(total);
+  lexer_keyword_t *keywords = malloc(count * sizeof(lexer_keyword_t));
+  ASSERT(table.storage != NULL && keywords != NULL && "No more memory");
+  char *cursor = table.storage;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = strlen(words[i]);
+    memcpy(cursor, words[i], length + 1);
+    keywords[i] = (lexer_keyword_t){cursor, (uint32_t)length, kinds[i]};
+    cursor += length + 1;
+  }
+
+  bool duplicate = false;
+  for (size_t i = 0; i < count && !duplicate; ++i) {
+    for (size_t j = i + 1; j < count; ++j) {
+      if (strcmp(keywords[i].word, keywords[j].word) == 0) {
+        duplicate = true;
+        break;
+      }
+    }
+  }
+  bool placed = !duplicate && lexer_keyword_place(&table, keywords, count);
+  free(keywords);
+  if (!placed) {
+    free(table.slots);
+    free(table.storage);
+    return false;
+  }
+
+  da_append(&lexer->keywords, table);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+// Scans the identifier at the current position and returns its keyword entry
+static const lexer_keyword_t *
+lexer_match_keyword(const lexer_t *lexer, const lexer_keyword_table_t *table) {
+  const char *start = lexer->source + lexer->position;
+  const char *end = lexer->source + lexer->source_length;
+  // Identifiers longer than every keyword are rejected without a full scan
+  if ((size_t)(end - start) > table->max_length + 1) {
+    end = start + table->max_length + 1;
+  }
+  size_t length = lexer_identifier_length(start, end);
+  if (length == 0 || length > table->max_length) {
+    return NULL;
+  }
+  const lexer_keyword_t *slot =
+      &table->slots[lexer_keyword_hash(start, length, table->seed) &
+                    table->mask];
+  if (slot->word == NULL || slot->length != length ||
+      memcmp(slot->word, start, length) != 0) {
+    return NULL;
+  }
+  return slot;
+}
+
+// Literal tries
+
+bool lexer_add_literals(lexer_t *lexer, const lexer_literal_t *literals,
+                        size_t count, token_action_fn action) {
+  if (lexer == NULL || literals == NULL || count == 0) {
+    return false;
+  }
+
+  // Build a dense trie first (one child per byte for every node)
+  size_t max_nodes = 1;
+  for (size_t i = 0; i < count; ++i) {
+    if (literals[i].text == NULL || literals[i].text[0] == '\0') {
+      return false;
+    }
+    max_nodes += strlen(literals[i].text);
+  }
+  uint32_t *children = calloc(max_nodes * 256, sizeof(uint32_t));
+  lexer_trie_node_t *nodes = calloc(max_nodes, sizeof(lexer_trie_node_t));
+  ASSERT(children != NULL && nodes != NULL && "No more memory");
+  uint32_t node_count = 1;
+  size_t edge_count = 0;
+  bool valid = true;
+
+  for (size_t i = 0; i < count && valid; ++i) {
+    uint32_t node = 0;
+    for (const char *p = literals[i].text; *p; ++p) {
+      uint32_t *child = &children[node * 256 + (unsigned char)*p];
+      if (*child == 0) {
+        *child = node_count++;
+        edge_count++;
+      }
+      node = *child;
+    }
+    valid = !nodes[node].accept;
+    nodes[node].accept = true;
+    nodes[node].kind = literals[i].kind;
+  }
+  if (!valid) {
+    free(children);
+    free(nodes);
+    return false;
+  }
+
+  // Compact the edges of every node below the root into sorted arrays
+  lexer_literal_table_t table = {0};
+  memcpy(table.root, children, sizeof(table.root));
+  table.edge_bytes = malloc(edge_count ? edge_count : 1);
+  table.edge_targets = malloc((edge_count ? edge_count : 1) * sizeof(uint32_t));
+  ASSERT(table.edge_bytes != NULL && table.edge_targets != NULL &&
+         "No more memory");
+  uint32_t edge = 0;
+  for (uint32_t node = 1; node < node_count; ++node) {
+    nodes[node].edges = edge;
+    for (unsigned c = 0; c < 256; ++c) {
+      uint32_t child = children[node * 256 + c];
+      if (child != 0) {
+        table.edge_bytes[edge] = (uint8_t)c;
+        table.edge_targets[edge] = child;
+        edge++;
+      }
+    }
+    nodes[node].edge_count = edge - nodes[node].edges;
+  }
+  free(children);
+  table.nodes = REALLOC(nodes, node_count * sizeof(lexer_trie_node_t));
+  ASSERT(table.nodes != NULL && "No more memory");
+
+  lexer_rule_t new_rule = {0};
+  new_rule.type = LEXER_RULE_LITERALS;
+  new_rule.action = action;
+  new_rule.id = (uint32_t)lexer->literals.count;
+  lexer_charset_clear(&new_rule.first);
+  for (unsigned c = 0; c < 256; ++c) {
+    if (table.root[c] != 0) {
+      lexer_charset_add(&new_rule.first, (unsigned char)c);
+    }
+  }
+
+  da_append(&lexer->literals, table);
+  lexer_append_rule(lexer, new_rule);
+  return true;
+}
+
+// Walks the trie once and returns the node of the longest literal matched
+// (NULL if none), storing its length in `length`
+static const lexer_trie_node_t *
+lexer_match_literal(const lexer_t *lexer, const lexer_literal_table_t *table,
+                    size_t *length) {
+  const unsigned char *start =
+      (const unsigned char *)lexer->source + lexer->position;
+  const unsigned char *end =
+      (const unsigned char *)lexer->source + lexer->source_length;
+  if (start >= end || table->root[*start] == 0) {
+    return NULL;
+  }
+
+  const lexer_trie_node_t *best = NULL;
+  const lexer_trie_node_t *node = &table->nodes[table->root[*start]];
+  const unsigned char *p = start + 1;
+  while (true) {
+    if (node->accept) {
+      best = node;
+      *length = (size_t)(p - start);
+    }
+    if (p >= end || node->edge_count == 0) {
+      break;
+    }
+    const uint8_t *bytes = table->edge_bytes + node->edges;
+    uint32_t i = 0;
+    while (i < node->edge_count && bytes[i] < *p) {
+      i++;
+    }
+    if (i == node->edge_count || bytes[i] != *p) {
+      break;
+    }
+    node = &table->nodes[table->edge_targets[node->edges + i]];
+    p++;
+  }
+  return best;
+}
+
+size_t lexer_rule_count(const lexer_t *lexer) {
+  return lexer ? lexer->rules.count : 0;
+}
+
+bool lexer_set_rule_flags(lexer_t *lexer, size_t rule, uint32_t flags) {
+  if (lexer == NULL || rule >= lexer->rules.count) {
+    return false;
+  }
+  lexer->rules.items[rule].flags = flags;
+  return true;
+}
+
+int32_t lexer_find_mode(const lexer_t *lexer, const char *name) {
+  if (lexer == NULL || name == NULL) {
+    return -1;
+  }
+  for (size_t i = 0; i < lexer->modes.count; ++i) {
+    if (strcmp(lexer->modes.items[i].name, name) == 0) {
+      return (int32_t)i;
+    }
+  }
+  return -1;
+}
+
+int32_t lexer_define_mode(lexer_t *lexer, const char *name) {
+  if (lexer == NULL || name == NULL || name[0] == '\0') {
+    return -1;
+  }
+  int32_t mode = lexer_find_mode(lexer, name);
+  if (mode >= 0) {
+    return mode;
+  }
+  if (lexer->modes.count == LEXER_MODE_MAX) {
+    return -1;
+  }
+  lexer_mode_t new_mode = {0};
+  size_t length = strlen(name);
+  new_mode.name = malloc(length + 1);
+  ASSERT(new_mode.name != NULL && "No more memory");
+  memcpy(new_mode.name, name, length + 1);
+  new_mode.dispatch.dirty = true;
+  da_append(&lexer->modes, new_mode);
+  return (int32_t)(lexer->modes.count - 1);
+}
+
+bool lexer_add_rule_in_mode(lexer_t *lexer, uint32_t mode,
+                            token_matcher_fn matcher, token_action_fn action) {
+  if (lexer == NULL || mode >= lexer->modes.count ||
+      !lexer_add_rule(lexer, matcher, action)) {
+    return false;
+  }
+  return lexer_set_rule_modes(lexer, lexer->rules.count - 1,
+                              (uint32_t)1 << mode);
+}
+
+bool lexer_set_rule_modes(lexer_t *lexer, size_t rule, uint32_t modes) {
+  if (lexer == NULL || rule >= lexer->rules.count) {
+    return false;
+  }
+  lexer->rules.items[rule].modes = modes;
+  lexer_invalidate_dispatch(lexer);
+  return true;
+}
+
+bool lexer_set_mode(lexer_t *lexer, uint32_t mode) {
+  if (lexer == NULL || mode >= lexer->modes.count) {
+    return false;
+  }
+  if (mode != lexer->mode) {
+    // Cached regex matches belong to the previous mode's DFA
+    lexer->mode = mode;
+    lexer->regexes.cached_position = SIZE_MAX;
+  }
+  return true;
+}
+
+bool lexer_push_mode(lexer_t *lexer, uint32_t mode) {
+  if (lexer == NULL || mode >= lexer->modes.count ||
+      lexer->mode_depth == LEXER_MODE_STACK_MAX) {
+    return false;
+  }
+  lexer->mode_stack[lexer->mode_depth++] = lexer->mode;
+  return lexer_set_mode(lexer, mode);
+}
+
+bool lexer_pop_mode(lexer_t *lexer) {
+  if (lexer == NULL || lexer->mode_depth == 0) {
+    return false;
+  }
+  return lexer_set_mode(lexer, lexer->mode_stack[--lexer->mode_depth]);
+}
+
+uint32_t lexer_get_mode(const lexer_t *lexer) {
+  return lexer ? lexer->mode : LEXER_MODE_DEFAULT;
+}
+
+// Length of the run of whitespace bytes at `p`
+static size_t lexer_scan_space(const lexer_space_set_t *set,
+                               const lexer_charset_t *bytes, const char *p,
+                               size_t length) {
+  size_t i = 0;
+#if defined(LEXER_SIMD_SSE2)
+  if (set->count > 0) {
+#if defined(LEXER_SIMD_AVX2)
+    __m256i wide[LEXER_SPACE_SIMD_MAX];
+    for (uint32_t k = 0; k < set->count; ++k) {
+      wide[k] = _mm256_set1_epi8((char)set->bytes[k]);
+    }
+    for (; i + 32 <= length; i += 32) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+      __m256i in_set = _mm256_cmpeq_epi8(block, wide[0]);
+      for (uint32_t k = 1; k < set->count; ++k) {
+        in_set = _mm256_or_si256(in_set, _mm256_cmpeq_epi8(block, wide[k]));
+      }
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(in_set);
+      if (mask != 0xFFFFFFFFu) {
+        return i + lexer_lowest_bit32(~mask);
+      }
+    }
+#endif
+    __m128i narrow[LEXER_SPACE_SIMD_MAX];
+    for (uint32_t k = 0; k < set->count; ++k) {
+      narrow[k] = _mm_set1_epi8((char)set->bytes[k]);
+    }
+    for (; i + 16 <= length; i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+      __m128i in_set = _mm_cmpeq_epi8(block, narrow[0]);
+      for (uint32_t k = 1; k < set->count; ++k) {
+        in_set = _mm_or_si128(in_set, _mm_cmpeq_epi8(block, narrow[k]));
+      }
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(in_set);
+      if (mask != 0xFFFFu) {
+        return i + lexer_lowest_bit32(~mask);
+      }
+    }
+  }
+#else
+  (void)set;
+#endif
+  while (i < length && lexer_charset_has(bytes, (unsigned char)p[i])) {
+    i++;
+  }
+  return i;
+}
+
+// Finds the bytes where an ignored whitespace rule is the first candidate
+static void lexer_build_skip(lexer_t *lexer, lexer_dispatch_t *dispatch) {
+  lexer_charset_clear(&dispatch->skip);
+  bool found = false;
+  for (unsigned c = 0; c < 256; ++c) {
+    if (dispatch->offsets[c] == dispatch->offsets[c + 1]) {
+      continue;
+    }
+    uint32_t index = dispatch->items[dispatch->offsets[c]];
+    const lexer_rule_t *rule = &lexer->rules.items[index];
+    if (rule->type != LEXER_RULE_SPACE ||
+        rule->action != lexer_action_ignore) {
+      continue;
+    }
+    // Only one skip rule, so the lookup stays a single set test
+    if (found && dispatch->skip_rule != index) {
+      continue;
+    }
+    found = true;
+    dispatch->skip_rule = index;
+    lexer_charset_add(&dispatch->skip, (unsigned char)c);
+  }
+}
+
+// Whether rule i can start with byte c in `mode`
+static inline bool lexer_rule_candidate(const lexer_t *lexer, size_t i,
+                                        unsigned c, uint32_t mode) {
+  const lexer_rule_t *rule = &lexer->rules.items[i];
+  return ((rule->modes >> mode) & 1) &&
+         lexer_charset_has(&rule->first, (unsigned char)c);
+}
+
+// Builds the per-byte candidate lists of a mode (counting pass, then filling
+// pass)
+static void lexer_build_dispatch(lexer_t *lexer, uint32_t mode) {
+  lexer_dispatch_t *dispatch = &lexer->modes.items[mode].dispatch;
+  size_t total = 0;
+  for (unsigned c = 0; c < 256; ++c) {
+    dispatch->offsets[c] = (uint32_t)total;
+    for (size_t i = 0; i < lexer->rules.count; ++i) {
+      total += lexer_rule_candidate(lexer, i, c, mode);
+    }
+  }
+  dispatch->offsets[256] = (uint32_t)total;
+
+  if (total > dispatch->capacity) {
+    dispatch->items = REALLOC(dispatch->items, total * sizeof(uint32_t));
+    ASSERT(dispatch->items != NULL && "No more memory");
+    dispatch->capacity = total;
+  }
+
+  for (unsigned c = 0; c < 256; ++c) {
+    uint32_t *out = dispatch->items + dispatch->offsets[c];
+    for (size_t i = 0; i < lexer->rules.count; ++i) {
+      if (lexer_rule_candidate(lexer, i, c, mode)) {
+        *out++ = (uint32_t)i;
+      }
+    }
+  }
+
+  lexer_build_dfa(&dispatch->dfa, &lexer->regexes, &lexer->rules, mode);
+  lexer->regexes.cached_position = SIZE_MAX;
+  lexer_build_skip(lexer, dispatch);
+  dispatch->dirty = false;
+}
+
+// Advances over `count` bytes (which must be in the source), updating line
+// and column once
+static void lexer_skip(lexer_t *lexer, size_t count) {
+  if (lexer->flags & LEXER_FLAG_LAZY_LOCATION) {
+    lexer->position += count;
+    return;
+  }
+  const char *p = lexer->source + lexer->position;
+  const char *last_newline = NULL;
+  size_t newlines = lexer_count_newlines(p, count, &last_newline);
+  if (newlines != 0) {
+    lexer->line += newlines;
+    lexer->column = (size_t)(p + count - last_newline);
+    if (lexer->flags & LEXER_FLAG_UTF8_COLUMNS) {
+      lexer->column = 1 + lexer_count_code_points(last_newline + 1,
+                                                  lexer->column - 1);
+    }
+  } else if (lexer->flags & LEXER_FLAG_UTF8_COLUMNS) {
+    lexer->column += lexer_count_code_points(p, count);
+  } else {
+    lexer->column += count;
+  }
+  lexer->position += count;
+}
+
+// Whether rule a (registered before rule b) must stay ahead of it
+static bool lexer_rules_ordered(const lexer_t *lexer, uint32_t a, uint32_t b) {
+  uint32_t either = lexer->rules.items[a].flags | lexer->rules.items[b].flags;
+  return a < b && !(either & LEXER_RULE_FLAG_ORDER_INDEPENDENT);
+}
+
+// Reorders the candidate lists of one mode
+static void lexer_optimize_mode(lexer_t *lexer, uint32_t mode) {
+  lexer_build_dispatch(lexer, mode);
+  lexer_dispatch_t *dispatch = &lexer->modes.items[mode].dispatch;
+
+  for (unsigned c = 0; c < 256; ++c) {
+    uint32_t *list = dispatch->items + dispatch->offsets[c];
+    size_t count = dispatch->offsets[c + 1] - dispatch->offsets[c];
+
+    // Repeatedly take the hottest rule that no remaining rule must precede
+    for (size_t placed = 0; placed < count; ++placed) {
+      size_t best = count;
+      for (size_t i = placed; i < count; ++i) {
+        bool blocked = false;
+        for (size_t j = placed; j < count && !blocked; ++j) {
+          blocked = j != i && lexer_rules_ordered(lexer, list[j], list[i]);
+        }
+        if (blocked) {
+          continue;
+        }
+        if (best == count ||
+            lexer->rules.items[list[i]].hits >
+                lexer->rules.items[list[best]].hits ||
+            (lexer->rules.items[list[i]].hits ==
+                 lexer->rules.items[list[best]].hits &&
+             list[i] < list[best])) {
+          best = i;
+        }
+      }
+      uint32_t rule = list[best];
+      list[best] = list[placed];
+      list[placed] = rule;
+    }
+  }
+  lexer_build_skip(lexer, dispatch);
+}
+
+void lexer_optimize_rules(lexer_t *lexer) {
+  if (lexer == NULL) {
+    return;
+  }
+  for (uint32_t mode = 0; mode < lexer->modes.count; ++mode) {
+    lexer_optimize_mode(lexer, mode);
+  }
+}
+
+// Tries a single rule at the current position, advancing on success
+static bool lexer_try_rule(lexer_t *lexer, const lexer_rule_t *rule,
+                           token_t *token) {
+  switch (rule->type) {
+  case LEXER_RULE_MATCHER:
+    return rule->matcher(lexer, token);
+  case LEXER_RULE_REGEX: {
+    if (lexer->regexes.cached_position != lexer->position) {
+      lexer_run_dfa(lexer);
+    }
+    size_t length = lexer->regexes.matches[rule->id];
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_KEYWORDS: {
+    const lexer_keyword_t *keyword =
+        lexer_match_keyword(lexer, &lexer->keywords.items[rule->id]);
+    if (keyword == NULL) {
+      return false;
+    }
+    token->kind = keyword->kind;
+    token->length = keyword->length;
+    token->flags = 0;
+    lexer_skip(lexer, keyword->length);
+    return true;
+  }
+  case LEXER_RULE_LITERALS: {
+    size_t length = 0;
+    const lexer_trie_node_t *literal =
+        lexer_match_literal(lexer, &lexer->literals.items[rule->id], &length);
+    if (literal == NULL) {
+      return false;
+    }
+    token->kind = literal->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_SPAN: {
+    size_t remaining = lexer->source_length - lexer->position;
+    size_t length = rule->span(lexer->source + lexer->position, remaining);
+    if (length == 0) {
+      return false;
+    }
+    if (length > remaining) {
+      length = remaining;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_IDENT: {
+    // The first byte was checked by the dispatch
+    size_t length = 1 + lexer_ident_run(
+                            lexer->source + lexer->position + 1,
+                            lexer->source_length - lexer->position - 1, false);
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_XID: {
+    size_t length = lexer_xid_length(lexer->source + lexer->position,
+                                     lexer->source_length - lexer->position);
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_STRING: {
+    bool has_escapes;
+    size_t length = lexer_scan_string(&lexer->strings.items[rule->id],
+                                      lexer->source + lexer->position,
+                                      lexer->source_length - lexer->position,
+                                      &has_escapes);
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = has_escapes ? TOKEN_FLAG_HAS_ESCAPES : 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_COMMENT: {
+    const lexer_comment_t *comment = &lexer->comments.items[rule->id];
+    const char *start = lexer->source + lexer->position;
+    size_t remaining = lexer->source_length - lexer->position;
+    if (!lexer_delimiter_at(start, remaining, 0, comment->open,
+                            comment->open_length)) {
+      return false;
+    }
+    size_t length = lexer_scan_comment(comment, start, remaining);
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_NUMBER: {
+    uint32_t flags = 0;
+    size_t length = lexer_scan_number(&lexer->numbers.items[rule->id],
+                                      lexer->source + lexer->position,
+                                      lexer->source_length - lexer->position,
+                                      &lexer->number, &flags);
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = flags;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  case LEXER_RULE_SPACE: {
+    size_t length = lexer_scan_space(&lexer->spaces.items[rule->id],
+                                     &rule->first,
+                                     lexer->source + lexer->position,
+                                     lexer->source_length - lexer->position);
+    if (length == 0) {
+      return false;
+    }
+    token->kind = rule->kind;
+    token->length = length;
+    token->flags = 0;
+    lexer_skip(lexer, length);
+    return true;
+  }
+  }
+  return false;
+}
+
+// Tries the candidates in order and keeps the first match
+static const lexer_rule_t *lexer_match_first(lexer_t *lexer,
+                                             const uint32_t *candidates,
+                                             size_t candidate_count,
+                                             token_t *token) {
+  // Save starting position for each token attempt
+  size_t start_position = lexer->position;
+  size_t start_line = lexer->line;
+  size_t start_column = lexer->column;
+
+  for (size_t i = 0; i < candidate_count; ++i) {
+    // Set initial token position for each rule attempt
+    token->line = start_line;
+    token->column = start_column;
+    token->lexeme = lexer->source + start_position;
+    token->filename = lexer->filename;
+    const lexer_rule_t *rule = &lexer->rules.items[candidates[i]];
+    if (lexer_try_rule(lexer, rule, token)) {
+      return rule;
+    }
+
+    // Rule didn't match, reset position
+    lexer->position = start_position;
+    lexer->line = start_line;
+    lexer->column = start_column;
+  }
+  return NULL;
+}
+
+// Tries every candidate and keeps the longest match, ties going to the
+// earliest registered rule. All regex candidates are resolved at once by the
+// DFA scan.
+static const lexer_rule_t *lexer_match_longest(lexer_t *lexer,
+                                               const uint32_t *candidates,
+                                               size_t candidate_count,
+                                               token_t *token) {
+  size_t start_position = lexer->position;
+  size_t start_line = lexer->line;
+  size_t start_column = lexer->column;
+
+  const lexer_rule_t *best = NULL;
+  uint32_t best_index = 0;
+  token_t best_token = *token;
+  size_t best_position = start_position;
+  size_t best_line = start_line;
+  size_t best_column = start_column;
+  bool regexes_done = false;
+
+  for (size_t i = 0; i < candidate_count; ++i) {
+    uint32_t index = candidates[i];
+    if (lexer->rules.items[index].type == LEXER_RULE_REGEX) {
+      if (regexes_done) {
+        continue;
+      }
+      regexes_done = true;
+      if (lexer->regexes.cached_position != lexer->position) {
+        lexer_run_dfa(lexer);
+      }
+      if (lexer->regexes.longest == 0) {
+        continue;
+      }
+      index = lexer->regexes.items[lexer->regexes.longest_regex].rule;
+    }
+    const lexer_rule_t *rule = &lexer->rules.items[index];
+
+    token_t attempt = *token;
+    attempt.line = start_line;
+    attempt.column = start_column;
+    attempt.lexeme = lexer->source + start_position;
+    attempt.filename = lexer->filename;
+    if (lexer_try_rule(lexer, rule, &attempt)) {
+      if (best == NULL || lexer->position > best_position ||
+          (lexer->position == best_position && index < best_index)) {
+        best = rule;
+        best_index = index;
+        best_token = attempt;
+        best_position = lexer->position;
+        best_line = lexer->line;
+        best_column = lexer->column;
+      }
+    }
+
+    lexer->position = start_position;
+    lexer->line = start_line;
+    lexer->column = start_column;
+  }
+
+  if (best != NULL) {
+    *token = best_token;
+    lexer->position = best_position;
+    lexer->line = best_line;
+    lexer->column = best_column;
+  }
+  return best;
+}
+
+void lexer_reset(lexer_t *lexer, const char *source, size_t length,
+                 const char *filename) {
+  if (lexer == NULL || source == NULL) {
+    return;
+  }
+  if (length == 0) {
+    length = strlen(source);
+  }
+  lexer_set_source(lexer, lexer_track_source(lexer, source, length, filename));
+}
+
+bool lexer_set_source(lexer_t *lexer, source_id_t id) {
+  if (lexer == NULL || id >= lexer->sources.count) {
+    return false;
+  }
+  const lexer_source_t *source = &lexer->sources.items[id];
+  lexer->source = source->text;
+  lexer->source_length = source->length;
+  lexer->position = 0;
+
+  lexer->filename = source->filename;
+  lexer->line = lexer->flags & LEXER_FLAG_LAZY_LOCATION ? 0 : 1;
+  lexer->column = lexer->flags & LEXER_FLAG_LAZY_LOCATION ? 0 : 1;
+  lexer->source_id = id;
+
+  lexer->mode = LEXER_MODE_DEFAULT;
+  lexer->mode_depth = 0;
+  lexer->regexes.cached_position = SIZE_MAX;
+  lexer->lookahead_first = 0;
+  lexer->lookahead_end = 0;
+  lexer->token_index = 0;
+  return true;
+}
+
+source_id_t lexer_get_source_id(const lexer_t *lexer) {
+  return lexer ? lexer->source_id : LEXER_SOURCE_INVALID;
+}
+
+size_t lexer_source_count(const lexer_t *lexer) {
+  return lexer ? lexer->sources.count : 0;
+}
+
+const char *lexer_source_filename(const lexer_t *lexer, source_id_t id) {
+  if (lexer == NULL || id >= lexer->sources.count) {
+    return NULL;
+  }
+  return lexer->sources.items[id].filename;
+}
+
+const char *lexer_source_text(const lexer_t *lexer, source_id_t id,
+                              size_t *length) {
+  if (lexer == NULL || id >= lexer->sources.count) {
+    return NULL;
+  }
+  if (length != NULL) {
+    *length = lexer->sources.items[id].length;
+  }
+  return lexer->sources.items[id].text;
+}
+
+char lexer_current(const lexer_t *lexer) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return 0;
+  }
+  return lexer->source[lexer->position];
+}
+
+char lexer_peek(const lexer_t *lexer, size_t offset) {
+  if (lexer == NULL || lexer->position + offset >= lexer->source_length) {
+    return '\0';
+  }
+  return lexer->source[lexer->position + offset];
+}
+
+void lexer_advance(lexer_t *lexer) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return;
+  }
+  char current = lexer->source[lexer->position++];
+
+  if (lexer->flags & LEXER_FLAG_LAZY_LOCATION) {
+    return;
+  }
+  if (current == '\n') {
+    lexer->line++;
+    lexer->column = 1;
+  } else if (!(lexer->flags & LEXER_FLAG_UTF8_COLUMNS) ||
+             ((unsigned char)current & 0xC0) != 0x80) {
+    lexer->column++;
+  }
+}
+
+void lexer_advance_n(lexer_t *lexer, size_t count) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return;
+  }
+  if (count > lexer->source_length - lexer->position) {
+    count = lexer->source_length - lexer->position;
+  }
+  lexer_skip(lexer, count);
+}
+
+void lexer_advance_to(lexer_t *lexer, const char *ptr) {
+  if (lexer == NULL || ptr < lexer->source + lexer->position ||
+      ptr > lexer->source + lexer->source_length) {
+    return;
+  }
+  lexer_skip(lexer, (size_t)(ptr - (lexer->source + lexer->position)));
+}
+
+size_t lexer_scan_ident(const lexer_t *lexer) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return 0;
+  }
+  return lexer_ident_run(lexer->source + lexer->position,
+                         lexer->source_length - lexer->position, false);
+}
+
+size_t lexer_scan_ident_utf8(const lexer_t *lexer) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return 0;
+  }
+  return lexer_ident_run(lexer->source + lexer->position,
+                         lexer->source_length - lexer->position, true);
+}
+
+size_t lexer_scan_xid(const lexer_t *lexer) {
+  if (lexer == NULL || lexer->position >= lexer->source_length) {
+    return 0;
+  }
+  return lexer_xid_length(lexer->source + lexer->position,
+                          lexer->source_length - lexer->position);
+}
+
+bool lexer_is_eof(const lexer_t *lexer) {
+  return lexer == NULL || lexer->position >= lexer->source_length;
+}
+
+void *lexer_get_context(lexer_t *lexer) {
+  if (lexer == NULL) {
+    return NULL;
+  }
+  return lexer->context;
+}
+
+token_t create_token(uint32_t kind, const char *lexeme, size_t length,
+                     size_t line, size_t column, const char *filename,
+                     uint32_t flags) {
+  token_t token;
+  token.kind = kind;
+  token.lexeme = lexeme;
+  token.line = line;
+  token.column = column;
+  token.length = length;
+  token.filename = filename;
+  token.flags = flags;
+  token.source = 0;
+  return token;
+}
+
+// Lexes the next token from the input, writing it in place. `offset` gets the
+// position the token was matched at (actions may point the lexeme elsewhere).
+static void lexer_lex_token(lexer_t *lexer, token_t *out, size_t *offset) {
+
+  if (lexer == NULL || lexer_is_eof(lexer)) {
+    *out = create_token(INTERNAL_TOKEN_EOF, "EOF", 0, lexer ? lexer->line : 0,
+                        lexer ? lexer->column : 0, lexer ? lexer->filename : 0,
+                        0);
+    *offset = lexer ? lexer->position : 0;
+    out->source = lexer ? lexer->source_id : 0;
+    return;
+  }
+
+  token_t token = {0};
+
+  while (!lexer_is_eof(lexer)) {
+    // Actions may have switched modes since the last iteration
+    lexer_dispatch_t *dispatch = &lexer->modes.items[lexer->mode].dispatch;
+    if (dispatch->dirty) {
+      lexer_build_dispatch(lexer, lexer->mode);
+    }
+
+    // Only the rules that can start with the current byte are tried
+    unsigned char first = (unsigned char)lexer->source[lexer->position];
+    const uint32_t *candidates = dispatch->items + dispatch->offsets[first];
+    size_t candidate_count =
+        dispatch->offsets[first + 1] - dispatch->offsets[first];
+
+    // Ignored whitespace is skipped without going through the rules (in
+    // longest-match mode only if no other rule could compete)
+    if (lexer_charset_has(&dispatch->skip, first) &&
+        !(lexer->flags & LEXER_FLAG_KEEP_IGNORABLE) &&
+        (!(lexer->flags & LEXER_FLAG_LONGEST_MATCH) || candidate_count == 1)) {
+      lexer_rule_t *space = &lexer->rules.items[dispatch->skip_rule];
+      lexer_skip(lexer, lexer_scan_space(
+                            &lexer->spaces.items[space->id], &space->first,
+                            lexer->source + lexer->position,
+                            lexer->source_length - lexer->position));
+      if (lexer->flags & LEXER_FLAG_PROFILE) {
+        space->hits++;
+      }
+      continue;
+    }
+
+    const size_t start = lexer->position;
+    const lexer_rule_t *rule =
+        lexer->flags & LEXER_FLAG_LONGEST_MATCH
+            ? lexer_match_longest(lexer, candidates, candidate_count, &token)
+            : lexer_match_first(lexer, candidates, candidate_count, &token);
+    if (rule == NULL) {
+      break;
+    }
+
+    // Successful match
+    if (lexer->flags & LEXER_FLAG_PROFILE) {
+      lexer->rules.items[rule - lexer->rules.items].hits++;
+    }
+    if (rule->action) {
+      rule->action(lexer, &token);
+    }
+    if (token.flags & TOKEN_FLAG_IGNORE &&
+        !(lexer->flags & LEXER_FLAG_KEEP_IGNORABLE)) {
+      // For ignorable tokens, restart from the new position
+      token.flags = 0;
+      continue;
+    }
+    // Copy of successful token
+    *out = create_token(token.kind, token.lexeme, token.length, token.line,
+                        token.column, token.filename, token.flags);
+    *offset = start;
+    out->source = lexer->source_id;
+    return;
+  }
+
+  // No rules matched - handle error case
+  *offset = lexer->position;
+  if (lexer_is_eof(lexer)) {
+    *out = create_token(INTERNAL_TOKEN_EOF, "EOF", 0, lexer->line,
+                        lexer->column, lexer->filename, 0);
+    out->source = lexer->source_id;
+    return;
+  }
+  *out = create_token(INTERNAL_TOKEN_ERROR, lexer->source + lexer->position, 1,
+                      lexer->line, lexer->column, lexer->filename, 0);
+  out->source = lexer->source_id;
+  lexer_advance(lexer);
+}
+
+// Body of lexer_next_token, writing the token in place (also used by
+// lexer_tokenize_all). Tokens already peeked are returned first.
+static void lexer_next_token_into(lexer_t *lexer, token_t *out,
+                                  size_t *offset) {
+  if (lexer == NULL) {
+    lexer_lex_token(lexer, out, offset);
+    return;
+  }
+  if (lexer->token_index < lexer->lookahead_end) {
+    const lexer_lookahead_t *next =
+        &lexer->lookahead[lexer->token_index % LEXER_LOOKAHEAD_MAX];
+    *out = next->token;
+    *offset = next->offset;
+    lexer->number = next->number;
+    lexer->token_index++;
+    return;
+  }
+  lexer_lex_token(lexer, out, offset);
+  // The ring only holds consecutive tokens, so it starts over after this one
+  lexer->token_index++;
+  lexer->lookahead_first = lexer->token_index;
+  lexer->lookahead_end = lexer->token_index;
+}
+
+// Current lexer state, as the start of token `token`
+static lexer_mark_t lexer_capture(const lexer_t *lexer, size_t token) {
+  lexer_mark_t mark;
+  mark.position = lexer->position;
+  mark.line = lexer->line;
+  mark.column = lexer->column;
+  mark.token = token;
+  mark.mode = lexer->mode;
+  mark.mode_depth = (uint32_t)lexer->mode_depth;
+  for (size_t i = 0; i < LEXER_MODE_STACK_MAX; ++i) {
+    mark.mode_stack[i] =
+        i < lexer->mode_depth ? (uint8_t)lexer->mode_stack[i] : 0;
+  }
+  return mark;
+}
+
+const token_t *lexer_peek_token(lexer_t *lexer, size_t k) {
+  if (lexer == NULL || k >= LEXER_LOOKAHEAD_MAX) {
+    return NULL;
+  }
+  // The number of the last token returned is kept for lexer_get_number
+  const lexer_number_t number = lexer->number;
+  while (lexer->lookahead_end <= lexer->token_index + k) {
+    lexer_lookahead_t *slot =
+        &lexer->lookahead[lexer->lookahead_end % LEXER_LOOKAHEAD_MAX];
+    slot->start = lexer_capture(lexer, lexer->lookahead_end);
+    lexer_lex_token(lexer, &slot->token, &slot->offset);
+    slot->number = lexer->number;
+    lexer->lookahead_end++;
+    if (lexer->lookahead_end - lexer->lookahead_first > LEXER_LOOKAHEAD_MAX) {
+      lexer->lookahead_first++;
+    }
+  }
+  lexer->number = number;
+  return &lexer->lookahead[(lexer->token_index + k) % LEXER_LOOKAHEAD_MAX]
+              .token;
+}
+
+lexer_mark_t lexer_mark(const lexer_t *lexer) {
+  if (lexer == NULL) {
+    return (lexer_mark_t){0};
+  }
+  if (lexer->token_index < lexer->lookahead_end) {
+    return lexer->lookahead[lexer->token_index % LEXER_LOOKAHEAD_MAX].start;
+  }
+  return lexer_capture(lexer, lexer->token_index);
+}
+
+void lexer_rewind(lexer_t *lexer, lexer_mark_t mark) {
+  if (lexer == NULL) {
+    return;
+  }
+  // Tokens still in the ring are replayed as they are
+  if (mark.token >= lexer->lookahead_first &&
+      mark.token < lexer->lookahead_end) {
+    lexer->token_index = mark.token;
+    return;
+  }
+  lexer->position = mark.position;
+  lexer->line = mark.line;
+  lexer->column = mark.column;
+  lexer->mode = mark.mode;
+  lexer->mode_depth = mark.mode_depth;
+  for (size_t i = 0; i < mark.mode_depth; ++i) {
+    lexer->mode_stack[i] = mark.mode_stack[i];
+  }
+  lexer->regexes.cached_position = SIZE_MAX;
+  // Rewinding to the end of the ring keeps it for later rewinds
+  if (mark.token != lexer->lookahead_end) {
+    lexer->lookahead_first = mark.token;
+    lexer->lookahead_end = mark.token;
+  }
+  lexer->token_index = mark.token;
+}
+
+token_t lexer_next_token(lexer_t *lexer) {
+  token_t token;
+  size_t offset;
+  lexer_next_token_into(lexer, &token, &offset);
+  return token;
+}
+
+compact_token_t lexer_next_compact_token(lexer_t *lexer) {
+  compact_token_t compact = {0};
+  if (lexer == NULL) {
+    return compact;
+  }
+  compact.source = lexer->source_id;
+  // Offsets would not fit 32 bits: the whole source is one error
+  if (lexer->source_length > UINT32_MAX) {
+    if (!lexer_is_eof(lexer)) {
+      lexer_advance_n(lexer, lexer->source_length - lexer->position);
+      compact.kind = INTERNAL_TOKEN_ERROR;
+    }
+    return compact;
+  }
+
+  token_t token;
+  size_t offset;
+  lexer_next_token_into(lexer, &token, &offset);
+  compact.offset = (uint32_t)offset;
+  if (token.length > UINT32_MAX || token.kind > UINT16_MAX ||
+      token.flags > UINT16_MAX) {
+    compact.kind = INTERNAL_TOKEN_ERROR;
+    compact.length = token.length > UINT32_MAX ? 0 : (uint32_t)token.length;
+    return compact;
+  }
+  compact.length = (uint32_t)token.length;
+  compact.kind = (uint16_t)token.kind;
+  compact.flags = (uint16_t)token.flags;
+  return compact;
+}
+
+void token_buffer_init(token_buffer_t *buffer, bool locations) {
+  if (buffer == NULL) {
+    return;
+  }
+  *buffer = (token_buffer_t){0};
+  buffer->locations = locations;
+}
+
+void token_buffer_free(token_buffer_t *buffer) {
+  if (buffer == NULL) {
+    return;
+  }
+  free(buffer->kinds);
+  free(buffer->offsets);
+  free(buffer->lengths);
+  free(buffer->flags);
+  free(buffer->lines);
+  free(buffer->columns);
+  token_buffer_init(buffer, buffer->locations);
+}
+
+// Grows every array of the buffer to `capacity` entries
+static void token_buffer_reserve(token_buffer_t *buffer, size_t capacity) {
+  buffer->kinds = REALLOC(buffer->kinds, capacity * sizeof(uint32_t));
+  buffer->offsets = REALLOC(buffer->offsets, capacity * sizeof(uint32_t));
+  buffer->lengths = REALLOC(buffer->lengths, capacity * sizeof(uint32_t));
+  buffer->flags = REALLOC(buffer->flags, capacity * sizeof(uint32_t));
+  ASSERT(buffer->kinds != NULL && buffer->offsets != NULL &&
+         buffer->lengths != NULL && buffer->flags != NULL && "No more memory");
+  if (buffer->locations) {
+    buffer->lines = REALLOC(buffer->lines, capacity * sizeof(uint32_t));
+    buffer->columns = REALLOC(buffer->columns, capacity * sizeof(uint32_t));
+    ASSERT(buffer->lines != NULL && buffer->columns != NULL &&
+           "No more memory");
+  }
+  buffer->capacity = capacity;
+}
+
+size_t token_buffer_next(token_buffer_t *buffer) {
+  if (buffer == NULL || buffer->count == 0) {
+    return 0;
+  }
+  if (buffer->cursor + 1 >= buffer->count) {
+    return buffer->count - 1;
+  }
+  return buffer->cursor++;
+}
+
+size_t token_buffer_peek(const token_buffer_t *buffer, size_t k) {
+  if (buffer == NULL || buffer->count == 0) {
+    return 0;
+  }
+  if (k >= buffer->count - 1 - buffer->cursor) {
+    return buffer->count - 1;
+  }
+  return buffer->cursor + k;
+}
+
+size_t token_buffer_mark(const token_buffer_t *buffer) {
+  return buffer ? buffer->cursor : 0;
+}
+
+void token_buffer_rewind(token_buffer_t *buffer, size_t mark) {
+  if (buffer == NULL || mark >= buffer->count) {
+    return;
+  }
+  buffer->cursor = mark;
+}
+
+bool lexer_tokenize_all(lexer_t *lexer, token_buffer_t *out) {
+  if (lexer == NULL || out == NULL || lexer->source_length > UINT32_MAX) {
+    return false;
+  }
+  // Arrays allocated before `locations` was set are topped up here
+  if (out->locations && out->lines == NULL && out->capacity > 0) {
+    token_buffer_reserve(out, out->capacity);
+  }
+  const bool lazy = lexer->flags & LEXER_FLAG_LAZY_LOCATION;
+  out->count = 0;
+  out->cursor = 0;
+  token_t token;
+  size_t offset;
+  do {
+    lexer_next_token_into(lexer, &token, &offset);
+    if (out->count == out->capacity) {
+      token_buffer_reserve(out, out->capacity ? out->capacity * 2 : 256);
+    }
+    const size_t i = out->count++;
+    out->kinds[i] = token.kind;
+    out->offsets[i] = (uint32_t)offset;
+    out->lengths[i] = (uint32_t)token.length;
+    out->flags[i] = token.flags;
+    if (out->locations) {
+      size_t line = token.line;
+      size_t column = token.column;
+      if (lazy) {
+        lexer_offset_to_location(lexer, offset, &line, &column);
+      }
+      out->lines[i] = (uint32_t)line;
+      out->columns[i] = (uint32_t)column;
+    }
+  } while (token.kind != INTERNAL_TOKEN_EOF);
+  return true;
+}
+
+size_t lexer_get_position(const lexer_t *lexer) {
+  return lexer ? lexer->position : 0;
+}
+
+const lexer_number_t *lexer_get_number(const lexer_t *lexer) {
+  return lexer ? &lexer->number : NULL;
+}
+
+size_t lexer_get_line(const lexer_t *lexer) {
+  if (lexer != NULL && lexer->flags & LEXER_FLAG_LAZY_LOCATION) {
+    size_t line = 0;
+    size_t column = 0;
+    lexer_offset_to_location(lexer, lexer->position, &line, &column);
+    return line;
+  }
+  return lexer ? lexer->line : 0;
 }
 
-size_t lexer_get_line(const lexer_t *lexer) { return lexer ? lexer->line : 0; }
-
 size_t lexer_get_column(const lexer_t *lexer) {
+  if (lexer != NULL && lexer->flags & LEXER_FLAG_LAZY_LOCATION) {
+    size_t line = 0;
+    size_t column = 0;
+    lexer_offset_to_location(lexer, lexer->position, &line, &column);
+    return column;
+  }
   return lexer ? lexer->column : 0;
 }
 
+// The index is a cache, so it is filled even through a const lexer
+static const lexer_newlines_t *lexer_newline_index(const lexer_t *lexer,
+                                                   source_id_t source_id) {
+  const lexer_source_t *source = &lexer->sources.items[source_id];
+  lexer_newlines_t *newlines = (lexer_newlines_t *)&source->newlines;
+  if (!newlines->built) {
+    newlines->count = 0;
+    const char *p = source->text;
+    const char *end = source->text + source->length;
+    const char *newline;
+    while ((newline = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+      size_t offset = (size_t)(newline - source->text);
+      da_append(newlines, offset);
+      p = newline + 1;
+    }
+    newlines->built = true;
+  }
+  return newlines;
+}
+
+bool lexer_source_location(const lexer_t *lexer, source_id_t source_id,
+                           size_t offset, size_t *line, size_t *column) {
+  if (lexer == NULL || source_id >= lexer->sources.count ||
+      offset > lexer->sources.items[source_id].length) {
+    return false;
+  }
+  const char *text = lexer->sources.items[source_id].text;
+  const lexer_newlines_t *newlines = lexer_newline_index(lexer, source_id);
+
+  // Number of newlines before `offset`
+  size_t low = 0;
+  size_t high = newlines->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (newlines->items[middle] < offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  size_t line_start = low == 0 ? 0 : newlines->items[low - 1] + 1;
+  if (line != NULL) {
+    *line = low + 1;
+  }
+  if (column != NULL) {
+    *column = lexer->flags & LEXER_FLAG_UTF8_COLUMNS
+                  ? lexer_count_code_points(text + line_start,
+                                            offset - line_start) +
+                        1
+                  : offset - line_start + 1;
+  }
+  return true;
+}
+
+bool lexer_offset_to_location(const lexer_t *lexer, size_t offset,
+                              size_t *line, size_t *column) {
+  if (lexer == NULL) {
+    return false;
+  }
+  return lexer_source_location(lexer, lexer->source_id, offset, line, column);
+}
+
+const char *lexer_compact_lexeme(const lexer_t *lexer, compact_token_t token) {
+  if (lexer == NULL || token.source >= lexer->sources.count) {
+    return NULL;
+  }
+  return lexer->sources.items[token.source].text + token.offset;
+}
+
+const char *lexer_compact_filename(const lexer_t *lexer,
+                                   compact_token_t token) {
+  if (lexer == NULL || token.source >= lexer->sources.count) {
+    return NULL;
+  }
+  return lexer->sources.items[token.source].filename;
+}
+
+bool lexer_compact_location(const lexer_t *lexer, compact_token_t token,
+                            size_t *line, size_t *column) {
+  if (lexer == NULL) {
+    return false;
+  }
+  return lexer_source_location(lexer, token.source, token.offset, line,
+                               column);
+}
+
 const char *lexer_get_lexeme(const lexer_t *lexer, size_t start,
                              size_t length) {
   if (!lexer || start >= lexer->source_length) {
@@ -412,26 +4052,452 @@ const char *lexer_get_lexeme(const lexer_t *lexer, size_t start,
   return lexer->source + start;
 }
 
-bool lexer_is_space(char c) {
-  switch (c) {
-  case ' ':
-  case '\n':
-  case '\t':
-  case '\b':
-  case '\r':
-  case '\v':
-    return true;
+// Bytes >= 0x80 belong to no built-in class
+const uint32_t lexer_class_table[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x08, 0x08, 0x08, 0x00, 0x08, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x15, 0x15, 0x15, 0x15, 0x15, 0x15, 0x15, 0x15,
+    0x15, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x36, 0x36, 0x36, 0x36, 0x36, 0x36, 0x26,
+    0x26, 0x26, 0x26, 0x26, 0x26, 0x26, 0x26, 0x26,
+    0x26, 0x26, 0x26, 0x26, 0x26, 0x26, 0x26, 0x26,
+    0x26, 0x26, 0x26, 0x00, 0x00, 0x00, 0x00, 0x06,
+    0x00, 0x56, 0x56, 0x56, 0x56, 0x56, 0x56, 0x46,
+    0x46, 0x46, 0x46, 0x46, 0x46, 0x46, 0x46, 0x46,
+    0x46, 0x46, 0x46, 0x46, 0x46, 0x46, 0x46, 0x46,
+    0x46, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+size_t lexer_utf8_decode(const char *p, size_t length, uint32_t *code_point) {
+  const unsigned char *s = (const unsigned char *)p;
+  if (length == 0) {
+    return 0;
   }
-  return false;
+  if (s[0] < 0x80) {
+    *code_point = s[0];
+    return 1;
+  }
+  size_t sequence;
+  uint32_t value;
+  uint32_t minimum;
+  if ((s[0] & 0xE0) == 0xC0) {
+    sequence = 2;
+    value = s[0] & 0x1F;
+    minimum = 0x80;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    sequence = 3;
+    value = s[0] & 0x0F;
+    minimum = 0x800;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    sequence = 4;
+    value = s[0] & 0x07;
+    minimum = 0x10000;
+  } else {
+    return 0;
+  }
+  if (length < sequence) {
+    return 0;
+  }
+  for (size_t i = 1; i < sequence; ++i) {
+    if ((s[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    value = (value << 6) | (s[i] & 0x3F);
+  }
+  if (value < minimum || value > 0x10FFFF ||
+      (value >= 0xD800 && value <= 0xDFFF)) {
+    return 0;
+  }
+  *code_point = value;
+  return sequence;
+}
+
+// Code point ranges above U+007F, generated from the Unicode 14.0 XID_Start
+// and XID_Continue properties. The second table only holds the code points
+// that are XID_Continue but not XID_Start.
+typedef struct lexer_code_point_range_t {
+  uint32_t first;
+  uint32_t last;
+} lexer_code_point_range_t;
+
+static const lexer_code_point_range_t lexer_xid_start_table[] = {
+    {0xAA, 0xAA}, {0xB5, 0xB5}, {0xBA, 0xBA}, {0xC0, 0xD6}, {0xD8, 0xF6},
+    {0xF8, 0x2C1}, {0x2C6, 0x2D1}, {0x2E0, 0x2E4}, {0x2EC, 0x2EC},
+    {0x2EE, 0x2EE}, {0x370, 0x374}, {0x376, 0x377}, {0x37B, 0x37D},
+    {0x37F, 0x37F}, {0x386, 0x386}, {0x388, 0x38A}, {0x38C, 0x38C},
+    {0x38E, 0x3A1}, {0x3A3, 0x3F5}, {0x3F7, 0x481}, {0x48A, 0x52F},
+    {0x531, 0x556}, {0x559, 0x559}, {0x560, 0x588}, {0x5D0, 0x5EA},
+    {0x5EF, 0x5F2}, {0x620, 0x64A}, {0x66E, 0x66F}, {0x671, 0x6D3},
+    {0x6D5, 0x6D5}, {0x6E5, 0x6E6}, {0x6EE, 0x6EF}, {0x6FA, 0x6FC},
+    {0x6FF, 0x6FF}, {0x710, 0x710}, {0x712, 0x72F}, {0x74D, 0x7A5},
+    {0x7B1, 0x7B1}, {0x7CA, 0x7EA}, {0x7F4, 0x7F5}, {0x7FA, 0x7FA},
+    {0x800, 0x815}, {0x81A, 0x81A}, {0x824, 0x824}, {0x828, 0x828},
+    {0x840, 0x858}, {0x860, 0x86A}, {0x870, 0x887}, {0x889, 0x88E},
+    {0x8A0, 0x8C9}, {0x904, 0x939}, {0x93D, 0x93D}, {0x950, 0x950},
+    {0x958, 0x961}, {0x971, 0x980}, {0x985, 0x98C}, {0x98F, 0x990},
+    {0x993, 0x9A8}, {0x9AA, 0x9B0}, {0x9B2, 0x9B2}, {0x9B6, 0x9B9},
+    {0x9BD, 0x9BD}, {0x9CE, 0x9CE}, {0x9DC, 0x9DD}, {0x9DF, 0x9E1},
+    {0x9F0, 0x9F1}, {0x9FC, 0x9FC}, {0xA05, 0xA0A}, {0xA0F, 0xA10},
+    {0xA13, 0xA28}, {0xA2A, 0xA30}, {0xA32, 0xA33}, {0xA35, 0xA36},
+    {0xA38, 0xA39}, {0xA59, 0xA5C}, {0xA5E, 0xA5E}, {0xA72, 0xA74},
+    {0xA85, 0xA8D}, {0xA8F, 0xA91}, {0xA93, 0xAA8}, {0xAAA, 0xAB0},
+    {0xAB2, 0xAB3}, {0xAB5, 0xAB9}, {0xABD, 0xABD}, {0xAD0, 0xAD0},
+    {0xAE0, 0xAE1}, {0xAF9, 0xAF9}, {0xB05, 0xB0C}, {0xB0F, 0xB10},
+    {0xB13, 0xB28}, {0xB2A, 0xB30}, {0xB32, 0xB33}, {0xB35, 0xB39},
+    {0xB3D, 0xB3D}, {0xB5C, 0xB5D}, {0xB5F, 0xB61}, {0xB71, 0xB71},
+    {0xB83, 0xB83}, {0xB85, 0xB8A}, {0xB8E, 0xB90}, {0xB92, 0xB95},
+    {0xB99, 0xB9A}, {0xB9C, 0xB9C}, {0xB9E, 0xB9F}, {0xBA3, 0xBA4},
+    {0xBA8, 0xBAA}, {0xBAE, 0xBB9}, {0xBD0, 0xBD0}, {0xC05, 0xC0C},
+    {0xC0E, 0xC10}, {0xC12, 0xC28}, {0xC2A, 0xC39}, {0xC3D, 0xC3D},
+    {0xC58, 0xC5A}, {0xC5D, 0xC5D}, {0xC60, 0xC61}, {0xC80, 0xC80},
+    {0xC85, 0xC8C}, {0xC8E, 0xC90}, {0xC92, 0xCA8}, {0xCAA, 0xCB3},
+    {0xCB5, 0xCB9}, {0xCBD, 0xCBD}, {0xCDD, 0xCDE}, {0xCE0, 0xCE1},
+    {0xCF1, 0xCF2}, {0xD04, 0xD0C}, {0xD0E, 0xD10}, {0xD12, 0xD3A},
+    {0xD3D, 0xD3D}, {0xD4E, 0xD4E}, {0xD54, 0xD56}, {0xD5F, 0xD61},
+    {0xD7A, 0xD7F}, {0xD85, 0xD96}, {0xD9A, 0xDB1}, {0xDB3, 0xDBB},
+    {0xDBD, 0xDBD}, {0xDC0, 0xDC6}, {0xE01, 0xE30}, {0xE32, 0xE32},
+    {0xE40, 0xE46}, {0xE81, 0xE82}, {0xE84, 0xE84}, {0xE86, 0xE8A},
+    {0xE8C, 0xEA3}, {0xEA5, 0xEA5}, {0xEA7, 0xEB0}, {0xEB2, 0xEB2},
+    {0xEBD, 0xEBD}, {0xEC0, 0xEC4}, {0xEC6, 0xEC6}, {0xEDC, 0xEDF},
+    {0xF00, 0xF00}, {0xF40, 0xF47}, {0xF49, 0xF6C}, {0xF88, 0xF8C},
+    {0x1000, 0x102A}, {0x103F, 0x103F}, {0x1050, 0x1055}, {0x105A, 0x105D},
+    {0x1061, 0x1061}, {0x1065, 0x1066}, {0x106E, 0x1070}, {0x1075, 0x1081},
+    {0x108E, 0x108E}, {0x10A0, 0x10C5}, {0x10C7, 0x10C7}, {0x10CD, 0x10CD},
+    {0x10D0, 0x10FA}, {0x10FC, 0x1248}, {0x124A, 0x124D}, {0x1250, 0x1256},
+    {0x1258, 0x1258}, {0x125A, 0x125D}, {0x1260, 0x1288}, {0x128A, 0x128D},
+    {0x1290, 0x12B0}, {0x12B2, 0x12B5}, {0x12B8, 0x12BE}, {0x12C0, 0x12C0},
+    {0x12C2, 0x12C5}, {0x12C8, 0x12D6}, {0x12D8, 0x1310}, {0x1312, 0x1315},
+    {0x1318, 0x135A}, {0x1380, 0x138F}, {0x13A0, 0x13F5}, {0x13F8, 0x13FD},
+    {0x1401, 0x166C}, {0x166F, 0x167F}, {0x1681, 0x169A}, {0x16A0, 0x16EA},
+    {0x16EE, 0x16F8}, {0x1700, 0x1711}, {0x171F, 0x1731}, {0x1740, 0x1751},
+    {0x1760, 0x176C}, {0x176E, 0x1770}, {0x1780, 0x17B3}, {0x17D7, 0x17D7},
+    {0x17DC, 0x17DC}, {0x1820, 0x1878}, {0x1880, 0x18A8}, {0x18AA, 0x18AA},
+    {0x18B0, 0x18F5}, {0x1900, 0x191E}, {0x1950, 0x196D}, {0x1970, 0x1974},
+    {0x1980, 0x19AB}, {0x19B0, 0x19C9}, {0x1A00, 0x1A16}, {0x1A20, 0x1A54},
+    {0x1AA7, 0x1AA7}, {0x1B05, 0x1B33}, {0x1B45, 0x1B4C}, {0x1B83, 0x1BA0},
+    {0x1BAE, 0x1BAF}, {0x1BBA, 0x1BE5}, {0x1C00, 0x1C23}, {0x1C4D, 0x1C4F},
+    {0x1C5A, 0x1C7D}, {0x1C80, 0x1C88}, {0x1C90, 0x1CBA}, {0x1CBD, 0x1CBF},
+    {0x1CE9, 0x1CEC}, {0x1CEE, 0x1CF3}, {0x1CF5, 0x1CF6}, {0x1CFA, 0x1CFA},
+    {0x1D00, 0x1DBF}, {0x1E00, 0x1F15}, {0x1F18, 0x1F1D}, {0x1F20, 0x1F45},
+    {0x1F48, 0x1F4D}, {0x1F50, 0x1F57}, {0x1F59, 0x1F59}, {0x1F5B, 0x1F5B},
+    {0x1F5D, 0x1F5D}, {0x1F5F, 0x1F7D}, {0x1F80, 0x1FB4}, {0x1FB6, 0x1FBC},
+    {0x1FBE, 0x1FBE}, {0x1FC2, 0x1FC4}, {0x1FC6, 0x1FCC}, {0x1FD0, 0x1FD3},
+    {0x1FD6, 0x1FDB}, {0x1FE0, 0x1FEC}, {0x1FF2, 0x1FF4}, {0x1FF6, 0x1FFC},
+    {0x2071, 0x2071}, {0x207F, 0x207F}, {0x2090, 0x209C}, {0x2102, 0x2102},
+    {0x2107, 0x2107}, {0x210A, 0x2113}, {0x2115, 0x2115}, {0x2118, 0x211D},
+    {0x2124, 0x2124}, {0x2126, 0x2126}, {0x2128, 0x2128}, {0x212A, 0x2139},
+    {0x213C, 0x213F}, {0x2145, 0x2149}, {0x214E, 0x214E}, {0x2160, 0x2188},
+    {0x2C00, 0x2CE4}, {0x2CEB, 0x2CEE}, {0x2CF2, 0x2CF3}, {0x2D00, 0x2D25},
+    {0x2D27, 0x2D27}, {0x2D2D, 0x2D2D}, {0x2D30, 0x2D67}, {0x2D6F, 0x2D6F},
+    {0x2D80, 0x2D96}, {0x2DA0, 0x2DA6}, {0x2DA8, 0x2DAE}, {0x2DB0, 0x2DB6},
+    {0x2DB8, 0x2DBE}, {0x2DC0, 0x2DC6}, {0x2DC8, 0x2DCE}, {0x2DD0, 0x2DD6},
+    {0x2DD8, 0x2DDE}, {0x3005, 0x3007}, {0x3021, 0x3029}, {0x3031, 0x3035},
+    {0x3038, 0x303C}, {0x3041, 0x3096}, {0x309D, 0x309F}, {0x30A1, 0x30FA},
+    {0x30FC, 0x30FF}, {0x3105, 0x312F}, {0x3131, 0x318E}, {0x31A0, 0x31BF},
+    {0x31F0, 0x31FF}, {0x3400, 0x4DBF}, {0x4E00, 0xA48C}, {0xA4D0, 0xA4FD},
+    {0xA500, 0xA60C}, {0xA610, 0xA61F}, {0xA62A, 0xA62B}, {0xA640, 0xA66E},
+    {0xA67F, 0xA69D}, {0xA6A0, 0xA6EF}, {0xA717, 0xA71F}, {0xA722, 0xA788},
+    {0xA78B, 0xA7CA}, {0xA7D0, 0xA7D1}, {0xA7D3, 0xA7D3}, {0xA7D5, 0xA7D9},
+    {0xA7F2, 0xA801}, {0xA803, 0xA805}, {0xA807, 0xA80A}, {0xA80C, 0xA822},
+    {0xA840, 0xA873}, {0xA882, 0xA8B3}, {0xA8F2, 0xA8F7}, {0xA8FB, 0xA8FB},
+    {0xA8FD, 0xA8FE}, {0xA90A, 0xA925}, {0xA930, 0xA946}, {0xA960, 0xA97C},
+    {0xA984, 0xA9B2}, {0xA9CF, 0xA9CF}, {0xA9E0, 0xA9E4}, {0xA9E6, 0xA9EF},
+    {0xA9FA, 0xA9FE}, {0xAA00, 0xAA28}, {0xAA40, 0xAA42}, {0xAA44, 0xAA4B},
+    {0xAA60, 0xAA76}, {0xAA7A, 0xAA7A}, {0xAA7E, 0xAAAF}, {0xAAB1, 0xAAB1},
+    {0xAAB5, 0xAAB6}, {0xAAB9, 0xAABD}, {0xAAC0, 0xAAC0}, {0xAAC2, 0xAAC2},
+    {0xAADB, 0xAADD}, {0xAAE0, 0xAAEA}, {0xAAF2, 0xAAF4}, {0xAB01, 0xAB06},
+    {0xAB09, 0xAB0E}, {0xAB11, 0xAB16}, {0xAB20, 0xAB26}, {0xAB28, 0xAB2E},
+    {0xAB30, 0xAB5A}, {0xAB5C, 0xAB69}, {0xAB70, 0xABE2}, {0xAC00, 0xD7A3},
+    {0xD7B0, 0xD7C6}, {0xD7CB, 0xD7FB}, {0xF900, 0xFA6D}, {0xFA70, 0xFAD9},
+    {0xFB00, 0xFB06}, {0xFB13, 0xFB17}, {0xFB1D, 0xFB1D}, {0xFB1F, 0xFB28},
+    {0xFB2A, 0xFB36}, {0xFB38, 0xFB3C}, {0xFB3E, 0xFB3E}, {0xFB40, 0xFB41},
+    {0xFB43, 0xFB44}, {0xFB46, 0xFBB1}, {0xFBD3, 0xFC5D}, {0xFC64, 0xFD3D},
+    {0xFD50, 0xFD8F}, {0xFD92, 0xFDC7}, {0xFDF0, 0xFDF9}, {0xFE71, 0xFE71},
+    {0xFE73, 0xFE73}, {0xFE77, 0xFE77}, {0xFE79, 0xFE79}, {0xFE7B, 0xFE7B},
+    {0xFE7D, 0xFE7D}, {0xFE7F, 0xFEFC}, {0xFF21, 0xFF3A}, {0xFF41, 0xFF5A},
+    {0xFF66, 0xFF9D}, {0xFFA0, 0xFFBE}, {0xFFC2, 0xFFC7}, {0xFFCA, 0xFFCF},
+    {0xFFD2, 0xFFD7}, {0xFFDA, 0xFFDC}, {0x10000, 0x1000B}, {0x1000D, 0x10026},
+    {0x10028, 0x1003A}, {0x1003C, 0x1003D}, {0x1003F, 0x1004D},
+    {0x10050, 0x1005D}, {0x10080, 0x100FA}, {0x10140, 0x10174},
+    {0x10280, 0x1029C}, {0x102A0, 0x102D0}, {0x10300, 0x1031F},
+    {0x1032D, 0x1034A}, {0x10350, 0x10375}, {0x10380, 0x1039D},
+    {0x103A0, 0x103C3}, {0x103C8, 0x103CF}, {0x103D1, 0x103D5},
+    {0x10400, 0x1049D}, {0x104B0, 0x104D3}, {0x104D8, 0x104FB},
+    {0x10500, 0x10527}, {0x10530, 0x10563}, {0x10570, 0x1057A},
+    {0x1057C, 0x1058A}, {0x1058C, 0x10592}, {0x10594, 0x10595},
+    {0x10597, 0x105A1}, {0x105A3, 0x105B1}, {0x105B3, 0x105B9},
+    {0x105BB, 0x105BC}, {0x10600, 0x10736}, {0x10740, 0x10755},
+    {0x10760, 0x10767}, {0x10780, 0x10785}, {0x10787, 0x107B0},
+    {0x107B2, 0x107BA}, {0x10800, 0x10805}, {0x10808, 0x10808},
+    {0x1080A, 0x10835}, {0x10837, 0x10838}, {0x1083C, 0x1083C},
+    {0x1083F, 0x10855}, {0x10860, 0x10876}, {0x10880, 0x1089E},
+    {0x108E0, 0x108F2}, {0x108F4, 0x108F5}, {0x10900, 0x10915},
+    {0x10920, 0x10939}, {0x10980, 0x109B7}, {0x109BE, 0x109BF},
+    {0x10A00, 0x10A00}, {0x10A10, 0x10A13}, {0x10A15, 0x10A17},
+    {0x10A19, 0x10A35}, {0x10A60, 0x10A7C}, {0x10A80, 0x10A9C},
+    {0x10AC0, 0x10AC7}, {0x10AC9, 0x10AE4}, {0x10B00, 0x10B35},
+    {0x10B40, 0x10B55}, {0x10B60, 0x10B72}, {0x10B80, 0x10B91},
+    {0x10C00, 0x10C48}, {0x10C80, 0x10CB2}, {0x10CC0, 0x10CF2},
+    {0x10D00, 0x10D23}, {0x10E80, 0x10EA9}, {0x10EB0, 0x10EB1},
+    {0x10F00, 0x10F1C}, {0x10F27, 0x10F27}, {0x10F30, 0x10F45},
+    {0x10F70, 0x10F81}, {0x10FB0, 0x10FC4}, {0x10FE0, 0x10FF6},
+    {0x11003, 0x11037}, {0x11071, 0x11072}, {0x11075, 0x11075},
+    {0x11083, 0x110AF}, {0x110D0, 0x110E8}, {0x11103, 0x11126},
+    {0x11144, 0x11144}, {0x11147, 0x11147}, {0x11150, 0x11172},
+    {0x11176, 0x11176}, {0x11183, 0x111B2}, {0x111C1, 0x111C4},
+    {0x111DA, 0x111DA}, {0x111DC, 0x111DC}, {0x11200, 0x11211},
+    {0x11213, 0x1122B}, {0x11280, 0x11286}, {0x11288, 0x11288},
+    {0x1128A, 0x1128D}, {0x1128F, 0x1129D}, {0x1129F, 0x112A8},
+    {0x112B0, 0x112DE}, {0x11305, 0x1130C}, {0x1130F, 0x11310},
+    {0x11313, 0x11328}, {0x1132A, 0x11330}, {0x11332, 0x11333},
+    {0x11335, 0x11339}, {0x1133D, 0x1133D}, {0x11350, 0x11350},
+    {0x1135D, 0x11361}, {0x11400, 0x11434}, {0x11447, 0x1144A},
+    {0x1145F, 0x11461}, {0x11480, 0x114AF}, {0x114C4, 0x114C5},
+    {0x114C7, 0x114C7}, {0x11580, 0x115AE}, {0x115D8, 0x115DB},
+    {0x11600, 0x1162F}, {0x11644, 0x11644}, {0x11680, 0x116AA},
+    {0x116B8, 0x116B8}, {0x11700, 0x1171A}, {0x11740, 0x11746},
+    {0x11800, 0x1182B}, {0x118A0, 0x118DF}, {0x118FF, 0x11906},
+    {0x11909, 0x11909}, {0x1190C, 0x11913}, {0x11915, 0x11916},
+    {0x11918, 0x1192F}, {0x1193F, 0x1193F}, {0x11941, 0x11941},
+    {0x119A0, 0x119A7}, {0x119AA, 0x119D0}, {0x119E1, 0x119E1},
+    {0x119E3, 0x119E3}, {0x11A00, 0x11A00}, {0x11A0B, 0x11A32},
+    {0x11A3A, 0x11A3A}, {0x11A50, 0x11A50}, {0x11A5C, 0x11A89},
+    {0x11A9D, 0x11A9D}, {0x11AB0, 0x11AF8}, {0x11C00, 0x11C08},
+    {0x11C0A, 0x11C2E}, {0x11C40, 0x11C40}, {0x11C72, 0x11C8F},
+    {0x11D00, 0x11D06}, {0x11D08, 0x11D09}, {0x11D0B, 0x11D30},
+    {0x11D46, 0x11D46}, {0x11D60, 0x11D65}, {0x11D67, 0x11D68},
+    {0x11D6A, 0x11D89}, {0x11D98, 0x11D98}, {0x11EE0, 0x11EF2},
+    {0x11FB0, 0x11FB0}, {0x12000, 0x12399}, {0x12400, 0x1246E},
+    {0x12480, 0x12543}, {0x12F90, 0x12FF0}, {0x13000, 0x1342E},
+    {0x14400, 0x14646}, {0x16800, 0x16A38}, {0x16A40, 0x16A5E},
+    {0x16A70, 0x16ABE}, {0x16AD0, 0x16AED}, {0x16B00, 0x16B2F},
+    {0x16B40, 0x16B43}, {0x16B63, 0x16B77}, {0x16B7D, 0x16B8F},
+    {0x16E40, 0x16E7F}, {0x16F00, 0x16F4A}, {0x16F50, 0x16F50},
+    {0x16F93, 0x16F9F}, {0x16FE0, 0x16FE1}, {0x16FE3, 0x16FE3},
+    {0x17000, 0x187F7}, {0x18800, 0x18CD5}, {0x18D00, 0x18D08},
+    {0x1AFF0, 0x1AFF3}, {0x1AFF5, 0x1AFFB}, {0x1AFFD, 0x1AFFE},
+    {0x1B000, 0x1B122}, {0x1B150, 0x1B152}, {0x1B164, 0x1B167},
+    {0x1B170, 0x1B2FB}, {0x1BC00, 0x1BC6A}, {0x1BC70, 0x1BC7C},
+    {0x1BC80, 0x1BC88}, {0x1BC90, 0x1BC99}, {0x1D400, 0x1D454},
+    {0x1D456, 0x1D49C}, {0x1D49E, 0x1D49F}, {0x1D4A2, 0x1D4A2},
+    {0x1D4A5, 0x1D4A6}, {0x1D4A9, 0x1D4AC}, {0x1D4AE, 0x1D4B9},
+    {0x1D4BB, 0x1D4BB}, {0x1D4BD, 0x1D4C3}, {0x1D4C5, 0x1D505},
+    {0x1D507, 0x1D50A}, {0x1D50D, 0x1D514}, {0x1D516, 0x1D51C},
+    {0x1D51E, 0x1D539}, {0x1D53B, 0x1D53E}, {0x1D540, 0x1D544},
+    {0x1D546, 0x1D546}, {0x1D54A, 0x1D550}, {0x1D552, 0x1D6A5},
+    {0x1D6A8, 0x1D6C0}, {0x1D6C2, 0x1D6DA}, {0x1D6DC, 0x1D6FA},
+    {0x1D6FC, 0x1D714}, {0x1D716, 0x1D734}, {0x1D736, 0x1D74E},
+    {0x1D750, 0x1D76E}, {0x1D770, 0x1D788}, {0x1D78A, 0x1D7A8},
+    {0x1D7AA, 0x1D7C2}, {0x1D7C4, 0x1D7CB}, {0x1DF00, 0x1DF1E},
+    {0x1E100, 0x1E12C}, {0x1E137, 0x1E13D}, {0x1E14E, 0x1E14E},
+    {0x1E290, 0x1E2AD}, {0x1E2C0, 0x1E2EB}, {0x1E7E0, 0x1E7E6},
+    {0x1E7E8, 0x1E7EB}, {0x1E7ED, 0x1E7EE}, {0x1E7F0, 0x1E7FE},
+    {0x1E800, 0x1E8C4}, {0x1E900, 0x1E943}, {0x1E94B, 0x1E94B},
+    {0x1EE00, 0x1EE03}, {0x1EE05, 0x1EE1F}, {0x1EE21, 0x1EE22},
+    {0x1EE24, 0x1EE24}, {0x1EE27, 0x1EE27}, {0x1EE29, 0x1EE32},
+    {0x1EE34, 0x1EE37}, {0x1EE39, 0x1EE39}, {0x1EE3B, 0x1EE3B},
+    {0x1EE42, 0x1EE42}, {0x1EE47, 0x1EE47}, {0x1EE49, 0x1EE49},
+    {0x1EE4B, 0x1EE4B}, {0x1EE4D, 0x1EE4F}, {0x1EE51, 0x1EE52},
+    {0x1EE54, 0x1EE54}, {0x1EE57, 0x1EE57}, {0x1EE59, 0x1EE59},
+    {0x1EE5B, 0x1EE5B}, {0x1EE5D, 0x1EE5D}, {0x1EE5F, 0x1EE5F},
+    {0x1EE61, 0x1EE62}, {0x1EE64, 0x1EE64}, {0x1EE67, 0x1EE6A},
+    {0x1EE6C, 0x1EE72}, {0x1EE74, 0x1EE77}, {0x1EE79, 0x1EE7C},
+    {0x1EE7E, 0x1EE7E}, {0x1EE80, 0x1EE89}, {0x1EE8B, 0x1EE9B},
+    {0x1EEA1, 0x1EEA3}, {0x1EEA5, 0x1EEA9}, {0x1EEAB, 0x1EEBB},
+    {0x20000, 0x2A6DF}, {0x2A700, 0x2B738}, {0x2B740, 0x2B81D},
+    {0x2B820, 0x2CEA1}, {0x2CEB0, 0x2EBE0}, {0x2F800, 0x2FA1D},
+    {0x30000, 0x3134A},
+};
+
+static const lexer_code_point_range_t lexer_xid_continue_table[] = {
+    {0xB7, 0xB7}, {0x300, 0x36F}, {0x387, 0x387}, {0x483, 0x487},
+    {0x591, 0x5BD}, {0x5BF, 0x5BF}, {0x5C1, 0x5C2}, {0x5C4, 0x5C5},
+    {0x5C7, 0x5C7}, {0x610, 0x61A}, {0x64B, 0x669}, {0x670, 0x670},
+    {0x6D6, 0x6DC}, {0x6DF, 0x6E4}, {0x6E7, 0x6E8}, {0x6EA, 0x6ED},
+    {0x6F0, 0x6F9}, {0x711, 0x711}, {0x730, 0x74A}, {0x7A6, 0x7B0},
+    {0x7C0, 0x7C9}, {0x7EB, 0x7F3}, {0x7FD, 0x7FD}, {0x816, 0x819},
+    {0x81B, 0x823}, {0x825, 0x827}, {0x829, 0x82D}, {0x859, 0x85B},
+    {0x898, 0x89F}, {0x8CA, 0x8E1}, {0x8E3, 0x903}, {0x93A, 0x93C},
+    {0x93E, 0x94F}, {0x951, 0x957}, {0x962, 0x963}, {0x966, 0x96F},
+    {0x981, 0x983}, {0x9BC, 0x9BC}, {0x9BE, 0x9C4}, {0x9C7, 0x9C8},
+    {0x9CB, 0x9CD}, {0x9D7, 0x9D7}, {0x9E2, 0x9E3}, {0x9E6, 0x9EF},
+    {0x9FE, 0x9FE}, {0xA01, 0xA03}, {0xA3C, 0xA3C}, {0xA3E, 0xA42},
+    {0xA47, 0xA48}, {0xA4B, 0xA4D}, {0xA51, 0xA51}, {0xA66, 0xA71},
+    {0xA75, 0xA75}, {0xA81, 0xA83}, {0xABC, 0xABC}, {0xABE, 0xAC5},
+    {0xAC7, 0xAC9}, {0xACB, 0xACD}, {0xAE2, 0xAE3}, {0xAE6, 0xAEF},
+    {0xAFA, 0xAFF}, {0xB01, 0xB03}, {0xB3C, 0xB3C}, {0xB3E, 0xB44},
+    {0xB47, 0xB48}, {0xB4B, 0xB4D}, {0xB55, 0xB57}, {0xB62, 0xB63},
+    {0xB66, 0xB6F}, {0xB82, 0xB82}, {0xBBE, 0xBC2}, {0xBC6, 0xBC8},
+    {0xBCA, 0xBCD}, {0xBD7, 0xBD7}, {0xBE6, 0xBEF}, {0xC00, 0xC04},
+    {0xC3C, 0xC3C}, {0xC3E, 0xC44}, {0xC46, 0xC48}, {0xC4A, 0xC4D},
+    {0xC55, 0xC56}, {0xC62, 0xC63}, {0xC66, 0xC6F}, {0xC81, 0xC83},
+    {0xCBC, 0xCBC}, {0xCBE, 0xCC4}, {0xCC6, 0xCC8}, {0xCCA, 0xCCD},
+    {0xCD5, 0xCD6}, {0xCE2, 0xCE3}, {0xCE6, 0xCEF}, {0xD00, 0xD03},
+    {0xD3B, 0xD3C}, {0xD3E, 0xD44}, {0xD46, 0xD48}, {0xD4A, 0xD4D},
+    {0xD57, 0xD57}, {0xD62, 0xD63}, {0xD66, 0xD6F}, {0xD81, 0xD83},
+    {0xDCA, 0xDCA}, {0xDCF, 0xDD4}, {0xDD6, 0xDD6}, {0xDD8, 0xDDF},
+    {0xDE6, 0xDEF}, {0xDF2, 0xDF3}, {0xE31, 0xE31}, {0xE33, 0xE3A},
+    {0xE47, 0xE4E}, {0xE50, 0xE59}, {0xEB1, 0xEB1}, {0xEB3, 0xEBC},
+    {0xEC8, 0xECD}, {0xED0, 0xED9}, {0xF18, 0xF19}, {0xF20, 0xF29},
+    {0xF35, 0xF35}, {0xF37, 0xF37}, {0xF39, 0xF39}, {0xF3E, 0xF3F},
+    {0xF71, 0xF84}, {0xF86, 0xF87}, {0xF8D, 0xF97}, {0xF99, 0xFBC},
+    {0xFC6, 0xFC6}, {0x102B, 0x103E}, {0x1040, 0x1049}, {0x1056, 0x1059},
+    {0x105E, 0x1060}, {0x1062, 0x1064}, {0x1067, 0x106D}, {0x1071, 0x1074},
+    {0x1082, 0x108D}, {0x108F, 0x109D}, {0x135D, 0x135F}, {0x1369, 0x1371},
+    {0x1712, 0x1715}, {0x1732, 0x1734}, {0x1752, 0x1753}, {0x1772, 0x1773},
+    {0x17B4, 0x17D3}, {0x17DD, 0x17DD}, {0x17E0, 0x17E9}, {0x180B, 0x180D},
+    {0x180F, 0x1819}, {0x18A9, 0x18A9}, {0x1920, 0x192B}, {0x1930, 0x193B},
+    {0x1946, 0x194F}, {0x19D0, 0x19DA}, {0x1A17, 0x1A1B}, {0x1A55, 0x1A5E},
+    {0x1A60, 0x1A7C}, {0x1A7F, 0x1A89}, {0x1A90, 0x1A99}, {0x1AB0, 0x1ABD},
+    {0x1ABF, 0x1ACE}, {0x1B00, 0x1B04}, {0x1B34, 0x1B44}, {0x1B50, 0x1B59},
+    {0x1B6B, 0x1B73}, {0x1B80, 0x1B82}, {0x1BA1, 0x1BAD}, {0x1BB0, 0x1BB9},
+    {0x1BE6, 0x1BF3}, {0x1C24, 0x1C37}, {0x1C40, 0x1C49}, {0x1C50, 0x1C59},
+    {0x1CD0, 0x1CD2}, {0x1CD4, 0x1CE8}, {0x1CED, 0x1CED}, {0x1CF4, 0x1CF4},
+    {0x1CF7, 0x1CF9}, {0x1DC0, 0x1DFF}, {0x203F, 0x2040}, {0x2054, 0x2054},
+    {0x20D0, 0x20DC}, {0x20E1, 0x20E1}, {0x20E5, 0x20F0}, {0x2CEF, 0x2CF1},
+    {0x2D7F, 0x2D7F}, {0x2DE0, 0x2DFF}, {0x302A, 0x302F}, {0x3099, 0x309A},
+    {0xA620, 0xA629}, {0xA66F, 0xA66F}, {0xA674, 0xA67D}, {0xA69E, 0xA69F},
+    {0xA6F0, 0xA6F1}, {0xA802, 0xA802}, {0xA806, 0xA806}, {0xA80B, 0xA80B},
+    {0xA823, 0xA827}, {0xA82C, 0xA82C}, {0xA880, 0xA881}, {0xA8B4, 0xA8C5},
+    {0xA8D0, 0xA8D9}, {0xA8E0, 0xA8F1}, {0xA8FF, 0xA909}, {0xA926, 0xA92D},
+    {0xA947, 0xA953}, {0xA980, 0xA983}, {0xA9B3, 0xA9C0}, {0xA9D0, 0xA9D9},
+    {0xA9E5, 0xA9E5}, {0xA9F0, 0xA9F9}, {0xAA29, 0xAA36}, {0xAA43, 0xAA43},
+    {0xAA4C, 0xAA4D}, {0xAA50, 0xAA59}, {0xAA7B, 0xAA7D}, {0xAAB0, 0xAAB0},
+    {0xAAB2, 0xAAB4}, {0xAAB7, 0xAAB8}, {0xAABE, 0xAABF}, {0xAAC1, 0xAAC1},
+    {0xAAEB, 0xAAEF}, {0xAAF5, 0xAAF6}, {0xABE3, 0xABEA}, {0xABEC, 0xABED},
+    {0xABF0, 0xABF9}, {0xFB1E, 0xFB1E}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0xFE33, 0xFE34}, {0xFE4D, 0xFE4F}, {0xFF10, 0xFF19}, {0xFF3F, 0xFF3F},
+    {0xFF9E, 0xFF9F}, {0x101FD, 0x101FD}, {0x102E0, 0x102E0},
+    {0x10376, 0x1037A}, {0x104A0, 0x104A9}, {0x10A01, 0x10A03},
+    {0x10A05, 0x10A06}, {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A},
+    {0x10A3F, 0x10A3F}, {0x10AE5, 0x10AE6}, {0x10D24, 0x10D27},
+    {0x10D30, 0x10D39}, {0x10EAB, 0x10EAC}, {0x10F46, 0x10F50},
+    {0x10F82, 0x10F85}, {0x11000, 0x11002}, {0x11038, 0x11046},
+    {0x11066, 0x11070}, {0x11073, 0x11074}, {0x1107F, 0x11082},
+    {0x110B0, 0x110BA}, {0x110C2, 0x110C2}, {0x110F0, 0x110F9},
+    {0x11100, 0x11102}, {0x11127, 0x11134}, {0x11136, 0x1113F},
+    {0x11145, 0x11146}, {0x11173, 0x11173}, {0x11180, 0x11182},
+    {0x111B3, 0x111C0}, {0x111C9, 0x111CC}, {0x111CE, 0x111D9},
+    {0x1122C, 0x11237}, {0x1123E, 0x1123E}, {0x112DF, 0x112EA},
+    {0x112F0, 0x112F9}, {0x11300, 0x11303}, {0x1133B, 0x1133C},
+    {0x1133E, 0x11344}, {0x11347, 0x11348}, {0x1134B, 0x1134D},
+    {0x11357, 0x11357}, {0x11362, 0x11363}, {0x11366, 0x1136C},
+    {0x11370, 0x11374}, {0x11435, 0x11446}, {0x11450, 0x11459},
+    {0x1145E, 0x1145E}, {0x114B0, 0x114C3}, {0x114D0, 0x114D9},
+    {0x115AF, 0x115B5}, {0x115B8, 0x115C0}, {0x115DC, 0x115DD},
+    {0x11630, 0x11640}, {0x11650, 0x11659}, {0x116AB, 0x116B7},
+    {0x116C0, 0x116C9}, {0x1171D, 0x1172B}, {0x11730, 0x11739},
+    {0x1182C, 0x1183A}, {0x118E0, 0x118E9}, {0x11930, 0x11935},
+    {0x11937, 0x11938}, {0x1193B, 0x1193E}, {0x11940, 0x11940},
+    {0x11942, 0x11943}, {0x11950, 0x11959}, {0x119D1, 0x119D7},
+    {0x119DA, 0x119E0}, {0x119E4, 0x119E4}, {0x11A01, 0x11A0A},
+    {0x11A33, 0x11A39}, {0x11A3B, 0x11A3E}, {0x11A47, 0x11A47},
+    {0x11A51, 0x11A5B}, {0x11A8A, 0x11A99}, {0x11C2F, 0x11C36},
+    {0x11C38, 0x11C3F}, {0x11C50, 0x11C59}, {0x11C92, 0x11CA7},
+    {0x11CA9, 0x11CB6}, {0x11D31, 0x11D36}, {0x11D3A, 0x11D3A},
+    {0x11D3C, 0x11D3D}, {0x11D3F, 0x11D45}, {0x11D47, 0x11D47},
+    {0x11D50, 0x11D59}, {0x11D8A, 0x11D8E}, {0x11D90, 0x11D91},
+    {0x11D93, 0x11D97}, {0x11DA0, 0x11DA9}, {0x11EF3, 0x11EF6},
+    {0x16A60, 0x16A69}, {0x16AC0, 0x16AC9}, {0x16AF0, 0x16AF4},
+    {0x16B30, 0x16B36}, {0x16B50, 0x16B59}, {0x16F4F, 0x16F4F},
+    {0x16F51, 0x16F87}, {0x16F8F, 0x16F92}, {0x16FE4, 0x16FE4},
+    {0x16FF0, 0x16FF1}, {0x1BC9D, 0x1BC9E}, {0x1CF00, 0x1CF2D},
+    {0x1CF30, 0x1CF46}, {0x1D165, 0x1D169}, {0x1D16D, 0x1D172},
+    {0x1D17B, 0x1D182}, {0x1D185, 0x1D18B}, {0x1D1AA, 0x1D1AD},
+    {0x1D242, 0x1D244}, {0x1D7CE, 0x1D7FF}, {0x1DA00, 0x1DA36},
+    {0x1DA3B, 0x1DA6C}, {0x1DA75, 0x1DA75}, {0x1DA84, 0x1DA84},
+    {0x1DA9B, 0x1DA9F}, {0x1DAA1, 0x1DAAF}, {0x1E000, 0x1E006},
+    {0x1E008, 0x1E018}, {0x1E01B, 0x1E021}, {0x1E023, 0x1E024},
+    {0x1E026, 0x1E02A}, {0x1E130, 0x1E136}, {0x1E140, 0x1E149},
+    {0x1E2AE, 0x1E2AE}, {0x1E2EC, 0x1E2F9}, {0x1E8D0, 0x1E8D6},
+    {0x1E944, 0x1E94A}, {0x1E950, 0x1E959}, {0x1FBF0, 0x1FBF9},
+    {0xE0100, 0xE01EF},
+};
+
+static bool lexer_code_point_in(const lexer_code_point_range_t *ranges,
+                                size_t count, uint32_t code_point) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (ranges[middle].last < code_point) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < count && ranges[low].first <= code_point;
 }
 
-bool lexer_is_alpha(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+bool lexer_is_xid_start(uint32_t code_point) {
+  if (code_point < 0x80) {
+    return lexer_is_alpha((char)code_point);
+  }
+  return lexer_code_point_in(lexer_xid_start_table,
+                             sizeof(lexer_xid_start_table) /
+                                 sizeof(lexer_xid_start_table[0]),
+                             code_point);
+}
+
+bool lexer_is_xid_continue(uint32_t code_point) {
+  if (code_point < 0x80) {
+    return lexer_is_alnum((char)code_point);
+  }
+  return lexer_is_xid_start(code_point) ||
+         lexer_code_point_in(lexer_xid_continue_table,
+                             sizeof(lexer_xid_continue_table) /
+                                 sizeof(lexer_xid_continue_table[0]),
+                             code_point);
 }
 
-bool lexer_is_digit(char c) { return c >= '0' && c <= '9'; }
+static const char *lexer_builtin_class_names[LEXER_CLASS_BUILTIN_COUNT] = {
+    "digit", "alpha", "alnum", "space", "xdigit", "upper", "lower",
+};
+
+int32_t lexer_find_class(const lexer_t *lexer, const char *name) {
+  if (lexer == NULL || name == NULL) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < lexer->class_count; ++i) {
+    const char *class_name = i < LEXER_CLASS_BUILTIN_COUNT
+                                 ? lexer_builtin_class_names[i]
+                                 : lexer->class_names[i];
+    if (strcmp(class_name, name) == 0) {
+      return (int32_t)i;
+    }
+  }
+  return -1;
+}
 
-bool lexer_is_alnum(char c) { return lexer_is_alpha(c) || lexer_is_digit(c); }
+int32_t lexer_define_class(lexer_t *lexer, const char *name,
+                           const char *bytes) {
+  if (lexer == NULL || name == NULL || name[0] == '\0' || bytes == NULL) {
+    return -1;
+  }
+  int32_t class_id = lexer_find_class(lexer, name);
+  if (class_id >= 0 && class_id < LEXER_CLASS_BUILTIN_COUNT) {
+    return -1;
+  }
+  if (class_id < 0) {
+    if (lexer->class_count == LEXER_CLASS_MAX) {
+      return -1;
+    }
+    size_t length = strlen(name);
+    char *copy = malloc(length + 1);
+    ASSERT(copy != NULL && "No more memory");
+    memcpy(copy, name, length + 1);
+    class_id = (int32_t)lexer->class_count++;
+    lexer->class_names[class_id] = copy;
+  }
+  for (const char *p = bytes; *p != '\0'; ++p) {
+    lexer->classes[(unsigned char)*p] |= (uint32_t)1 << class_id;
+  }
+  return class_id;
+}
 
 #endif // PLEXTRUM_IMPL
 
@@ -0,0 +1,478 @@
+/**
+ * plextrum.hpp
+ * Copyright (C) 2024 Paul Passeron
+ * pLEXtrum C++ header file
+ * Paul Passeron <paul.passeron2@gmail.com>
+ */
+
+/********************************************************************************
+ * Compile-time matcher combinators layered over plextrum.h (C++17).
+ *
+ * Matchers are types, so a whole rule list is known to the compiler and
+ * basic_lexer<Flags, Rules...> expands it into a single inlined function: no
+ * token_matcher_fn pointers, first-byte checks folded into constants, and the
+ * lexer flags are template parameters so the branches they control vanish.
+ * Tokens are plain token_t and the state lives in a regular lexer_t, so a
+ * basic_lexer can also be registered as one rule of a runtime lexer.
+ *
+ * Matchers follow PEG semantics: repetitions are greedy and never give back
+ * input, and alt<> is an ordered choice (the first alternative that matches
+ * wins).
+ *
+ *   using namespace plextrum;
+ *   using ident_start = char_class<range<'a', 'z'>, range<'A', 'Z'>,
+ *                                  one_of<'_'>>;
+ *   using digit = char_class<range<'0', '9'>>;
+ *   using my_lexer = basic_lexer<
+ *       LEXER_FLAG_NONE,
+ *       rule<TOK_ARROW, literal<'-', '>'>>,
+ *       rule<TOK_IDENT, seq<ident_start, star<alt<ident_start, digit>>>>,
+ *       rule<TOK_NUMBER, plus<digit>>,
+ *       rule<TOK_SPACE, plus<char_class<one_of<' ', '\t', '\n'>>>,
+ *            TOKEN_FLAG_IGNORE>>;
+ *
+ *   token_t token = my_lexer::next_token(lexer);
+ *
+ * token_range turns any lexer into an input range of tokens whose lexemes are
+ * std::string_view into the source, for range-based for loops and (in C++20)
+ * <ranges> pipelines:
+ *
+ *   for (const plextrum::token &token : plextrum::token_range(lexer)) { ... }
+ *   for (const auto &token : plextrum::basic_token_range<my_lexer::next_token>(
+ *            lexer)) { ... }
+ ********************************************************************************/
+
+#ifndef PLEXTRUM_HPP
+#define PLEXTRUM_HPP
+
+#include "plextrum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#if __cplusplus >= 202002L && __has_include(<ranges>)
+#include <ranges>
+#define PLEXTRUM_HAS_RANGES 1
+#endif
+
+namespace plextrum {
+
+// Compile-time 256-bit byte set
+struct byte_set {
+  std::uint64_t bits[4];
+
+  static constexpr byte_set none() { return {{0, 0, 0, 0}}; }
+
+  static constexpr byte_set all() {
+    return {{~std::uint64_t(0), ~std::uint64_t(0), ~std::uint64_t(0),
+             ~std::uint64_t(0)}};
+  }
+
+  static constexpr byte_set range(unsigned char low, unsigned char high) {
+    byte_set set = none();
+    for (unsigned c = low; c <= high; ++c) {
+      set.bits[c >> 6] |= std::uint64_t(1) << (c & 63);
+    }
+    return set;
+  }
+
+  constexpr bool has(unsigned char c) const {
+    return (bits[c >> 6] >> (c & 63)) & 1;
+  }
+
+  constexpr byte_set operator|(const byte_set &other) const {
+    return {{bits[0] | other.bits[0], bits[1] | other.bits[1],
+             bits[2] | other.bits[2], bits[3] | other.bits[3]}};
+  }
+
+  constexpr byte_set operator~() const {
+    return {{~bits[0], ~bits[1], ~bits[2], ~bits[3]}};
+  }
+
+  lexer_charset_t to_charset() const {
+    return {{bits[0], bits[1], bits[2], bits[3]}};
+  }
+};
+
+// Items of a char_class
+template <char Low, char High> struct range {
+  static constexpr byte_set set = byte_set::range(
+      static_cast<unsigned char>(Low), static_cast<unsigned char>(High));
+};
+
+template <char... Cs> struct one_of {
+  static constexpr byte_set set =
+      (byte_set::none() | ... |
+       byte_set::range(static_cast<unsigned char>(Cs),
+                       static_cast<unsigned char>(Cs)));
+};
+
+// Every matcher M provides:
+//   static constexpr byte_set first();  // Bytes a match can start with
+//   static constexpr bool nullable;      // Can match the empty string
+//   static const char *match(const char *p, const char *end);
+// where match returns the end of the match, or nullptr if it fails.
+
+// One byte from a set
+template <typename... Items> struct char_class {
+  static constexpr byte_set set = (byte_set::none() | ... | Items::set);
+  static constexpr bool nullable = false;
+  static constexpr byte_set first() { return set; }
+  static const char *match(const char *p, const char *end) noexcept {
+    return p < end && set.has(static_cast<unsigned char>(*p)) ? p + 1
+                                                              : nullptr;
+  }
+};
+
+// One byte outside a set
+template <typename... Items> struct not_class {
+  static constexpr byte_set set = ~(byte_set::none() | ... | Items::set);
+  static constexpr bool nullable = false;
+  static constexpr byte_set first() { return set; }
+  static const char *match(const char *p, const char *end) noexcept {
+    return p < end && set.has(static_cast<unsigned char>(*p)) ? p + 1
+                                                              : nullptr;
+  }
+};
+
+using any_byte = not_class<>;
+
+// Exact byte sequence
+template <char... Cs> struct literal {
+  static_assert(sizeof...(Cs) > 0, "empty literal");
+  static constexpr char text[] = {Cs...};
+  static constexpr bool nullable = false;
+  static constexpr byte_set first() {
+    return byte_set::range(static_cast<unsigned char>(text[0]),
+                           static_cast<unsigned char>(text[0]));
+  }
+  static const char *match(const char *p, const char *end) noexcept {
+    if (static_cast<std::size_t>(end - p) < sizeof...(Cs)) {
+      return nullptr;
+    }
+    std::size_t i = 0;
+    return ((p[i++] == Cs) && ...) ? p + sizeof...(Cs) : nullptr;
+  }
+};
+
+// All matchers, one after the other
+template <typename... Ms> struct seq {
+  static constexpr bool nullable = (Ms::nullable && ...);
+  static constexpr byte_set first() {
+    byte_set set = byte_set::none();
+    bool open = true;
+    ((open ? (set = set | Ms::first(), open = Ms::nullable) : false), ...);
+    return set;
+  }
+  static const char *match(const char *p, const char *end) noexcept {
+    return (((p = Ms::match(p, end)) != nullptr) && ...) ? p : nullptr;
+  }
+};
+
+// First matcher that succeeds
+template <typename... Ms> struct alt {
+  static constexpr bool nullable = (Ms::nullable || ...);
+  static constexpr byte_set first() {
+    return (byte_set::none() | ... | Ms::first());
+  }
+  static const char *match(const char *p, const char *end) noexcept {
+    const char *result = nullptr;
+    (((result = Ms::match(p, end)) != nullptr) || ...);
+    return result;
+  }
+};
+
+// Zero or more repetitions
+template <typename M> struct star {
+  static constexpr bool nullable = true;
+  static constexpr byte_set first() { return M::first(); }
+  static const char *match(const char *p, const char *end) noexcept {
+    while (const char *next = M::match(p, end)) {
+      if (next == p) {
+        break;
+      }
+      p = next;
+    }
+    return p;
+  }
+};
+
+// One or more repetitions
+template <typename M> struct plus {
+  static constexpr bool nullable = M::nullable;
+  static constexpr byte_set first() { return M::first(); }
+  static const char *match(const char *p, const char *end) noexcept {
+    p = M::match(p, end);
+    return p ? star<M>::match(p, end) : nullptr;
+  }
+};
+
+// Zero or one occurrence
+template <typename M> struct opt {
+  static constexpr bool nullable = true;
+  static constexpr byte_set first() { return M::first(); }
+  static const char *match(const char *p, const char *end) noexcept {
+    const char *next = M::match(p, end);
+    return next ? next : p;
+  }
+};
+
+// Token kind and flags produced by a matcher
+template <std::uint32_t Kind, typename Matcher,
+          std::uint32_t TokenFlags = TOKEN_FLAG_NONE>
+struct rule {
+  using matcher = Matcher;
+  static constexpr std::uint32_t kind = Kind;
+  static constexpr std::uint32_t flags = TokenFlags;
+};
+
+namespace detail {
+
+// Column width of [p, stop): bytes, or UTF-8 code points
+template <bool Utf8Columns>
+inline std::size_t width(const char *p, const char *stop) noexcept {
+  if constexpr (Utf8Columns) {
+    std::size_t code_points = 0;
+    for (; p < stop; ++p) {
+      code_points += (static_cast<unsigned char>(*p) & 0xC0) != 0x80;
+    }
+    return code_points;
+  } else {
+    return static_cast<std::size_t>(stop - p);
+  }
+}
+
+// Moves the lexer to `stop`, updating line and column
+template <bool Utf8Columns>
+inline void advance_to(lexer_t *lexer, const char *stop) noexcept {
+  const char *p = lexer->source + lexer->position;
+  const char *last_newline = nullptr;
+  for (const char *nl;
+       (nl = static_cast<const char *>(std::memchr(p, '\n', stop - p)));
+       p = nl + 1) {
+    lexer->line++;
+    last_newline = nl;
+  }
+  if (last_newline) {
+    lexer->column = 1 + width<Utf8Columns>(last_newline + 1, stop);
+  } else {
+    lexer->column += width<Utf8Columns>(p, stop);
+  }
+  lexer->position = static_cast<std::size_t>(stop - lexer->source);
+}
+
+struct match_result {
+  const char *stop = nullptr;
+  std::uint32_t kind = 0;
+  std::uint32_t flags = 0;
+};
+
+template <typename Rule>
+inline bool try_first(unsigned char c, const char *p, const char *end,
+                      match_result &result) noexcept {
+  static constexpr byte_set first = Rule::matcher::first();
+  if (!first.has(c)) {
+    return false;
+  }
+  const char *stop = Rule::matcher::match(p, end);
+  if (stop == nullptr || stop == p) {
+    return false;
+  }
+  result = {stop, Rule::kind, Rule::flags};
+  return true;
+}
+
+template <typename Rule>
+inline void try_longest(unsigned char c, const char *p, const char *end,
+                        match_result &result) noexcept {
+  static constexpr byte_set first = Rule::matcher::first();
+  if (!first.has(c)) {
+    return;
+  }
+  const char *stop = Rule::matcher::match(p, end);
+  // Strictly longer only, so earlier rules win ties
+  if (stop != nullptr && stop > (result.stop ? result.stop : p)) {
+    result = {stop, Rule::kind, Rule::flags};
+  }
+}
+
+} // namespace detail
+
+// Lexer whose rule list is fixed at compile time. `Flags` replaces the
+// runtime lexer flags (LEXER_FLAG_KEEP_IGNORABLE, LEXER_FLAG_LONGEST_MATCH,
+// LEXER_FLAG_LAZY_LOCATION, LEXER_FLAG_UTF8_COLUMNS).
+template <std::uint32_t Flags, typename... Rules> struct basic_lexer {
+  static_assert(sizeof...(Rules) > 0, "basic_lexer needs at least one rule");
+
+  static constexpr byte_set first() {
+    return (byte_set::none() | ... | Rules::matcher::first());
+  }
+
+  // Matches one token at the current position (a token_matcher_fn)
+  static bool match(lexer_t *lexer, token_t *token) noexcept {
+    const char *start = lexer->source + lexer->position;
+    const char *end = lexer->source + lexer->source_length;
+    if (start >= end) {
+      return false;
+    }
+    const unsigned char c = static_cast<unsigned char>(*start);
+    detail::match_result result;
+    if constexpr ((Flags & LEXER_FLAG_LONGEST_MATCH) != 0) {
+      (detail::try_longest<Rules>(c, start, end, result), ...);
+    } else {
+      (detail::try_first<Rules>(c, start, end, result) || ...);
+    }
+    if (result.stop == nullptr) {
+      return false;
+    }
+    token->kind = result.kind;
+    token->flags = result.flags;
+    token->lexeme = start;
+    token->length = static_cast<std::size_t>(result.stop - start);
+    token->filename = lexer->filename;
+    token->line = lexer->line;
+    token->column = lexer->column;
+    token->source = lexer->source_id;
+    advance(lexer, result.stop);
+    return true;
+  }
+
+  // Same contract as lexer_next_token
+  static token_t next_token(lexer_t *lexer) noexcept {
+    token_t token{};
+    while (lexer->position < lexer->source_length) {
+      if (!match(lexer, &token)) {
+        token_t error{};
+        error.kind = INTERNAL_TOKEN_ERROR;
+        error.lexeme = lexer->source + lexer->position;
+        error.length = 1;
+        error.filename = lexer->filename;
+        error.line = lexer->line;
+        error.column = lexer->column;
+        error.source = lexer->source_id;
+        advance(lexer, error.lexeme + 1);
+        return error;
+      }
+      if constexpr ((Flags & LEXER_FLAG_KEEP_IGNORABLE) == 0) {
+        if (token.flags & TOKEN_FLAG_IGNORE) {
+          continue;
+        }
+      }
+      return token;
+    }
+    token = token_t{};
+    token.kind = INTERNAL_TOKEN_EOF;
+    token.lexeme = "EOF";
+    token.filename = lexer->filename;
+    token.line = lexer->line;
+    token.column = lexer->column;
+    token.source = lexer->source_id;
+    return token;
+  }
+
+  // Registers the whole rule list as a single rule of a runtime lexer
+  static bool install(lexer_t *lexer, token_action_fn action = nullptr) {
+    const lexer_charset_t set = first().to_charset();
+    return lexer_add_rule_ex(lexer, match, action, &set);
+  }
+
+private:
+  static void advance(lexer_t *lexer, const char *stop) noexcept {
+    if constexpr ((Flags & LEXER_FLAG_LAZY_LOCATION) != 0) {
+      lexer->position = static_cast<std::size_t>(stop - lexer->source);
+    } else {
+      detail::advance_to<(Flags & LEXER_FLAG_UTF8_COLUMNS) != 0>(lexer, stop);
+    }
+  }
+};
+
+// Token yielded by a token_range. The lexeme points into the source text.
+struct token {
+  std::uint32_t kind;
+  std::uint32_t flags;
+  std::string_view lexeme;
+  std::size_t line;
+  std::size_t column;
+  source_id_t source;
+};
+
+// End of a token_range, reached at the EOF token
+struct token_sentinel {};
+
+// Single-pass range over the tokens of `lexer`, from its current position up
+// to (not including) the EOF token. `Next` is the tokenizer, lexer_next_token
+// or a basic_lexer's next_token; being a template argument, it is called
+// directly. Nothing is allocated or copied: each step is one call to `Next`.
+template <token_t (*Next)(lexer_t *) = lexer_next_token>
+class basic_token_range
+#ifdef PLEXTRUM_HAS_RANGES
+    : public std::ranges::view_base
+#endif
+{
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = token;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const token *;
+    using reference = const token &;
+
+    iterator() = default;
+    // Lexes the first token
+    explicit iterator(lexer_t *lexer) noexcept : lexer_(lexer) { ++*this; }
+
+    reference operator*() const noexcept { return token_; }
+    pointer operator->() const noexcept { return &token_; }
+
+    iterator &operator++() noexcept {
+      const token_t next = Next(lexer_);
+      token_.kind = next.kind;
+      token_.flags = next.flags;
+      token_.lexeme = std::string_view(next.lexeme, next.length);
+      token_.line = next.line;
+      token_.column = next.column;
+      token_.source = next.source;
+      return *this;
+    }
+    void operator++(int) noexcept { ++*this; }
+
+    friend bool operator==(const iterator &it, token_sentinel) noexcept {
+      return it.token_.kind == INTERNAL_TOKEN_EOF;
+    }
+#if __cplusplus < 202002L
+    // Synthesized from operator== in C++20
+    friend bool operator==(token_sentinel end, const iterator &it) noexcept {
+      return it == end;
+    }
+    friend bool operator!=(const iterator &it, token_sentinel end) noexcept {
+      return !(it == end);
+    }
+    friend bool operator!=(token_sentinel end, const iterator &it) noexcept {
+      return !(it == end);
+    }
+#endif
+
+  private:
+    lexer_t *lexer_ = nullptr;
+    token token_{INTERNAL_TOKEN_EOF, 0, {}, 0, 0, 0};
+  };
+
+  basic_token_range() = default;
+  explicit basic_token_range(lexer_t *lexer) noexcept : lexer_(lexer) {}
+
+  // Starts lexing: call once, as the range is single-pass
+  iterator begin() const noexcept { return iterator(lexer_); }
+  token_sentinel end() const noexcept { return {}; }
+
+private:
+  lexer_t *lexer_ = nullptr;
+};
+
+using token_range = basic_token_range<>;
+
+} // namespace plextrum
+
+#endif // PLEXTRUM_HPP
@@ -0,0 +1,455 @@
+/**
+ * plextrum_gen.c
+ * Copyright (C) 2024 Paul Passeron
+ * pLEXtrum scanner generator
+ * Paul Passeron <paul.passeron2@gmail.com>
+ */
+
+/********************************************************************************
+ * Ahead-of-time scanner generator built on pLEXtrum's regex rules.
+ *
+ * Reads a rule file and writes a direct-coded C scanner: every DFA state is a
+ * label and every transition a goto, so matching a token involves no table
+ * lookup and no indirect call. The generated code uses the regular
+ * lexer_t/token_t API and can either be registered as a single rule
+ * (<prefix>_install) or replace lexer_next_token (<prefix>_next_token).
+ *
+ * Build:  cc -o plextrum_gen plextrum_gen.c
+ * Usage:  plextrum_gen rules.lex [-o scanner.c]
+ *
+ * Rule file format (one rule per line, `#` starts a comment, LF or CRLF line
+ * endings, lines limited to 4095 bytes):
+ *
+ *   %prefix c_scanner          // Prefix of the generated functions
+ *   %include "tokens.h"        // Copied as an #include line
+ *   TOKEN_IDENT  /\w+/
+ *   TOKEN_NUMBER /[0-9]+/       action=on_number
+ *   TOKEN_SPACE  /\s+/          ignore
+ *
+ * The first column is a C expression giving the token kind, the pattern uses
+ * the syntax of lexer_add_regex_rule (`\/` for a slash), `ignore` marks the
+ * tokens as ignorable and `action=fn` calls `void fn(lexer_t *, token_t *)`
+ * on every match. The scanner picks the longest match, ties going to the
+ * earliest rule.
+ ********************************************************************************/
+
+#define LEXER_IMPL
+#include "plextrum.h"
+
+#include <ctype.h>
+
+#define GEN_MAX_LINE 4096
+
+typedef struct gen_rule_t {
+  char *kind;
+  char *pattern;
+  char *action; // NULL if none
+  bool ignore;
+  size_t line;
+} gen_rule_t;
+
+typedef struct gen_rules_t {
+  gen_rule_t *items;
+  size_t count;
+  size_t capacity;
+} gen_rules_t;
+
+typedef struct gen_includes_t {
+  char **items;
+  size_t count;
+  size_t capacity;
+} gen_includes_t;
+
+typedef struct gen_spec_t {
+  char *prefix;
+  gen_includes_t includes;
+  gen_rules_t rules;
+} gen_spec_t;
+
+static char *gen_strndup(const char *s, size_t n) {
+  char *copy = malloc(n + 1);
+  ASSERT(copy != NULL && "No more memory");
+  memcpy(copy, s, n);
+  copy[n] = '\0';
+  return copy;
+}
+
+static const char *gen_skip_spaces(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r') {
+    p++;
+  }
+  return p;
+}
+
+static const char *gen_word_end(const char *p) {
+  while (*p && !isspace((unsigned char)*p)) {
+    p++;
+  }
+  return p;
+}
+
+static bool gen_error(const char *path, size_t line, const char *message) {
+  fprintf(stderr, "%s:%zu: %s\n", path, line, message);
+  return false;
+}
+
+// Reports an error on a rule line and frees what was parsed of it
+static bool gen_rule_error(gen_rule_t *rule, const char *path, size_t line,
+                           const char *message) {
+  free(rule->kind);
+  free(rule->pattern);
+  free(rule->action);
+  return gen_error(path, line, message);
+}
+
+static bool gen_parse_rule(const char *path, size_t line_number,
+                           const char *p, gen_spec_t *spec) {
+  gen_rule_t rule = {0};
+  rule.line = line_number;
+
+  const char *kind_end = gen_word_end(p);
+  rule.kind = gen_strndup(p, (size_t)(kind_end - p));
+
+  p = gen_skip_spaces(kind_end);
+  if (*p != '/') {
+    return gen_rule_error(&rule, path, line_number,
+                          "expected /pattern/ after the kind");
+  }
+  const char *pattern = ++p;
+  while (*p && *p != '/') {
+    if (*p == '\\' && p[1] != '\0') {
+      p++;
+    }
+    p++;
+  }
+  if (*p != '/') {
+    return gen_rule_error(&rule, path, line_number,
+                          "unterminated pattern");
+  }
+  rule.pattern = gen_strndup(pattern, (size_t)(p - pattern));
+  p++;
+
+  while (*(p = gen_skip_spaces(p)) && *p != '\n' && *p != '#') {
+    const char *end = gen_word_end(p);
+    size_t length = (size_t)(end - p);
+    if (length == 6 && strncmp(p, "ignore", 6) == 0) {
+      rule.ignore = true;
+    } else if (length > 7 && strncmp(p, "action=", 7) == 0) {
+      free(rule.action);
+      rule.action = gen_strndup(p + 7, length - 7);
+    } else {
+      return gen_rule_error(&rule, path, line_number,
+                            "unknown rule option");
+    }
+    p = end;
+  }
+
+  da_append(&spec->rules, rule);
+  return true;
+}
+
+static bool gen_parse_spec(const char *path, FILE *file, gen_spec_t *spec) {
+  char line[GEN_MAX_LINE];
+  size_t line_number = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    // A line without its '\n' is either the last one or too long to fit. The
+    // '\r' of a CRLF ending does not count against the limit.
+    if (strchr(line, '\n') == NULL) {
+      int next = getc(file);
+      if (next == '\r') {
+        next = getc(file);
+      }
+      if (next != EOF && next != '\n') {
+        return gen_error(path, line_number, "line too long");
+      }
+    }
+    const char *p = gen_skip_spaces(line);
+    if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#') {
+      continue;
+    }
+    if (*p == '%') {
+      const char *directive_end = gen_word_end(p);
+      const char *value = gen_skip_spaces(directive_end);
+      const char *value_end = value + strlen(value);
+      while (value_end > value && isspace((unsigned char)value_end[-1])) {
+        value_end--;
+      }
+      if (value == value_end) {
+        return gen_error(path, line_number, "missing directive value");
+      }
+      size_t length = (size_t)(directive_end - p);
+      if (length == 7 && strncmp(p, "%prefix", 7) == 0) {
+        free(spec->prefix);
+        spec->prefix = gen_strndup(value, (size_t)(value_end - value));
+      } else if (length == 8 && strncmp(p, "%include", 8) == 0) {
+        char *include = gen_strndup(value, (size_t)(value_end - value));
+        da_append(&spec->includes, include);
+      } else {
+        return gen_error(path, line_number, "unknown directive");
+      }
+      continue;
+    }
+    if (!gen_parse_rule(path, line_number, p, spec)) {
+      return false;
+    }
+  }
+  if (spec->rules.count == 0) {
+    return gen_error(path, line_number, "no rules");
+  }
+  return true;
+}
+
+static void gen_emit_byte(FILE *out, unsigned c) {
+  if (isalnum((int)c) || c == '_') {
+    fprintf(out, "case '%c':", (char)c);
+  } else {
+    fprintf(out, "case 0x%02X:", c);
+  }
+}
+
+// One labelled block per DFA state, remembering the last accepting state.
+// Like the runtime DFA, a token is at least one byte long: a pattern that
+// matches the empty string does not accept before a transition.
+static void gen_emit_states(FILE *out, const lexer_dfa_t *dfa) {
+  fprintf(out, "  goto s%u;\n", LEXER_DFA_START);
+  for (uint32_t state = LEXER_DFA_START; state < dfa->state_count; ++state) {
+    fprintf(out, "s%u:\n", state);
+    uint32_t accept = dfa->accept_offsets[state];
+    if (accept != dfa->accept_offsets[state + 1]) {
+      if (state == LEXER_DFA_START) {
+        fprintf(out, "  if (p != start) {\n    last = p;\n    rule = %u;\n"
+                     "  }\n",
+                dfa->accepts[accept]);
+      } else {
+        fprintf(out, "  last = p;\n  rule = %u;\n", dfa->accepts[accept]);
+      }
+    }
+
+    const uint32_t *row = dfa->transitions + state * dfa->class_count;
+    bool has_edges = false;
+    for (uint32_t k = 0; k < dfa->class_count; ++k) {
+      has_edges |= row[k] != LEXER_DFA_DEAD;
+    }
+    if (!has_edges) {
+      fprintf(out, "  goto done;\n");
+      continue;
+    }
+
+    fprintf(out, "  if (p == end) {\n    goto done;\n  }\n");
+    fprintf(out, "  switch (*p++) {\n");
+    // Group the bytes by target state
+    bool emitted[256] = {false};
+    for (unsigned c = 0; c < 256; ++c) {
+      uint32_t target = row[dfa->classes[c]];
+      if (emitted[c] || target == LEXER_DFA_DEAD) {
+        continue;
+      }
+      size_t column = 0;
+      fprintf(out, "  ");
+      for (unsigned d = c; d < 256; ++d) {
+        if (!emitted[d] && row[dfa->classes[d]] == target) {
+          emitted[d] = true;
+          if (column == 6) {
+            fprintf(out, "\n  ");
+            column = 0;
+          } else if (column > 0) {
+            fprintf(out, " ");
+          }
+          gen_emit_byte(out, d);
+          column++;
+        }
+      }
+      fprintf(out, "\n    goto s%u;\n", target);
+    }
+    fprintf(out, "  default:\n    goto done;\n  }\n");
+  }
+}
+
+static void gen_emit_first_set(FILE *out, const lexer_dfa_t *dfa) {
+  lexer_charset_t first;
+  lexer_charset_clear(&first);
+  const uint32_t *row = dfa->transitions + LEXER_DFA_START * dfa->class_count;
+  for (unsigned c = 0; c < 256; ++c) {
+    if (row[dfa->classes[c]] != LEXER_DFA_DEAD) {
+      lexer_charset_add(&first, (unsigned char)c);
+    }
+  }
+  fprintf(out, "  static const lexer_charset_t first = {{\n");
+  for (size_t i = 0; i < 4; ++i) {
+    fprintf(out, "      0x%016llXull,\n", (unsigned long long)first.bits[i]);
+  }
+  fprintf(out, "  }};\n");
+}
+
+static void gen_emit(FILE *out, const char *path, const gen_spec_t *spec,
+                     const lexer_dfa_t *dfa) {
+  const char *prefix = spec->prefix ? spec->prefix : "scanner";
+
+  fprintf(out, "// Generated by plextrum_gen from %s, do not edit.\n\n", path);
+  fprintf(out, "#include \"plextrum.h\"\n");
+  for (size_t i = 0; i < spec->includes.count; ++i) {
+    fprintf(out, "#include %s\n", spec->includes.items[i]);
+  }
+  fprintf(out, "\n");
+
+  for (size_t i = 0; i < spec->rules.count; ++i) {
+    if (spec->rules.items[i].action != NULL) {
+      fprintf(out, "void %s(lexer_t *lexer, token_t *token);\n",
+              spec->rules.items[i].action);
+    }
+  }
+
+  // Matcher
+  fprintf(out, "\n// Matches the longest token of any rule (earliest rule on "
+               "ties)\n");
+  fprintf(out, "bool %s_match(lexer_t *lexer, token_t *token) {\n", prefix);
+  fprintf(out, "  const unsigned char *start =\n"
+               "      (const unsigned char *)lexer->source + "
+               "lexer->position;\n"
+               "  const unsigned char *end =\n"
+               "      (const unsigned char *)lexer->source + "
+               "lexer->source_length;\n"
+               "  const unsigned char *p = start;\n"
+               "  const unsigned char *last = NULL;\n"
+               "  int rule = -1;\n\n");
+  gen_emit_states(out, dfa);
+  fprintf(out, "done:\n"
+               "  if (rule < 0) {\n"
+               "    return false;\n"
+               "  }\n"
+               "  lexer_advance_n(lexer, (size_t)(last - start));\n"
+               "  token->length = (size_t)(last - start);\n"
+               "  switch (rule) {\n");
+  for (size_t i = 0; i < spec->rules.count; ++i) {
+    const gen_rule_t *rule = &spec->rules.items[i];
+    fprintf(out, "  case %zu:\n", i);
+    fprintf(out, "    token->kind = (%s);\n", rule->kind);
+    fprintf(out, "    token->flags = %s;\n",
+            rule->ignore ? "TOKEN_FLAG_IGNORE" : "TOKEN_FLAG_NONE");
+    if (rule->action != NULL) {
+      fprintf(out, "    %s(lexer, token);\n", rule->action);
+    }
+    fprintf(out, "    break;\n");
+  }
+  fprintf(out, "  }\n  return true;\n}\n\n");
+
+  // Registration as a single rule
+  fprintf(out, "// Registers the whole scanner as one rule\n");
+  fprintf(out, "bool %s_install(lexer_t *lexer) {\n", prefix);
+  gen_emit_first_set(out, dfa);
+  fprintf(out,
+          "  return lexer_add_rule_ex(lexer, %s_match, NULL, &first);\n}\n\n",
+          prefix);
+
+  // Replacement for lexer_next_token
+  fprintf(out,
+          "// Same contract as lexer_next_token, without the rule list\n"
+          "token_t %s_next_token(lexer_t *lexer) {\n"
+          "  token_t token = {0};\n"
+          "  while (!lexer_is_eof(lexer)) {\n"
+          "    token.lexeme = lexer->source + lexer->position;\n"
+          "    token.line = lexer->line;\n"
+          "    token.column = lexer->column;\n"
+          "    token.filename = lexer->filename;\n"
+          "    token.source = lexer->source_id;\n"
+          "    if (!%s_match(lexer, &token)) {\n"
+          "      token_t error = create_token(\n"
+          "          INTERNAL_TOKEN_ERROR, lexer->source + lexer->position, 1,\n"
+          "          lexer->line, lexer->column, lexer->filename, 0);\n"
+          "      error.source = lexer->source_id;\n"
+          "      lexer_advance(lexer);\n"
+          "      return error;\n"
+          "    }\n"
+          "    if (token.flags & TOKEN_FLAG_IGNORE &&\n"
+          "        !(lexer->flags & LEXER_FLAG_KEEP_IGNORABLE)) {\n"
+          "      continue;\n"
+          "    }\n"
+          "    return token;\n"
+          "  }\n"
+          "  token = create_token(INTERNAL_TOKEN_EOF, \"EOF\", 0,\n"
+          "                       lexer ? lexer->line : 0,\n"
+          "                       lexer ? lexer->column : 0,\n"
+          "                       lexer ? lexer->filename : 0, 0);\n"
+          "  token.source = lexer ? lexer->source_id : 0;\n"
+          "  return token;\n"
+          "}\n",
+          prefix, prefix);
+}
+
+static void gen_free_spec(gen_spec_t *spec) {
+  for (size_t i = 0; i < spec->rules.count; ++i) {
+    free(spec->rules.items[i].kind);
+    free(spec->rules.items[i].pattern);
+    free(spec->rules.items[i].action);
+  }
+  da_free(spec->rules);
+  for (size_t i = 0; i < spec->includes.count; ++i) {
+    free(spec->includes.items[i]);
+  }
+  da_free(spec->includes);
+  free(spec->prefix);
+}
+
+int main(int argc, char **argv) {
+  const char *input = NULL;
+  const char *output = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (input == NULL) {
+      input = argv[i];
+    } else {
+      input = NULL;
+      break;
+    }
+  }
+  if (input == NULL) {
+    fprintf(stderr, "Usage: %s rules.lex [-o scanner.c]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(input, "r");
+  if (file == NULL) {
+    perror(input);
+    return 1;
+  }
+  gen_spec_t spec = {0};
+  bool parsed = gen_parse_spec(input, file, &spec);
+  fclose(file);
+  if (!parsed) {
+    gen_free_spec(&spec);
+    return 1;
+  }
+
+  // Compile every pattern into the library's DFA, regex i being rule i
+  lexer_t *lexer = lexer_create("", 0, input, 0);
+  ASSERT(lexer != NULL && "No more memory");
+  for (size_t i = 0; i < spec.rules.count; ++i) {
+    const gen_rule_t *rule = &spec.rules.items[i];
+    if (!lexer_add_regex_rule(lexer, rule->pattern, (uint32_t)i, NULL)) {
+      gen_error(input, rule->line, "invalid pattern");
+      lexer_destroy(lexer);
+      gen_free_spec(&spec);
+      return 1;
+    }
+  }
+  lexer_build_dispatch(lexer, LEXER_MODE_DEFAULT);
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if (out == NULL) {
+    perror(output);
+    lexer_destroy(lexer);
+    gen_free_spec(&spec);
+    return 1;
+  }
+  gen_emit(out, input, &spec,
+           &lexer->modes.items[LEXER_MODE_DEFAULT].dispatch.dfa);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  lexer_destroy(lexer);
+  gen_free_spec(&spec);
+  return 0;
+}
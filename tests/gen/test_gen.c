@@ -0,0 +1,95 @@
+// Round trip of plextrum_gen: the scanner generated from gen/rules.lex, used
+// through gen_next_token and through gen_install, produces the same tokens as
+// a runtime lexer with the same regex rules in longest-match mode. A pattern
+// that matches the empty string (TOK_AT) only produces non-empty tokens.
+
+#define LEXER_IMPL
+#include "test.h"
+#include "tokens.h"
+
+bool gen_install(lexer_t *lexer);
+token_t gen_next_token(lexer_t *lexer);
+
+static int number_calls = 0;
+
+void on_number(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  (void)token;
+  number_calls++;
+}
+
+// Same rules as gen/rules.lex
+static lexer_t *runtime_lexer(const char *source) {
+  lexer_t *lexer = lexer_create(source, 0, "gen", LEXER_FLAG_LONGEST_MATCH);
+  lexer_add_regex_rule(lexer, "if|else|while|return", TOK_KEYWORD, NULL);
+  lexer_add_regex_rule(lexer, "[A-Za-z_]\\w*", TOK_IDENT, NULL);
+  lexer_add_regex_rule(lexer, "[0-9]+(\\.[0-9]+)?([eE][+-]?[0-9]+)?",
+                       TOK_NUMBER, on_number);
+  lexer_add_regex_rule(lexer, "\"([^\"\\\\\\n]|\\\\.)*\"", TOK_STRING, NULL);
+  lexer_add_regex_rule(lexer, "<<=|<<|<=|<|\\+\\+|\\+=|\\+|->|-|\\/|\\*|=",
+                       TOK_OP, NULL);
+  lexer_add_regex_rule(lexer, "#[^\\n]*", TOK_COMMENT, lexer_action_ignore);
+  lexer_add_regex_rule(lexer, "\\s+", TOK_SPACE, lexer_action_ignore);
+  lexer_add_regex_rule(lexer, "@*", TOK_AT, NULL);
+  return lexer;
+}
+
+static bool same_token(token_t a, token_t b) {
+  return a.kind == b.kind && a.length == b.length &&
+         (a.kind == INTERNAL_TOKEN_EOF || a.lexeme == b.lexeme) &&
+         a.line == b.line && a.column == b.column && a.flags == b.flags &&
+         a.source == b.source;
+}
+
+static void test_round_trip(const char *source) {
+  lexer_t *reference = runtime_lexer(source);
+  lexer_t *generated = lexer_create(source, 0, "gen", 0);
+  lexer_t *installed = lexer_create(source, 0, "gen", 0);
+  CHECK(gen_install(installed));
+
+  for (size_t i = 0;; ++i) {
+    // Actions run once per token, whichever way the scanner is used
+    number_calls = 0;
+    token_t expected = lexer_next_token(reference);
+    const int expected_calls = number_calls;
+    number_calls = 0;
+    token_t direct = gen_next_token(generated);
+    CHECK(number_calls == expected_calls);
+    number_calls = 0;
+    token_t rule = lexer_next_token(installed);
+    CHECK(number_calls == expected_calls);
+    if (!same_token(expected, direct) || !same_token(expected, rule)) {
+      fprintf(stderr, "token %zu: expected %u '%.*s', got %u '%.*s' / %u\n",
+              i, expected.kind, (int)expected.length, expected.lexeme,
+              direct.kind, (int)direct.length, direct.lexeme, rule.kind);
+      test_failures++;
+      break;
+    }
+    if (expected.kind == INTERNAL_TOKEN_EOF) {
+      break;
+    }
+  }
+
+  lexer_destroy(reference);
+  lexer_destroy(generated);
+  lexer_destroy(installed);
+}
+
+int main(void) {
+  test_round_trip("");
+  test_round_trip("@");
+  test_round_trip("$@@ x@$");
+  test_round_trip("while x1 <<= 2.5e-3 # done\n  return \"a\\\"b\" -> y;");
+  static const char *words[] = {
+      "if",   "iffy", "else", "_x9",  "42",   "3.14", "1e10", "7.",  "\"s\"",
+      "\"\\n\"", "\"open", "<<=", "<<",  "<",    "++",   "+=",  "+",
+      "->",   "-",    "/",    "*",    "=",    " ",    "\t",   "\n",  "# c\n",
+      "$",    "@"};
+  static char source[1 << 14];
+  for (int round = 0; round < 8; ++round) {
+    test_random_text(source, sizeof(source), words,
+                     sizeof(words) / sizeof(words[0]));
+    test_round_trip(source);
+  }
+  return test_report();
+}
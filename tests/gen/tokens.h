@@ -0,0 +1,17 @@
+// Token kinds of gen/rules.lex
+
+#ifndef PLEXTRUM_TEST_GEN_TOKENS_H
+#define PLEXTRUM_TEST_GEN_TOKENS_H
+
+enum {
+  TOK_KEYWORD = 2,
+  TOK_IDENT,
+  TOK_NUMBER,
+  TOK_STRING,
+  TOK_OP,
+  TOK_COMMENT,
+  TOK_SPACE,
+  TOK_AT,
+};
+
+#endif // PLEXTRUM_TEST_GEN_TOKENS_H
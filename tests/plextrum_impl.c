@@ -0,0 +1,5 @@
+// Implementation of plextrum.h for the C++ tests, which include plextrum.hpp
+// and link against this file compiled as C
+
+#define LEXER_IMPL
+#include "plextrum.h"
@@ -0,0 +1,80 @@
+/**
+ * test.h
+ * Copyright (C) 2024 Paul Passeron
+ * pLEXtrum test helpers
+ * Paul Passeron <paul.passeron2@gmail.com>
+ */
+
+// Every test is a standalone program that includes plextrum.h (with
+// LEXER_IMPL defined) then this file, runs its checks and returns
+// test_report().
+
+#ifndef PLEXTRUM_TEST_H
+#define PLEXTRUM_TEST_H
+
+#include "plextrum.h"
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+// Checks the next token's kind and lexeme
+#define CHECK_TOKEN(lexer, expected_kind, expected_lexeme)                     \
+  do {                                                                         \
+    token_t check_token_ = lexer_next_token(lexer);                            \
+    const char *check_lexeme_ = (expected_lexeme);                             \
+    if (check_token_.kind != (uint32_t)(expected_kind) ||                      \
+        check_token_.length != strlen(check_lexeme_) ||                        \
+        memcmp(check_token_.lexeme, check_lexeme_, check_token_.length)) {     \
+      fprintf(stderr, "%s:%d: expected %u '%s', got %u '%.*s'\n", __FILE__,   \
+              __LINE__, (unsigned)(expected_kind), check_lexeme_,              \
+              check_token_.kind, (int)check_token_.length,                     \
+              check_token_.lexeme);                                            \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EOF(lexer)                                                       \
+  CHECK(lexer_next_token(lexer).kind == INTERNAL_TOKEN_EOF)
+
+static inline int test_report(void) {
+  if (test_failures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", test_failures);
+    return 1;
+  }
+  return 0;
+}
+
+// Deterministic pseudo-random numbers (xorshift), for generated inputs
+static inline uint32_t test_random(void) {
+  static uint32_t state = 2463534242u;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Fills `out` (of size `size`, NUL-terminated) with random picks from `words`
+static inline size_t test_random_text(char *out, size_t size,
+                                      const char **words, size_t count) {
+  size_t length = 0;
+  for (;;) {
+    const char *word = words[test_random() % count];
+    size_t word_length = strlen(word);
+    if (length + word_length + 1 > size) {
+      break;
+    }
+    memcpy(out + length, word, word_length);
+    length += word_length;
+  }
+  out[length] = '\0';
+  return length;
+}
+
+#endif // PLEXTRUM_TEST_H
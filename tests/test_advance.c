@@ -0,0 +1,84 @@
+// Bulk advance: lexer_advance_n stops at the end of the input,
+// lexer_advance_to ignores pointers outside [position, end], and both update
+// the location like the same number of lexer_advance calls. Long random runs
+// are covered by test_simd in every SIMD build.
+
+#define LEXER_IMPL
+#include "test.h"
+
+static void check_location(const lexer_t *lexer, size_t position, size_t line,
+                           size_t column) {
+  CHECK(lexer_get_position(lexer) == position);
+  CHECK(lexer_get_line(lexer) == line);
+  CHECK(lexer_get_column(lexer) == column);
+}
+
+static void test_bounds(void) {
+  const char *source = "ab\ncd\n\nefgh";
+  lexer_t *lexer = lexer_create(source, 0, "advance", 0);
+  lexer_advance_n(lexer, 4);
+  check_location(lexer, 4, 2, 2);
+  lexer_advance_n(lexer, 0);
+  check_location(lexer, 4, 2, 2);
+  // Backwards and past the end: ignored
+  lexer_advance_to(lexer, source + 1);
+  check_location(lexer, 4, 2, 2);
+  lexer_advance_to(lexer, source + 12);
+  check_location(lexer, 4, 2, 2);
+  lexer_advance_to(lexer, NULL);
+  check_location(lexer, 4, 2, 2);
+  lexer_advance_to(lexer, source + 7);
+  check_location(lexer, 7, 4, 1);
+  // The end itself is reachable, and advance_n stops there
+  lexer_advance_n(lexer, 100);
+  check_location(lexer, 11, 4, 5);
+  CHECK(lexer_is_eof(lexer));
+  lexer_advance_n(lexer, 1);
+  check_location(lexer, 11, 4, 5);
+  lexer_destroy(lexer);
+
+  lexer = lexer_create(source, 0, "advance", 0);
+  lexer_advance_to(lexer, source + 11);
+  check_location(lexer, 11, 4, 5);
+  lexer_destroy(lexer);
+}
+
+// Same location as one lexer_advance per byte
+static void test_same_as_advance(void) {
+  const char *source = "\xc3\xa9t\xc3\xa9\n\n  x\xe2\x82\xac\ny";
+  size_t length = strlen(source);
+  for (int utf8 = 0; utf8 < 2; ++utf8) {
+    uint32_t flags = utf8 ? LEXER_FLAG_UTF8_COLUMNS : 0;
+    for (size_t step = 1; step <= length; ++step) {
+      lexer_t *bulk = lexer_create(source, 0, "bulk", flags);
+      lexer_t *single = lexer_create(source, 0, "single", flags);
+      while (!lexer_is_eof(bulk)) {
+        lexer_advance_n(bulk, step);
+        while (lexer_get_position(single) < lexer_get_position(bulk)) {
+          lexer_advance(single);
+        }
+        check_location(bulk, lexer_get_position(single),
+                       lexer_get_line(single), lexer_get_column(single));
+      }
+      lexer_destroy(bulk);
+      lexer_destroy(single);
+    }
+  }
+}
+
+// With lazy locations only the position moves
+static void test_lazy(void) {
+  const char *source = "a\nbc";
+  lexer_t *lexer = lexer_create(source, 0, "lazy", LEXER_FLAG_LAZY_LOCATION);
+  lexer_advance_n(lexer, 3);
+  CHECK(lexer->line == 0 && lexer->column == 0);
+  check_location(lexer, 3, 2, 2);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_bounds();
+  test_same_as_advance();
+  test_lazy();
+  return test_report();
+}
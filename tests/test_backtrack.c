@@ -0,0 +1,189 @@
+// Marks and rewinds: rewinding inside the lookahead ring replays the tokens
+// kept there without running actions again, while older marks restore the
+// position, location and modes and lex the tokens again. The token buffer
+// cursor is covered by test_tokenize.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_WORD = 2, TOK_TAG, TOK_LT, TOK_GT, TOK_SPACE };
+
+static int action_calls = 0;
+
+static void count_action(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  (void)token;
+  action_calls++;
+}
+
+static void push_tag(lexer_t *lexer, token_t *token) {
+  (void)token;
+  action_calls++;
+  CHECK(lexer_push_mode(lexer, (uint32_t)lexer_find_mode(lexer, "tag")));
+}
+
+static void pop_tag(lexer_t *lexer, token_t *token) {
+  (void)token;
+  action_calls++;
+  CHECK(lexer_pop_mode(lexer));
+}
+
+// Words in the default mode, tags between < and > (which nest)
+static lexer_t *backtrack_lexer(const char *source) {
+  lexer_t *lexer = lexer_create(source, 0, "backtrack", 0);
+  int32_t tag = lexer_define_mode(lexer, "tag");
+  uint32_t both = 1u << LEXER_MODE_DEFAULT | 1u << tag;
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_set_rule_modes(lexer, 0, both));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, count_action));
+  CHECK(lexer_add_regex_rule(lexer, "<", TOK_LT, push_tag));
+  CHECK(lexer_set_rule_modes(lexer, 2, both));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_TAG, count_action));
+  CHECK(lexer_set_rule_modes(lexer, 3, 1u << tag));
+  CHECK(lexer_add_regex_rule(lexer, ">", TOK_GT, pop_tag));
+  CHECK(lexer_set_rule_modes(lexer, 4, 1u << tag));
+  return lexer;
+}
+
+static void check_token(lexer_t *lexer, uint32_t kind, const char *lexeme,
+                        size_t line, size_t column) {
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == kind && token.length == strlen(lexeme) &&
+        memcmp(token.lexeme, lexeme, token.length) == 0);
+  CHECK(token.line == line && token.column == column);
+}
+
+static void test_ring(void) {
+  action_calls = 0;
+  lexer_t *lexer = backtrack_lexer("a b\nc d");
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK(lexer_peek_token(lexer, 2) != NULL);
+  CHECK(action_calls == 4);
+  lexer_mark_t mark = lexer_mark(lexer);
+  // The mark is the state before the next token, not the current one
+  CHECK(mark.position == 1 && mark.line == 1 && mark.column == 2);
+  for (int i = 0; i < 2; ++i) {
+    check_token(lexer, TOK_WORD, "b", 1, 3);
+    check_token(lexer, TOK_WORD, "c", 2, 1);
+    check_token(lexer, TOK_WORD, "d", 2, 3);
+    lexer_rewind(lexer, mark);
+  }
+  CHECK(action_calls == 4);
+
+  // A mark at the end of the ring keeps it for older marks
+  CHECK_TOKEN(lexer, TOK_WORD, "b");
+  CHECK_TOKEN(lexer, TOK_WORD, "c");
+  CHECK_TOKEN(lexer, TOK_WORD, "d");
+  lexer_mark_t end = lexer_mark(lexer);
+  lexer_rewind(lexer, end);
+  lexer_rewind(lexer, mark);
+  CHECK_TOKEN(lexer, TOK_WORD, "b");
+  CHECK(action_calls == 4);
+  lexer_destroy(lexer);
+}
+
+static void test_replay(void) {
+  action_calls = 0;
+  lexer_t *lexer = backtrack_lexer("a\n  b c\n d");
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  lexer_mark_t mark = lexer_mark(lexer);
+  // Nothing peeked: the tokens are lexed again
+  for (int i = 0; i < 2; ++i) {
+    check_token(lexer, TOK_WORD, "b", 2, 3);
+    check_token(lexer, TOK_WORD, "c", 2, 5);
+    check_token(lexer, TOK_WORD, "d", 3, 2);
+    CHECK_EOF(lexer);
+    lexer_rewind(lexer, mark);
+    CHECK(lexer_get_position(lexer) == 1);
+  }
+  CHECK(action_calls == 7);
+
+  // Older than the ring: the whole window was consumed past the mark
+  lexer_t *words = backtrack_lexer("a b c d e f g h i j k");
+  mark = lexer_mark(words);
+  CHECK(lexer_peek_token(words, LEXER_LOOKAHEAD_MAX - 1) != NULL);
+  for (int i = 0; i < 10; ++i) {
+    CHECK(lexer_next_token(words).kind == TOK_WORD);
+  }
+  lexer_rewind(words, mark);
+  check_token(words, TOK_WORD, "a", 1, 1);
+  check_token(words, TOK_WORD, "b", 1, 3);
+  lexer_destroy(words);
+  lexer_destroy(lexer);
+}
+
+// The mode and the mode stack come back with the mark, whether the tokens are
+// replayed from the ring or lexed again
+static void test_modes(void) {
+  for (int peek = 0; peek < 2; ++peek) {
+    action_calls = 0;
+    lexer_t *lexer = backtrack_lexer("x <a <b> c> y");
+    CHECK_TOKEN(lexer, TOK_WORD, "x");
+    CHECK_TOKEN(lexer, TOK_LT, "<");
+    CHECK_TOKEN(lexer, TOK_TAG, "a");
+    lexer_mark_t mark = lexer_mark(lexer);
+    CHECK(mark.mode == 1 && mark.mode_depth == 1 && mark.mode_stack[0] == 0);
+    if (peek) {
+      CHECK(lexer_peek_token(lexer, 5) != NULL);
+    }
+    int calls = action_calls;
+    for (int i = 0; i < 2; ++i) {
+      CHECK_TOKEN(lexer, TOK_LT, "<");
+      CHECK_TOKEN(lexer, TOK_TAG, "b");
+      CHECK_TOKEN(lexer, TOK_GT, ">");
+      CHECK_TOKEN(lexer, TOK_TAG, "c");
+      CHECK_TOKEN(lexer, TOK_GT, ">");
+      CHECK_TOKEN(lexer, TOK_WORD, "y");
+      CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+      lexer_rewind(lexer, mark);
+      if (!peek) {
+        CHECK(lexer_get_mode(lexer) == 1);
+      }
+    }
+    CHECK(action_calls == calls + (peek ? 0 : 12));
+    // The restored stack unwinds like the original one
+    for (int i = 0; i < 6; ++i) {
+      lexer_next_token(lexer);
+    }
+    CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+    CHECK(!lexer_pop_mode(lexer));
+    CHECK_EOF(lexer);
+    lexer_destroy(lexer);
+  }
+}
+
+// A speculative parse: try `word word`, fall back to `word <tag>`
+static void test_speculation(void) {
+  lexer_t *lexer = backtrack_lexer("a <b> c d");
+  size_t pairs = 0;
+  size_t tagged = 0;
+  for (;;) {
+    lexer_mark_t mark = lexer_mark(lexer);
+    token_t first = lexer_next_token(lexer);
+    if (first.kind == INTERNAL_TOKEN_EOF) {
+      break;
+    }
+    CHECK(first.kind == TOK_WORD);
+    if (lexer_next_token(lexer).kind == TOK_WORD) {
+      pairs++;
+      continue;
+    }
+    lexer_rewind(lexer, mark);
+    CHECK(lexer_next_token(lexer).kind == TOK_WORD);
+    CHECK_TOKEN(lexer, TOK_LT, "<");
+    CHECK_TOKEN(lexer, TOK_TAG, "b");
+    CHECK_TOKEN(lexer, TOK_GT, ">");
+    tagged++;
+  }
+  CHECK(pairs == 1 && tagged == 1);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_ring();
+  test_replay();
+  test_modes();
+  test_speculation();
+  return test_report();
+}
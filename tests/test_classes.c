@@ -0,0 +1,106 @@
+// Character classes: the built-in table, classes defined per lexer, their use
+// in regex rules and `first` sets, and built-in classes staying fixed.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_MATCH = 2 };
+
+static bool in_range(int c, int low, int high) {
+  return c >= low && c <= high;
+}
+
+static void test_builtin_table(void) {
+  for (int c = 0; c < 256; ++c) {
+    bool digit = in_range(c, '0', '9');
+    bool upper = in_range(c, 'A', 'Z');
+    bool lower = in_range(c, 'a', 'z');
+    bool alpha = upper || lower || c == '_';
+    bool space = c == ' ' || c == '\n' || c == '\t' || c == '\b' ||
+                 c == '\r' || c == '\v';
+    bool xdigit = digit || in_range(c, 'a', 'f') || in_range(c, 'A', 'F');
+    CHECK(lexer_is_digit((char)c) == digit);
+    CHECK(lexer_is_alpha((char)c) == alpha);
+    CHECK(lexer_is_alnum((char)c) == (alpha || digit));
+    CHECK(lexer_is_space((char)c) == space);
+    uint32_t expected = (uint32_t)digit << LEXER_CLASS_DIGIT |
+                        (uint32_t)alpha << LEXER_CLASS_ALPHA |
+                        (uint32_t)(alpha || digit) << LEXER_CLASS_ALNUM |
+                        (uint32_t)space << LEXER_CLASS_SPACE |
+                        (uint32_t)xdigit << LEXER_CLASS_XDIGIT |
+                        (uint32_t)upper << LEXER_CLASS_UPPER |
+                        (uint32_t)lower << LEXER_CLASS_LOWER;
+    CHECK(lexer_class_table[c] == expected);
+  }
+}
+
+static void test_user_classes(void) {
+  lexer_t *lexer = lexer_create("", 0, "classes", 0);
+  CHECK(lexer_find_class(lexer, "xdigit") == LEXER_CLASS_XDIGIT);
+  CHECK(lexer_find_class(lexer, "sign") == -1);
+
+  int32_t sign = lexer_define_class(lexer, "sign", "+-");
+  CHECK(sign == LEXER_CLASS_BUILTIN_COUNT);
+  CHECK(lexer_find_class(lexer, "sign") == sign);
+  CHECK(lexer_in_class(lexer, '+', (uint32_t)sign));
+  CHECK(!lexer_in_class(lexer, '*', (uint32_t)sign));
+  // Defining an existing class extends it
+  CHECK(lexer_define_class(lexer, "sign", "~") == sign);
+  CHECK(lexer_in_class(lexer, '~', (uint32_t)sign));
+  CHECK(lexer_in_class(lexer, '-', (uint32_t)sign));
+
+  lexer_charset_t set;
+  lexer_charset_clear(&set);
+  lexer_charset_add_class(&set, lexer, (uint32_t)sign);
+  for (int c = 0; c < 256; ++c) {
+    CHECK(lexer_charset_has(&set, (unsigned char)c) ==
+          (c == '+' || c == '-' || c == '~'));
+  }
+
+  // Class ids are bits of a 32-bit mask
+  char name[32];
+  for (int i = LEXER_CLASS_BUILTIN_COUNT + 1; i < LEXER_CLASS_MAX; ++i) {
+    snprintf(name, sizeof(name), "class%d", i);
+    CHECK(lexer_define_class(lexer, name, "x") == i);
+  }
+  CHECK(lexer_define_class(lexer, "one_too_many", "x") == -1);
+  CHECK(lexer_define_class(lexer, "", "x") == -1);
+  lexer_destroy(lexer);
+}
+
+static void test_regex_classes(void) {
+  lexer_t *lexer = lexer_create("+~-1 +x", 0, "classes", 0);
+  CHECK(lexer_define_class(lexer, "sign", "+-~") >= 0);
+  CHECK(lexer_add_regex_rule(lexer, "[[:sign:]]+[[:digit:]]?", TOK_MATCH,
+                             NULL));
+  CHECK(!lexer_add_regex_rule(lexer, "[[:unknown:]]", TOK_MATCH, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, 3, lexer_action_ignore));
+  CHECK_TOKEN(lexer, TOK_MATCH, "+~-1");
+  CHECK_TOKEN(lexer, TOK_MATCH, "+");
+  CHECK_TOKEN(lexer, INTERNAL_TOKEN_ERROR, "x");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Built-in classes are shared with the lexer_is_* helpers, the built-in rules
+// and the regex escapes, so they cannot be changed
+static void test_builtin_redefinition(void) {
+  lexer_t *lexer = lexer_create("a$b", 0, "classes", 0);
+  CHECK(lexer_define_class(lexer, "alpha", "$") == -1);
+  CHECK(lexer_define_class(lexer, "digit", "x") == -1);
+  CHECK(!lexer_in_class(lexer, '$', LEXER_CLASS_ALPHA));
+  CHECK(!lexer_is_alpha('$'));
+  CHECK(lexer_add_regex_rule(lexer, "[[:alpha:]]+", TOK_MATCH, NULL));
+  CHECK_TOKEN(lexer, TOK_MATCH, "a");
+  CHECK_TOKEN(lexer, INTERNAL_TOKEN_ERROR, "$");
+  CHECK_TOKEN(lexer, TOK_MATCH, "b");
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_builtin_table();
+  test_user_classes();
+  test_regex_classes();
+  test_builtin_redefinition();
+  return test_report();
+}
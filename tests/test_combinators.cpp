@@ -0,0 +1,184 @@
+// Compile-time matcher combinators: PEG semantics of each combinator, first
+// sets, and basic_lexer against the equivalent runtime lexer (first and
+// longest match, byte and code point columns, lazy locations, install).
+
+#include "test.h"
+
+#include "plextrum.hpp"
+
+using namespace plextrum;
+
+enum {
+  TOK_ARROW = 2,
+  TOK_MINUS,
+  TOK_IDENT,
+  TOK_NUMBER,
+  TOK_SPACE,
+  TOK_WORD,
+  TOK_OTHER,
+};
+
+using ident_start =
+    char_class<range<'a', 'z'>, range<'A', 'Z'>, one_of<'_'>>;
+using digit = char_class<range<'0', '9'>>;
+using rules_arrow = rule<TOK_ARROW, literal<'-', '>'>>;
+using rules_minus = rule<TOK_MINUS, literal<'-'>>;
+using rules_ident =
+    rule<TOK_IDENT, seq<ident_start, star<alt<ident_start, digit>>>>;
+using rules_number = rule<TOK_NUMBER, plus<digit>>;
+using rules_space = rule<TOK_SPACE, plus<char_class<one_of<' ', '\t', '\n'>>>,
+                         TOKEN_FLAG_IGNORE>;
+// Multi-byte sequences, to tell byte and code point columns apart
+using rules_word = rule<TOK_WORD, plus<not_class<range<'\0', '\x7f'>>>>;
+
+template <std::uint32_t Flags>
+using test_lexer = basic_lexer<Flags, rules_arrow, rules_minus, rules_ident,
+                               rules_number, rules_space, rules_word>;
+
+// Whether M matches exactly the first `length` bytes of `text` (-1: fails)
+template <typename M> static bool matches(const char *text, int length) {
+  const char *end = text + std::strlen(text);
+  const char *stop = M::match(text, end);
+  return length < 0 ? stop == nullptr : stop == text + length;
+}
+
+static void test_combinators(void) {
+  using a = literal<'a'>;
+  using b = literal<'b'>;
+  CHECK((matches<literal<'a', 'b'>>("abc", 2)));
+  CHECK((matches<literal<'a', 'b'>>("a", -1)));
+  CHECK((matches<seq<a, b>>("abab", 2)));
+  CHECK((matches<seq<a, b>>("aa", -1)));
+  // Ordered choice: the first alternative wins even if a later one is longer
+  CHECK((matches<alt<a, literal<'a', 'b'>>>("ab", 1)));
+  CHECK((matches<alt<b, a>>("a", 1)));
+  CHECK((matches<star<a>>("aaab", 3)));
+  CHECK((matches<star<a>>("b", 0)));
+  CHECK((matches<plus<a>>("b", -1)));
+  CHECK((matches<opt<a>>("b", 0)));
+  // Repetitions are greedy and never give back input
+  CHECK((matches<seq<star<a>, a>>("aaa", -1)));
+  // A repetition of a nullable matcher stops instead of looping
+  CHECK((matches<star<opt<a>>>("aab", 2)));
+  CHECK((matches<not_class<one_of<'a'>>>("b", 1)));
+  CHECK((matches<not_class<one_of<'a'>>>("a", -1)));
+  CHECK((matches<any_byte>("\xff", 1)));
+  CHECK((matches<any_byte>("", -1)));
+
+  static_assert(!seq<a, b>::nullable && seq<opt<a>, star<b>>::nullable, "");
+  static_assert(alt<a, opt<b>>::nullable && !plus<a>::nullable, "");
+  // The first set of a sequence goes through its nullable prefix
+  static_assert(seq<opt<a>, b>::first().has('a') &&
+                    seq<opt<a>, b>::first().has('b') &&
+                    !seq<a, b>::first().has('b'),
+                "");
+  static_assert(alt<a, b>::first().has('b') && !alt<a, b>::first().has('c'),
+                "");
+  static_assert(test_lexer<0>::first().has('_') &&
+                    !test_lexer<0>::first().has('+'),
+                "");
+}
+
+// The runtime equivalent of test_lexer
+static lexer_t *runtime_lexer(const char *source, uint32_t flags) {
+  lexer_t *lexer = lexer_create(source, 0, "runtime", flags);
+  CHECK(lexer_add_regex_rule(lexer, "->", TOK_ARROW, nullptr));
+  CHECK(lexer_add_regex_rule(lexer, "-", TOK_MINUS, nullptr));
+  CHECK(lexer_add_regex_rule(lexer, "[a-zA-Z_][a-zA-Z_0-9]*", TOK_IDENT,
+                             nullptr));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, nullptr));
+  CHECK(lexer_add_regex_rule(lexer, "[ \t\n]+", TOK_SPACE,
+                             lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[\\x80-\\xff]+", TOK_WORD, nullptr));
+  return lexer;
+}
+
+static void random_source(char *source, size_t size) {
+  static const char *const words[] = {
+      "a", "b_", "x1", "_", "0", "42", "-", "->", ">", " ", "\t", "\n",
+      "\xc3\xa9", "\xe2\x82\xac", "+", "a-", "9b",
+  };
+  size_t count = sizeof(words) / sizeof(words[0]);
+  test_random_text(source, 1 + test_random() % size, (const char **)words,
+                   count);
+}
+
+template <std::uint32_t Flags> static void compare_with_runtime(void) {
+  char source[300];
+  for (int round = 0; round < 500; ++round) {
+    random_source(source, sizeof(source));
+    lexer_t *compiled = lexer_create(source, 0, "compiled", Flags);
+    lexer_t *runtime = runtime_lexer(source, Flags);
+    for (;;) {
+      token_t a = test_lexer<Flags>::next_token(compiled);
+      token_t b = lexer_next_token(runtime);
+      bool same = a.kind == b.kind && a.length == b.length &&
+                  a.line == b.line && a.column == b.column &&
+                  a.flags == b.flags &&
+                  (a.kind == INTERNAL_TOKEN_EOF || a.lexeme == b.lexeme);
+      if (!same) {
+        fprintf(stderr,
+                "flags %u, '%s': %u '%.*s' %zu:%zu instead of %u '%.*s' "
+                "%zu:%zu\n",
+                (unsigned)Flags, source, a.kind, (int)a.length, a.lexeme,
+                a.line, a.column, b.kind, (int)b.length, b.lexeme, b.line,
+                b.column);
+        test_failures++;
+        break;
+      }
+      if (a.kind == INTERNAL_TOKEN_EOF) {
+        break;
+      }
+    }
+    lexer_destroy(compiled);
+    lexer_destroy(runtime);
+  }
+}
+
+// Lazy locations leave line and column alone; the newline index gives them
+static void test_lazy_location(void) {
+  const char *source = "ab\n  cd";
+  lexer_t *lexer = lexer_create(source, 0, "lazy", LEXER_FLAG_LAZY_LOCATION);
+  using lazy = test_lexer<LEXER_FLAG_LAZY_LOCATION>;
+  CHECK(lazy::next_token(lexer).kind == TOK_IDENT);
+  token_t token = lazy::next_token(lexer);
+  CHECK(token.kind == TOK_IDENT && token.line == 0 && token.column == 0);
+  size_t line = 0;
+  size_t column = 0;
+  CHECK(lexer_offset_to_location(lexer, (size_t)(token.lexeme - source),
+                                 &line, &column));
+  CHECK(line == 2 && column == 3);
+  lexer_destroy(lexer);
+}
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+// A basic_lexer registered as one rule of a runtime lexer, tried on its first
+// set only
+static void test_install(void) {
+  lexer_t *lexer = lexer_create("a->+1 +", 0, "install", 0);
+  CHECK(test_lexer<0>::install(lexer));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, nullptr, nullptr));
+  CHECK_TOKEN(lexer, TOK_IDENT, "a");
+  CHECK_TOKEN(lexer, TOK_ARROW, "->");
+  CHECK_TOKEN(lexer, TOK_OTHER, "+");
+  CHECK_TOKEN(lexer, TOK_NUMBER, "1");
+  // Ignored by the installed rule's flags
+  CHECK_TOKEN(lexer, TOK_OTHER, "+");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_combinators();
+  compare_with_runtime<LEXER_FLAG_NONE>();
+  compare_with_runtime<LEXER_FLAG_LONGEST_MATCH>();
+  compare_with_runtime<LEXER_FLAG_UTF8_COLUMNS>();
+  compare_with_runtime<LEXER_FLAG_KEEP_IGNORABLE>();
+  test_lazy_location();
+  test_install();
+  return test_report();
+}
@@ -0,0 +1,124 @@
+// Comment rules: line comments up to the newline or the end of the input,
+// block comments with one- and multi-byte delimiters, nesting, and
+// unterminated comments.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_LINE = 2, TOK_BLOCK, TOK_NESTED, TOK_SPACE, TOK_OTHER };
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+static lexer_t *comment_lexer(const char *source) {
+  lexer_t *lexer = lexer_create(source, 0, "comments", 0);
+  CHECK(lexer_add_whitespace_rule(lexer, " \n", TOK_SPACE,
+                                  lexer_action_ignore));
+  return lexer;
+}
+
+static void add_other_rule(lexer_t *lexer) {
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+}
+
+static void test_line_comments(void) {
+  lexer_t *lexer = comment_lexer("// one\nx -- two -- \n# three");
+  CHECK(lexer_add_line_comment_rule(lexer, "//", TOK_LINE, NULL));
+  CHECK(lexer_add_line_comment_rule(lexer, "--", TOK_LINE, NULL));
+  CHECK(lexer_add_line_comment_rule(lexer, "#", TOK_LINE, NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_LINE, "// one");
+  CHECK_TOKEN(lexer, TOK_OTHER, "x");
+  CHECK_TOKEN(lexer, TOK_LINE, "-- two -- ");
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_LINE && token.length == 7 && token.line == 3);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  lexer = comment_lexer("/ /");
+  CHECK(!lexer_add_line_comment_rule(lexer, "", TOK_LINE, NULL));
+  CHECK(lexer_add_line_comment_rule(lexer, "//", TOK_LINE, NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_OTHER, "/");
+  CHECK_TOKEN(lexer, TOK_OTHER, "/");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_block_comments(void) {
+  lexer_t *lexer = comment_lexer("/**/ /*/ */ /* a\n*/ x /* open");
+  CHECK(lexer_add_block_comment_rule(lexer, "/*", "*/", false, TOK_BLOCK,
+                                     NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_BLOCK, "/**/");
+  // The terminator cannot overlap the opening delimiter
+  CHECK_TOKEN(lexer, TOK_BLOCK, "/*/ */");
+  CHECK_TOKEN(lexer, TOK_BLOCK, "/* a\n*/");
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_OTHER && token.line == 2 && token.column == 4);
+  // Unterminated: left to the next rule
+  CHECK_TOKEN(lexer, TOK_OTHER, "/");
+  lexer_destroy(lexer);
+
+  // Without nesting, the first terminator ends the comment
+  lexer = comment_lexer("/* /* */ */");
+  CHECK(lexer_add_block_comment_rule(lexer, "/*", "*/", false, TOK_BLOCK,
+                                     NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_BLOCK, "/* /* */");
+  CHECK_TOKEN(lexer, TOK_OTHER, "*");
+  lexer_destroy(lexer);
+}
+
+static void test_nested_comments(void) {
+  lexer_t *lexer = comment_lexer("{ a { b } c } { { } x");
+  CHECK(lexer_add_block_comment_rule(lexer, "{", "}", true, TOK_NESTED,
+                                     NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_NESTED, "{ a { b } c }");
+  // One level left open
+  CHECK_TOKEN(lexer, TOK_OTHER, "{");
+  CHECK_TOKEN(lexer, TOK_NESTED, "{ }");
+  lexer_destroy(lexer);
+
+  // Multi-byte delimiters sharing bytes
+  lexer = comment_lexer("<!-- <!-- --> --> <!---->");
+  CHECK(lexer_add_block_comment_rule(lexer, "<!--", "-->", true, TOK_NESTED,
+                                     NULL));
+  add_other_rule(lexer);
+  CHECK_TOKEN(lexer, TOK_NESTED, "<!-- <!-- --> -->");
+  CHECK_TOKEN(lexer, TOK_NESTED, "<!---->");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Terminators at every offset up to three blocks, with a decoy of the first
+// delimiter byte before them
+static void test_lengths(void) {
+  char source[128];
+  for (size_t body = 0; body < 100; ++body) {
+    memset(source, 'x', sizeof(source));
+    memcpy(source, "(*", 2);
+    if (body > 0) {
+      source[2 + body - 1] = '*';
+    }
+    memcpy(source + 2 + body, "*)", 3);
+    lexer_t *lexer = comment_lexer(source);
+    CHECK(lexer_add_block_comment_rule(lexer, "(*", "*)", true, TOK_NESTED,
+                                       NULL));
+    token_t token = lexer_next_token(lexer);
+    CHECK(token.kind == TOK_NESTED && token.length == body + 4);
+    CHECK_EOF(lexer);
+    lexer_destroy(lexer);
+  }
+}
+
+int main(void) {
+  test_line_comments();
+  test_block_comments();
+  test_nested_comments();
+  test_lengths();
+  return test_report();
+}
@@ -0,0 +1,146 @@
+// Compact tokens: lexemes, filenames and locations recovered from the source
+// table, offsets taken from the match start, and the 32/16-bit limits of
+// compact_token_t.
+
+#define _DEFAULT_SOURCE
+#define LEXER_IMPL
+#include "test.h"
+
+#include <sys/mman.h>
+
+enum { TOK_WORD = 2, TOK_NUMBER, TOK_SPACE, TOK_OTHER };
+
+static char replaced_lexeme[] = "replaced";
+
+// Points the lexeme at storage outside the source
+static void replace_lexeme(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->lexeme = replaced_lexeme;
+  token->length = strlen(replaced_lexeme);
+}
+
+static void wide_kind(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->kind = 70000;
+}
+
+static void wide_flags(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->flags = 1u << 20;
+}
+
+static lexer_t *compact_lexer(const char *source, const char *filename) {
+  lexer_t *lexer = lexer_create(source, 0, filename, 0);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  return lexer;
+}
+
+static void check_compact(lexer_t *lexer, compact_token_t token,
+                          uint32_t kind, const char *lexeme, size_t line,
+                          size_t column) {
+  CHECK(token.kind == kind);
+  CHECK(token.length == strlen(lexeme));
+  CHECK(memcmp(lexer_compact_lexeme(lexer, token), lexeme, token.length) ==
+        0);
+  size_t token_line = 0;
+  size_t token_column = 0;
+  CHECK(lexer_compact_location(lexer, token, &token_line, &token_column));
+  CHECK(token_line == line && token_column == column);
+}
+
+static void test_accessors(void) {
+  lexer_t *lexer = compact_lexer("abc 12\n  de", "a.txt");
+  compact_token_t token = lexer_next_compact_token(lexer);
+  check_compact(lexer, token, TOK_WORD, "abc", 1, 1);
+  CHECK(token.offset == 0);
+  CHECK(strcmp(lexer_compact_filename(lexer, token), "a.txt") == 0);
+  check_compact(lexer, lexer_next_compact_token(lexer), TOK_NUMBER, "12", 1,
+                5);
+  token = lexer_next_compact_token(lexer);
+  check_compact(lexer, token, TOK_WORD, "de", 2, 3);
+  CHECK(token.offset == 9);
+  token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == INTERNAL_TOKEN_EOF && token.offset == 11);
+  lexer_destroy(lexer);
+}
+
+// The offset is where the match started, whatever the action did to the
+// lexeme; a token peeked before being consumed keeps its offset too
+static void test_offsets(void) {
+  lexer_t *lexer = lexer_create("ab 123 cd", 0, "offsets", 0);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, replace_lexeme));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_next_compact_token(lexer).offset == 0);
+  compact_token_t token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == TOK_NUMBER && token.offset == 3);
+  CHECK(lexer_peek_token(lexer, 0)->kind == TOK_WORD);
+  token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.offset == 7 && token.length == 2);
+  lexer_destroy(lexer);
+}
+
+// Kinds and flags that do not fit 16 bits give an error token that keeps the
+// offset and length of the match
+static void test_limits(void) {
+  lexer_t *lexer = lexer_create("ab 12 cd", 0, "limits", 0);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", 65536, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_next_compact_token(lexer).kind == TOK_WORD);
+  compact_token_t token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == INTERNAL_TOKEN_ERROR);
+  CHECK(token.offset == 3 && token.length == 2);
+  CHECK(lexer_next_compact_token(lexer).kind == TOK_WORD);
+  lexer_destroy(lexer);
+
+  lexer = lexer_create("ab cd", 0, "limits", 0);
+  CHECK(lexer_add_regex_rule(lexer, "ab", TOK_WORD, wide_kind));
+  CHECK(lexer_add_regex_rule(lexer, "cd", TOK_WORD, wide_flags));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == INTERNAL_TOKEN_ERROR);
+  CHECK(token.offset == 0 && token.length == 2 && token.flags == 0);
+  token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == INTERNAL_TOKEN_ERROR);
+  CHECK(token.offset == 3 && token.length == 2 && token.flags == 0);
+  CHECK(lexer_next_compact_token(lexer).kind == INTERNAL_TOKEN_EOF);
+  lexer_destroy(lexer);
+}
+
+// A source of 4 GiB or more is one error token then EOF. The mapping is
+// never written, so it costs address space only.
+static void test_huge_source(void) {
+#if SIZE_MAX > UINT32_MAX
+  size_t length = (size_t)UINT32_MAX + 2;
+  char *text = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS |
+                    MAP_NORESERVE, -1, 0);
+  if (text == MAP_FAILED) {
+    fprintf(stderr, "test_huge_source: skipped, mmap failed\n");
+    return;
+  }
+  lexer_t *lexer = lexer_create(text, length, "huge", 0);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  compact_token_t token = lexer_next_compact_token(lexer);
+  CHECK(token.kind == INTERNAL_TOKEN_ERROR);
+  CHECK(token.offset == 0 && token.length == 0);
+  CHECK(lexer_is_eof(lexer));
+  CHECK(lexer_next_compact_token(lexer).kind == INTERNAL_TOKEN_EOF);
+  lexer_destroy(lexer);
+  munmap(text, length);
+#endif
+}
+
+int main(void) {
+  test_accessors();
+  test_offsets();
+  test_limits();
+  test_huge_source();
+  return test_report();
+}
@@ -0,0 +1,125 @@
+// First-byte dispatch: a rule is only tried on the bytes of its `first` set,
+// in registration order, and the dispatch follows rules added later on.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_DIGITS = 2, TOK_WORD, TOK_ANY, TOK_SPACE };
+
+static int digit_calls = 0;
+static int word_calls = 0;
+
+static bool match_digits(lexer_t *lexer, token_t *token) {
+  digit_calls++;
+  size_t start = lexer_get_position(lexer);
+  while (lexer_is_digit(lexer_current(lexer))) {
+    lexer_advance(lexer);
+  }
+  token->kind = TOK_DIGITS;
+  token->length = lexer_get_position(lexer) - start;
+  return token->length > 0;
+}
+
+static bool match_word(lexer_t *lexer, token_t *token) {
+  word_calls++;
+  size_t start = lexer_get_position(lexer);
+  while (lexer_is_alpha(lexer_current(lexer))) {
+    lexer_advance(lexer);
+  }
+  token->kind = TOK_WORD;
+  token->length = lexer_get_position(lexer) - start;
+  return token->length > 0;
+}
+
+// Matches any single byte, tried on every byte (no first set)
+static bool match_any(lexer_t *lexer, token_t *token) {
+  lexer_advance(lexer);
+  token->kind = TOK_ANY;
+  token->length = 1;
+  return true;
+}
+
+// Skips spaces, tried on spaces only
+static bool match_space(lexer_t *lexer, token_t *token) {
+  size_t start = lexer_get_position(lexer);
+  while (lexer_current(lexer) == ' ') {
+    lexer_advance(lexer);
+  }
+  token->kind = TOK_SPACE;
+  token->length = lexer_get_position(lexer) - start;
+  token->flags = TOKEN_FLAG_IGNORE;
+  return token->length > 0;
+}
+
+static void test_first_sets(void) {
+  lexer_t *lexer = lexer_create("12 ab 3", 0, "dispatch", 0);
+  lexer_charset_t digits;
+  lexer_charset_clear(&digits);
+  lexer_charset_add_range(&digits, '0', '9');
+  lexer_charset_t letters;
+  lexer_charset_clear(&letters);
+  lexer_charset_add_range(&letters, 'a', 'z');
+  CHECK(lexer_add_rule_ex(lexer, match_digits, NULL, &digits));
+  CHECK(lexer_add_rule_ex(lexer, match_word, NULL, &letters));
+  lexer_charset_t space;
+  lexer_charset_clear(&space);
+  lexer_charset_add(&space, ' ');
+  CHECK(lexer_add_rule_ex(lexer, match_space, NULL, &space));
+
+  digit_calls = word_calls = 0;
+  CHECK_TOKEN(lexer, TOK_DIGITS, "12");
+  CHECK_TOKEN(lexer, TOK_WORD, "ab");
+  CHECK_TOKEN(lexer, TOK_DIGITS, "3");
+  CHECK_EOF(lexer);
+  // Each matcher only ran on the tokens starting with one of its bytes
+  CHECK(digit_calls == 2);
+  CHECK(word_calls == 1);
+  lexer_destroy(lexer);
+}
+
+static void test_order_and_late_rules(void) {
+  lexer_t *lexer = lexer_create("a1!b", 0, "dispatch", 0);
+  lexer_charset_t letters;
+  lexer_charset_clear(&letters);
+  lexer_charset_add_range(&letters, 'a', 'z');
+  CHECK(lexer_add_rule_ex(lexer, match_word, NULL, &letters));
+  // No `first` set: a candidate for every byte, after the word rule
+  CHECK(lexer_add_rule(lexer, match_any, NULL));
+
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_ANY, "1");
+
+  // A rule added after lexing started is dispatched from the next token on,
+  // but still after the earlier rules
+  lexer_charset_t digits;
+  lexer_charset_clear(&digits);
+  lexer_charset_add_range(&digits, '0', '9');
+  lexer_charset_add(&digits, '!');
+  CHECK(lexer_add_rule_ex(lexer, match_digits, NULL, &digits));
+  CHECK_TOKEN(lexer, TOK_ANY, "!");
+  CHECK_TOKEN(lexer, TOK_WORD, "b");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_no_candidate(void) {
+  lexer_t *lexer = lexer_create("1?", 0, "dispatch", 0);
+  lexer_charset_t digits;
+  lexer_charset_clear(&digits);
+  lexer_charset_add_range(&digits, '0', '9');
+  CHECK(lexer_add_rule_ex(lexer, match_digits, NULL, &digits));
+  CHECK_TOKEN(lexer, TOK_DIGITS, "1");
+  token_t error = lexer_next_token(lexer);
+  CHECK(error.kind == INTERNAL_TOKEN_ERROR);
+  CHECK(error.length == 1 && error.lexeme[0] == '?');
+  CHECK(error.line == 1 && error.column == 2);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_first_sets();
+  test_order_and_late_rules();
+  test_no_candidate();
+  return test_report();
+}
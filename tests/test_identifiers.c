@@ -0,0 +1,151 @@
+// Identifier rules and scanners: ASCII identifiers at block boundaries and
+// at the end of the input, UTF-8 decoding, XID identifiers and code point
+// columns.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_IDENT = 2, TOK_NUMBER, TOK_SPACE, TOK_OTHER, TOK_XID };
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+static void test_ascii_rule(void) {
+  lexer_t *lexer = lexer_create("_a1 9b Z_9\xc3\xa9-x", 0, "ident", 0);
+  CHECK(lexer_add_identifier_rule(lexer, TOK_IDENT, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  CHECK_TOKEN(lexer, TOK_IDENT, "_a1");
+  // Identifiers do not start with a digit
+  CHECK_TOKEN(lexer, TOK_NUMBER, "9");
+  CHECK_TOKEN(lexer, TOK_IDENT, "b");
+  // The ASCII rule stops at the first high byte
+  CHECK_TOKEN(lexer, TOK_IDENT, "Z_9");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xc3");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xa9");
+  CHECK_TOKEN(lexer, TOK_OTHER, "-");
+  CHECK_TOKEN(lexer, TOK_IDENT, "x");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Identifiers of every length up to three blocks, followed by a stop byte or
+// by the end of the input
+static void test_lengths(void) {
+  char source[128];
+  for (size_t length = 1; length < 100; ++length) {
+    for (size_t i = 0; i < length; ++i) {
+      source[i] = "aZ_09"[i % 5];
+    }
+    for (int end = 0; end < 2; ++end) {
+      source[length] = end ? '\0' : '+';
+      source[length + 1] = '\0';
+      lexer_t *lexer = lexer_create(source, 0, "lengths", 0);
+      CHECK(lexer_scan_ident(lexer) == length);
+      CHECK(lexer_scan_ident_utf8(lexer) == length);
+      CHECK(lexer_add_identifier_rule(lexer, TOK_IDENT, NULL));
+      token_t token = lexer_next_token(lexer);
+      CHECK(token.kind == TOK_IDENT && token.length == length);
+      lexer_destroy(lexer);
+    }
+  }
+}
+
+static void check_decode(const char *bytes, size_t expected_length,
+                         uint32_t expected_code_point) {
+  uint32_t code_point = 0;
+  size_t length = lexer_utf8_decode(bytes, strlen(bytes), &code_point);
+  CHECK(length == expected_length);
+  if (length != 0) {
+    CHECK(code_point == expected_code_point);
+  }
+}
+
+static void test_decode(void) {
+  check_decode("\x7f", 1, 0x7F);
+  check_decode("\xc3\xa9", 2, 0xE9);
+  check_decode("\xe2\x82\xac", 3, 0x20AC);
+  check_decode("\xf0\x9f\x98\x80", 4, 0x1F600);
+  check_decode("\xf4\x8f\xbf\xbf", 4, 0x10FFFF);
+  // Truncated, stray continuation, overlong, surrogate, above U+10FFFF
+  check_decode("\xe2\x82", 0, 0);
+  check_decode("\x80", 0, 0);
+  check_decode("\xc0\xaf", 0, 0);
+  check_decode("\xe0\x80\xaf", 0, 0);
+  check_decode("\xed\xa0\x80", 0, 0);
+  check_decode("\xf4\x90\x80\x80", 0, 0);
+  check_decode("\xff", 0, 0);
+
+  CHECK(lexer_is_xid_start('a') && lexer_is_xid_start('_'));
+  CHECK(!lexer_is_xid_start('1') && lexer_is_xid_continue('1'));
+  CHECK(lexer_is_xid_start(0x3BB) && lexer_is_xid_start(0x65E5));
+  // Combining acute accent, euro sign
+  CHECK(!lexer_is_xid_start(0x301) && lexer_is_xid_continue(0x301));
+  CHECK(!lexer_is_xid_start(0x20AC) && !lexer_is_xid_continue(0x20AC));
+}
+
+static void test_xid_rule(void) {
+  lexer_t *lexer = lexer_create(
+      "caf\xc3\xa9 \xce\xbb" "1 e\xcc\x81 \xcc\x81x a\xe2\x82\xac "
+      "\xe6\x97\xa5\xe6\x9c\xac x\xff",
+      0, "xid", 0);
+  CHECK(lexer_add_utf8_identifier_rule(lexer, TOK_XID, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  CHECK_TOKEN(lexer, TOK_XID, "caf\xc3\xa9");
+  CHECK_TOKEN(lexer, TOK_XID, "\xce\xbb" "1");
+  CHECK_TOKEN(lexer, TOK_XID, "e\xcc\x81");
+  // A combining mark cannot start an identifier
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xcc");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\x81");
+  CHECK_TOKEN(lexer, TOK_XID, "x");
+  CHECK_TOKEN(lexer, TOK_XID, "a");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xe2");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\x82");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xac");
+  CHECK_TOKEN(lexer, TOK_XID, "\xe6\x97\xa5\xe6\x9c\xac");
+  // Invalid UTF-8 ends the identifier
+  CHECK_TOKEN(lexer, TOK_XID, "x");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\xff");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Columns count code points with LEXER_FLAG_UTF8_COLUMNS
+static void test_utf8_columns(void) {
+  const char *source = "\xc3\xa9t\xc3\xa9 \xe2\x82\xac x\n\xce\xbb y";
+  for (int utf8 = 0; utf8 < 2; ++utf8) {
+    lexer_t *lexer = lexer_create(source, 0, "columns",
+                                  utf8 ? LEXER_FLAG_UTF8_COLUMNS : 0);
+    CHECK(lexer_add_utf8_identifier_rule(lexer, TOK_XID, NULL));
+    CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                    lexer_action_ignore));
+    CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+    CHECK(lexer_next_token(lexer).column == 1);
+    CHECK(lexer_next_token(lexer).column == (utf8 ? 5 : 7));
+    // Every byte of the euro sign is its own token, the last two are
+    // continuation bytes
+    CHECK(lexer_next_token(lexer).column == (utf8 ? 6 : 8));
+    CHECK(lexer_next_token(lexer).column == (utf8 ? 6 : 9));
+    token_t token = lexer_next_token(lexer);
+    CHECK(token.kind == TOK_XID && token.column == (utf8 ? 7 : 11));
+    CHECK(lexer_next_token(lexer).line == 2);
+    token = lexer_next_token(lexer);
+    CHECK(token.line == 2 && token.column == (utf8 ? 3 : 4));
+    lexer_destroy(lexer);
+  }
+}
+
+int main(void) {
+  test_ascii_rule();
+  test_lengths();
+  test_decode();
+  test_xid_rule();
+  test_utf8_columns();
+  return test_report();
+}
@@ -0,0 +1,141 @@
+// Keyword tables: whole identifiers only, invalid word lists, and a large
+// random table checked against a linear search.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_IDENT = 2, TOK_SPACE, TOK_IF, TOK_ELSE, TOK_WHILE, TOK_FIRST };
+
+static lexer_t *keyword_lexer(const char *source, const char **words,
+                              const uint32_t *kinds, size_t count) {
+  lexer_t *lexer = lexer_create(source, 0, "keywords", 0);
+  CHECK(lexer_add_keywords(lexer, words, kinds, count, NULL));
+  CHECK(lexer_add_identifier_rule(lexer, TOK_IDENT, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  return lexer;
+}
+
+static void test_whole_identifiers(void) {
+  const char *words[] = {"if", "else", "while"};
+  const uint32_t kinds[] = {TOK_IF, TOK_ELSE, TOK_WHILE};
+  lexer_t *lexer = keyword_lexer("if iff _if while1 i else\twhile whil", words,
+                                 kinds, 3);
+  CHECK_TOKEN(lexer, TOK_IF, "if");
+  CHECK_TOKEN(lexer, TOK_IDENT, "iff");
+  CHECK_TOKEN(lexer, TOK_IDENT, "_if");
+  CHECK_TOKEN(lexer, TOK_IDENT, "while1");
+  CHECK_TOKEN(lexer, TOK_IDENT, "i");
+  CHECK_TOKEN(lexer, TOK_ELSE, "else");
+  CHECK_TOKEN(lexer, TOK_WHILE, "while");
+  CHECK_TOKEN(lexer, TOK_IDENT, "whil");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // A keyword right at the end of the input
+  lexer = keyword_lexer("else", words, kinds, 3);
+  CHECK_TOKEN(lexer, TOK_ELSE, "else");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_invalid_words(void) {
+  lexer_t *lexer = lexer_create("", 0, "invalid", 0);
+  const uint32_t kinds[] = {TOK_IF, TOK_ELSE};
+  const char *duplicate[] = {"if", "if"};
+  const char *digit[] = {"if", "9x"};
+  const char *dash[] = {"if", "a-b"};
+  const char *empty[] = {"if", ""};
+  CHECK(!lexer_add_keywords(lexer, duplicate, kinds, 2, NULL));
+  CHECK(!lexer_add_keywords(lexer, digit, kinds, 2, NULL));
+  CHECK(!lexer_add_keywords(lexer, dash, kinds, 2, NULL));
+  CHECK(!lexer_add_keywords(lexer, empty, kinds, 2, NULL));
+  CHECK(!lexer_add_keywords(lexer, duplicate, kinds, 0, NULL));
+  CHECK(lexer_rule_count(lexer) == 0);
+  lexer_destroy(lexer);
+}
+
+enum { WORD_COUNT = 500, WORD_SIZE = 12 };
+
+static void random_word(char *word) {
+  static const char first[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+  size_t length = 1 + test_random() % (WORD_SIZE - 2);
+  word[0] = first[test_random() % (sizeof(first) - 1)];
+  for (size_t i = 1; i < length; ++i) {
+    word[i] = "abc_0123"[test_random() % 8];
+  }
+  word[length] = '\0';
+}
+
+static void test_large_table(void) {
+  static char storage[WORD_COUNT][WORD_SIZE];
+  const char *words[WORD_COUNT];
+  uint32_t kinds[WORD_COUNT];
+  size_t count = 0;
+  while (count < WORD_COUNT) {
+    random_word(storage[count]);
+    bool seen = false;
+    for (size_t i = 0; i < count && !seen; ++i) {
+      seen = strcmp(storage[i], storage[count]) == 0;
+    }
+    if (!seen) {
+      words[count] = storage[count];
+      kinds[count] = TOK_FIRST + (uint32_t)count;
+      count++;
+    }
+  }
+
+  // Keywords, and identifiers around them: prefixes, extensions and others
+  char source[WORD_COUNT * 3 * (WORD_SIZE + 2)];
+  size_t length = 0;
+  for (size_t i = 0; i < WORD_COUNT * 3; ++i) {
+    const char *word = words[test_random() % WORD_COUNT];
+    size_t word_length = strlen(word);
+    char other[WORD_SIZE + 1];
+    switch (test_random() % 3) {
+    case 0:
+      memcpy(source + length, word, word_length);
+      length += word_length;
+      break;
+    case 1:
+      memcpy(source + length, word, word_length);
+      length += word_length;
+      source[length++] = 'x';
+      break;
+    default:
+      random_word(other);
+      memcpy(source + length, other, strlen(other));
+      length += strlen(other);
+      break;
+    }
+    source[length++] = ' ';
+  }
+  source[length] = '\0';
+
+  lexer_t *lexer = keyword_lexer(source, words, kinds, count);
+  for (token_t token = lexer_next_token(lexer);
+       token.kind != INTERNAL_TOKEN_EOF; token = lexer_next_token(lexer)) {
+    uint32_t expected = TOK_IDENT;
+    for (size_t i = 0; i < count; ++i) {
+      if (strlen(words[i]) == token.length &&
+          memcmp(words[i], token.lexeme, token.length) == 0) {
+        expected = kinds[i];
+        break;
+      }
+    }
+    if (token.kind != expected) {
+      fprintf(stderr, "'%.*s': got %u, expected %u\n", (int)token.length,
+              token.lexeme, token.kind, expected);
+      test_failures++;
+    }
+  }
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_whole_identifiers();
+  test_invalid_words();
+  test_large_table();
+  return test_report();
+}
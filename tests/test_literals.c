@@ -0,0 +1,144 @@
+// Literal tables: the longest literal wins, the trie backs off to the last
+// complete literal, invalid sets are rejected, and random sets are checked
+// against a naive longest-prefix search.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum {
+  TOK_OTHER = 2,
+  TOK_LT,
+  TOK_LE,
+  TOK_SHL,
+  TOK_SHL_ASSIGN,
+  TOK_SPACESHIP,
+  TOK_FIRST,
+};
+
+// Any single byte
+static bool match_other(lexer_t *lexer, token_t *token) {
+  if (lexer_is_eof(lexer)) {
+    return false;
+  }
+  lexer_advance(lexer);
+  token->kind = TOK_OTHER;
+  token->length = 1;
+  return true;
+}
+
+static void test_longest_literal(void) {
+  const lexer_literal_t literals[] = {
+      {"<", TOK_LT},
+      {"<=", TOK_LE},
+      {"<<", TOK_SHL},
+      {"<<=", TOK_SHL_ASSIGN},
+      {"<=>", TOK_SPACESHIP},
+  };
+  lexer_t *lexer = lexer_create("<<=<=><<<=x<", 0, "literals", 0);
+  CHECK(lexer_add_literals(lexer, literals, 5, NULL));
+  CHECK(lexer_add_rule(lexer, match_other, NULL));
+  CHECK_TOKEN(lexer, TOK_SHL_ASSIGN, "<<=");
+  CHECK_TOKEN(lexer, TOK_SPACESHIP, "<=>");
+  CHECK_TOKEN(lexer, TOK_SHL, "<<");
+  CHECK_TOKEN(lexer, TOK_LE, "<=");
+  CHECK_TOKEN(lexer, TOK_OTHER, "x");
+  CHECK_TOKEN(lexer, TOK_LT, "<");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // A prefix of a literal that is not a literal itself does not match
+  const lexer_literal_t arrow[] = {{"->>", TOK_SHL}};
+  lexer = lexer_create("->>->", 0, "literals", 0);
+  CHECK(lexer_add_literals(lexer, arrow, 1, NULL));
+  CHECK(lexer_add_rule(lexer, match_other, NULL));
+  CHECK_TOKEN(lexer, TOK_SHL, "->>");
+  CHECK_TOKEN(lexer, TOK_OTHER, "-");
+  CHECK_TOKEN(lexer, TOK_OTHER, ">");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_invalid_literals(void) {
+  lexer_t *lexer = lexer_create("+", 0, "invalid", 0);
+  const lexer_literal_t duplicate[] = {{"+", TOK_LT}, {"+", TOK_LE}};
+  const lexer_literal_t empty[] = {{"+", TOK_LT}, {"", TOK_LE}};
+  const lexer_literal_t missing[] = {{"+", TOK_LT}, {NULL, TOK_LE}};
+  CHECK(!lexer_add_literals(lexer, duplicate, 2, NULL));
+  CHECK(!lexer_add_literals(lexer, empty, 2, NULL));
+  CHECK(!lexer_add_literals(lexer, missing, 2, NULL));
+  CHECK(!lexer_add_literals(lexer, duplicate, 0, NULL));
+  // None of them was added
+  CHECK(lexer_next_token(lexer).kind == INTERNAL_TOKEN_ERROR);
+  lexer_destroy(lexer);
+}
+
+enum { LITERAL_COUNT = 60, LITERAL_SIZE = 6 };
+
+// Random literal sets over a few bytes (including high ones), so that
+// literals share prefixes
+static void test_random_sets(void) {
+  static const char bytes[] = "+-=<>\xc3\xa9";
+  for (int round = 0; round < 200; ++round) {
+    char storage[LITERAL_COUNT][LITERAL_SIZE];
+    lexer_literal_t literals[LITERAL_COUNT];
+    size_t count = 0;
+    size_t wanted = 1 + test_random() % LITERAL_COUNT;
+    for (int attempt = 0; attempt < 1000 && count < wanted; ++attempt) {
+      size_t length = 1 + test_random() % (LITERAL_SIZE - 1);
+      for (size_t i = 0; i < length; ++i) {
+        storage[count][i] = bytes[test_random() % (sizeof(bytes) - 1)];
+      }
+      storage[count][length] = '\0';
+      bool seen = false;
+      for (size_t i = 0; i < count && !seen; ++i) {
+        seen = strcmp(literals[i].text, storage[count]) == 0;
+      }
+      if (!seen) {
+        literals[count] = (lexer_literal_t){storage[count],
+                                            TOK_FIRST + (uint32_t)count};
+        count++;
+      }
+    }
+
+    char source[200];
+    size_t length = 1 + test_random() % (sizeof(source) - 1);
+    for (size_t i = 0; i < length; ++i) {
+      source[i] = bytes[test_random() % (sizeof(bytes) - 1)];
+    }
+    source[length] = '\0';
+
+    lexer_t *lexer = lexer_create(source, length, "random", 0);
+    CHECK(lexer_add_literals(lexer, literals, count, NULL));
+    CHECK(lexer_add_rule(lexer, match_other, NULL));
+    for (size_t offset = 0; offset < length;) {
+      uint32_t kind = TOK_OTHER;
+      size_t longest = 0;
+      for (size_t i = 0; i < count; ++i) {
+        size_t literal_length = strlen(literals[i].text);
+        if (literal_length > longest && literal_length <= length - offset &&
+            memcmp(source + offset, literals[i].text, literal_length) == 0) {
+          longest = literal_length;
+          kind = literals[i].kind;
+        }
+      }
+      size_t expected = longest > 0 ? longest : 1;
+      token_t token = lexer_next_token(lexer);
+      if (token.kind != kind || token.length != expected ||
+          token.lexeme != source + offset) {
+        fprintf(stderr, "round %d at %zu: got %u (%zu bytes), expected %u\n",
+                round, offset, token.kind, token.length, kind);
+        test_failures++;
+        break;
+      }
+      offset += expected;
+    }
+    lexer_destroy(lexer);
+  }
+}
+
+int main(void) {
+  test_longest_literal();
+  test_invalid_literals();
+  test_random_sets();
+  return test_report();
+}
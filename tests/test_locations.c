@@ -0,0 +1,101 @@
+// Lazy locations: with LEXER_FLAG_LAZY_LOCATION tokens carry no line or
+// column, and the newline index gives the same locations as eager tracking,
+// in bytes and in code points.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_WORD = 2, TOK_SPACE, TOK_OTHER };
+
+static lexer_t *location_lexer(const char *source, uint32_t flags) {
+  lexer_t *lexer = lexer_create(source, 0, "locations", flags);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z\\x80-\\xff]+", TOK_WORD, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, " \n", TOK_SPACE, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[^a-z \\n\\x80-\\xff]", TOK_OTHER, NULL));
+  return lexer;
+}
+
+static void naive_location(const char *p, size_t offset, bool utf8,
+                           size_t *line, size_t *column) {
+  *line = 1;
+  *column = 1;
+  for (size_t i = 0; i < offset; ++i) {
+    if (p[i] == '\n') {
+      (*line)++;
+      *column = 1;
+    } else if (!utf8 || ((unsigned char)p[i] & 0xC0) != 0x80) {
+      (*column)++;
+    }
+  }
+}
+
+static void test_bounds(void) {
+  const char *source = "ab\n\ncd\n";
+  lexer_t *lexer = location_lexer(source, LEXER_FLAG_LAZY_LOCATION);
+  size_t line = 0;
+  size_t column = 0;
+  CHECK(lexer_offset_to_location(lexer, 0, &line, &column));
+  CHECK(line == 1 && column == 1);
+  // The newline itself ends its line
+  CHECK(lexer_offset_to_location(lexer, 2, &line, &column));
+  CHECK(line == 1 && column == 3);
+  CHECK(lexer_offset_to_location(lexer, 3, &line, &column));
+  CHECK(line == 2 && column == 1);
+  // The end of the input is a valid location, past it is not
+  CHECK(lexer_offset_to_location(lexer, 7, &line, &column));
+  CHECK(line == 4 && column == 1);
+  CHECK(!lexer_offset_to_location(lexer, 8, &line, &column));
+
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.line == 0 && token.column == 0);
+  CHECK(lexer_get_line(lexer) == 1 && lexer_get_column(lexer) == 3);
+  lexer_destroy(lexer);
+}
+
+// Random multi-line inputs, lexed with eager and lazy locations
+static void test_random_inputs(void) {
+  static const char *const words[] = {"a",    "bc",         " ",  "\n",
+                                      "\n\n", "\xc3\xa9",   "\r", "+",
+                                      "xyz",  "\xe2\x82\xac"};
+  char source[400];
+  for (int round = 0; round < 400; ++round) {
+    test_random_text(source, 2 + test_random() % (sizeof(source) - 2),
+                     (const char **)words, sizeof(words) / sizeof(words[0]));
+    bool utf8 = round % 2;
+    uint32_t columns = utf8 ? LEXER_FLAG_UTF8_COLUMNS : 0;
+    lexer_t *eager = location_lexer(source, columns);
+    lexer_t *lazy = location_lexer(source, columns | LEXER_FLAG_LAZY_LOCATION);
+    for (;;) {
+      token_t a = lexer_next_token(eager);
+      token_t b = lexer_next_token(lazy);
+      CHECK(a.kind == b.kind && a.length == b.length);
+      CHECK(b.line == 0 && b.column == 0);
+      size_t offset = a.kind == INTERNAL_TOKEN_EOF
+                          ? strlen(source)
+                          : (size_t)(a.lexeme - source);
+      size_t line = 0;
+      size_t column = 0;
+      size_t lazy_line = 0;
+      size_t lazy_column = 0;
+      naive_location(source, offset, utf8, &line, &column);
+      CHECK(lexer_offset_to_location(lazy, offset, &lazy_line, &lazy_column));
+      CHECK(a.line == line && a.column == column);
+      CHECK(lazy_line == line && lazy_column == column);
+      if (a.kind == INTERNAL_TOKEN_EOF || b.kind == INTERNAL_TOKEN_EOF) {
+        break;
+      }
+    }
+    size_t line = 0;
+    size_t column = 0;
+    naive_location(source, strlen(source), utf8, &line, &column);
+    CHECK(lexer_get_line(lazy) == line && lexer_get_column(lazy) == column);
+    lexer_destroy(eager);
+    lexer_destroy(lazy);
+  }
+}
+
+int main(void) {
+  test_bounds();
+  test_random_inputs();
+  return test_report();
+}
@@ -0,0 +1,226 @@
+// LEXER_FLAG_LONGEST_MATCH: the longest match among all rules wins, ties go
+// to the earliest rule, and the rules that lose leave no trace. Checked
+// against a naive maximal munch over random inputs.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum {
+  TOK_AB = 2,
+  TOK_WORD,
+  TOK_ASSIGN,
+  TOK_EQUAL,
+  TOK_ARROW,
+  TOK_LONG_ARROW,
+  TOK_ABB,
+  TOK_SPACE,
+  TOK_EQUALS,
+  TOK_C,
+  TOK_OTHER,
+  TOK_KEYWORD,
+  TOK_IDENT,
+};
+
+static const lexer_literal_t literals[] = {
+    {"=", TOK_ASSIGN},
+    {"==", TOK_EQUAL},
+    {"=>", TOK_ARROW},
+    {"==>", TOK_LONG_ARROW},
+};
+
+// Hand-written rule for c[c\n]*, which moves the lexer (and its line) as it
+// goes, even when a longer match wins
+static bool match_c(lexer_t *lexer, token_t *token) {
+  size_t start = lexer_get_position(lexer);
+  if (lexer_current(lexer) != 'c') {
+    return false;
+  }
+  while (!lexer_is_eof(lexer) &&
+         (lexer_current(lexer) == 'c' || lexer_current(lexer) == '\n')) {
+    lexer_advance(lexer);
+  }
+  token->kind = TOK_C;
+  token->length = lexer_get_position(lexer) - start;
+  return true;
+}
+
+static size_t word_span(const char *p, size_t length) {
+  size_t i = 0;
+  while (i < length && p[i] >= 'a' && p[i] <= 'c') {
+    i++;
+  }
+  return i;
+}
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+// Naive match lengths of every rule, in registration order
+
+static size_t naive_prefix(const char *p, size_t length, const char *text) {
+  size_t text_length = strlen(text);
+  return length >= text_length && memcmp(p, text, text_length) == 0
+             ? text_length
+             : 0;
+}
+
+static size_t naive_abb(const char *p, size_t length) {
+  if (length == 0 || p[0] != 'a') {
+    return 0;
+  }
+  size_t best = 0;
+  for (size_t i = 1; i < length && (p[i] == 'b' || p[i] == 'c'); ++i) {
+    if (p[i] == 'b') {
+      best = i + 1;
+    }
+  }
+  return best;
+}
+
+static size_t naive_run(const char *p, size_t length, const char *bytes) {
+  size_t i = 0;
+  while (i < length && strchr(bytes, p[i]) != NULL) {
+    i++;
+  }
+  return i;
+}
+
+typedef struct naive_match_t {
+  uint32_t kind;
+  size_t length;
+} naive_match_t;
+
+static naive_match_t naive_longest(const char *p, size_t length) {
+  naive_match_t candidates[] = {
+      {TOK_AB, naive_prefix(p, length, "ab")},
+      {TOK_WORD, word_span(p, length)},
+      {TOK_ASSIGN, 0},
+      {TOK_ABB, naive_abb(p, length)},
+      {TOK_SPACE, naive_run(p, length, " \n")},
+      {TOK_EQUALS, naive_run(p, length, "=")},
+      {TOK_C, p[0] == 'c' ? naive_run(p, length, "c\n") : 0},
+      {TOK_OTHER, other_span(p, length)},
+  };
+  // Longest literal
+  for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); ++i) {
+    size_t match = naive_prefix(p, length, literals[i].text);
+    if (match > candidates[2].length) {
+      candidates[2].kind = literals[i].kind;
+      candidates[2].length = match;
+    }
+  }
+  naive_match_t best = {INTERNAL_TOKEN_ERROR, 0};
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+    if (candidates[i].length > best.length) {
+      best = candidates[i];
+    }
+  }
+  return best;
+}
+
+static lexer_t *longest_lexer(const char *source) {
+  lexer_t *lexer = lexer_create(source, 0, "longest", LEXER_FLAG_LONGEST_MATCH);
+  CHECK(lexer_add_regex_rule(lexer, "ab", TOK_AB, NULL));
+  CHECK(lexer_add_span_rule(lexer, word_span, TOK_WORD, NULL, NULL));
+  CHECK(lexer_add_literals(lexer, literals,
+                           sizeof(literals) / sizeof(literals[0]), NULL));
+  CHECK(lexer_add_regex_rule(lexer, "a(b|c)*b", TOK_ABB, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, " \n", TOK_SPACE, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "=+", TOK_EQUALS, NULL));
+  CHECK(lexer_add_rule(lexer, match_c, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  return lexer;
+}
+
+static void test_first_and_longest(void) {
+  const char *source = "if ifx i";
+  for (int longest = 0; longest < 2; ++longest) {
+    lexer_t *lexer = lexer_create(
+        source, 0, "keywords", longest ? LEXER_FLAG_LONGEST_MATCH : 0);
+    CHECK(lexer_add_regex_rule(lexer, "if", TOK_KEYWORD, NULL));
+    CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_IDENT, NULL));
+    CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                    lexer_action_ignore));
+    // A tie goes to the earliest rule
+    CHECK_TOKEN(lexer, TOK_KEYWORD, "if");
+    if (longest) {
+      CHECK_TOKEN(lexer, TOK_IDENT, "ifx");
+    } else {
+      CHECK_TOKEN(lexer, TOK_KEYWORD, "if");
+      CHECK_TOKEN(lexer, TOK_IDENT, "x");
+    }
+    CHECK_TOKEN(lexer, TOK_IDENT, "i");
+    CHECK_EOF(lexer);
+    lexer_destroy(lexer);
+  }
+}
+
+// A losing rule that crossed newlines does not move the location
+static void test_rollback(void) {
+  lexer_t *lexer = longest_lexer("==>=\nab abcb\nc\nc\n\n=");
+  CHECK_TOKEN(lexer, TOK_LONG_ARROW, "==>");
+  CHECK_TOKEN(lexer, TOK_ASSIGN, "=");
+  CHECK_TOKEN(lexer, TOK_SPACE, "\n");
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_AB && token.line == 2 && token.column == 1);
+  CHECK_TOKEN(lexer, TOK_SPACE, " ");
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.length == 4 && token.column == 4);
+  CHECK_TOKEN(lexer, TOK_SPACE, "\n");
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_C && token.length == 5 && token.line == 3);
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_ASSIGN && token.line == 6 && token.column == 1);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_random_inputs(void) {
+  static const char alphabet[] = "aabbc= =\n>";
+  char source[256];
+  for (int round = 0; round < 2000; ++round) {
+    size_t length = 1 + test_random() % (sizeof(source) - 1);
+    for (size_t i = 0; i < length; ++i) {
+      source[i] = alphabet[test_random() % (sizeof(alphabet) - 1)];
+    }
+    source[length] = '\0';
+    lexer_t *lexer = longest_lexer(source);
+    size_t offset = 0;
+    size_t line = 1;
+    size_t column = 1;
+    while (offset < length) {
+      naive_match_t expected = naive_longest(source + offset, length - offset);
+      token_t token = lexer_next_token(lexer);
+      if (token.kind != expected.kind || token.length != expected.length ||
+          token.lexeme != source + offset || token.line != line ||
+          token.column != column) {
+        fprintf(stderr, "'%s' at %zu: got %u (%zu bytes), expected %u\n",
+                source, offset, token.kind, token.length, expected.kind);
+        test_failures++;
+        break;
+      }
+      for (size_t i = 0; i < expected.length; ++i) {
+        if (source[offset + i] == '\n') {
+          line++;
+          column = 1;
+        } else {
+          column++;
+        }
+      }
+      offset += expected.length;
+    }
+    if (offset == length) {
+      CHECK_EOF(lexer);
+    }
+    lexer_destroy(lexer);
+  }
+}
+
+int main(void) {
+  test_first_and_longest();
+  test_rollback();
+  test_random_inputs();
+  return test_report();
+}
@@ -0,0 +1,147 @@
+// Token lookahead: lexer_peek_token up to LEXER_LOOKAHEAD_MAX tokens ahead,
+// peeked tokens consumed by every way of getting tokens, actions run once per
+// token, mode switches made by peeked tokens, and lexer_get_number following
+// the tokens returned rather than the tokens lexed.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_WORD = 2, TOK_NUMBER, TOK_TAG, TOK_LT, TOK_SPACE };
+
+static int action_calls = 0;
+
+static void count_action(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  (void)token;
+  action_calls++;
+}
+
+static void enter_tag(lexer_t *lexer, token_t *token) {
+  (void)token;
+  action_calls++;
+  CHECK(lexer_set_mode(lexer, (uint32_t)lexer_find_mode(lexer, "tag")));
+}
+
+static lexer_t *lookahead_lexer(const char *source) {
+  lexer_t *lexer = lexer_create(source, 0, "lookahead", 0);
+  lexer_number_config_t config = {LEXER_NUMBER_DECODE, '\0', NULL};
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, count_action));
+  CHECK(lexer_add_number_rule(lexer, &config, TOK_NUMBER, count_action));
+  return lexer;
+}
+
+static void check_peek(lexer_t *lexer, size_t k, uint32_t kind,
+                       const char *lexeme) {
+  const token_t *token = lexer_peek_token(lexer, k);
+  CHECK(token != NULL);
+  if (token != NULL) {
+    CHECK(token->kind == kind && token->length == strlen(lexeme) &&
+          memcmp(token->lexeme, lexeme, token->length) == 0);
+  }
+}
+
+static void test_window(void) {
+  action_calls = 0;
+  lexer_t *lexer = lookahead_lexer("a b c d e f g h i j");
+  CHECK(lexer_peek_token(lexer, LEXER_LOOKAHEAD_MAX) == NULL);
+  CHECK(lexer_peek_token(NULL, 0) == NULL);
+  check_peek(lexer, LEXER_LOOKAHEAD_MAX - 1, TOK_WORD, "h");
+  CHECK(action_calls == LEXER_LOOKAHEAD_MAX);
+  // The lexer has moved past the last token lexed
+  CHECK(lexer_get_position(lexer) == 15);
+  check_peek(lexer, 0, TOK_WORD, "a");
+  CHECK(lexer_peek_token(lexer, 3) == lexer_peek_token(lexer, 3));
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  check_peek(lexer, 0, TOK_WORD, "b");
+  // The window slides with the tokens consumed
+  check_peek(lexer, LEXER_LOOKAHEAD_MAX - 1, TOK_WORD, "i");
+  CHECK_TOKEN(lexer, TOK_WORD, "b");
+  CHECK_TOKEN(lexer, TOK_WORD, "c");
+  check_peek(lexer, 6, TOK_WORD, "j");
+  CHECK(lexer_peek_token(lexer, 7)->kind == INTERNAL_TOKEN_EOF);
+  CHECK(action_calls == 10);
+  const char *rest[] = {"d", "e", "f", "g", "h", "i", "j"};
+  for (size_t i = 0; i < 7; ++i) {
+    CHECK_TOKEN(lexer, TOK_WORD, rest[i]);
+  }
+  CHECK(action_calls == 10);
+  // EOF repeats past the end of the input
+  CHECK(lexer_peek_token(lexer, 5)->kind == INTERNAL_TOKEN_EOF);
+  CHECK_EOF(lexer);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_consumers(void) {
+  const char *source = "one 2 three 4";
+  lexer_t *lexer = lookahead_lexer(source);
+  check_peek(lexer, 2, TOK_WORD, "three");
+  compact_token_t compact = lexer_next_compact_token(lexer);
+  CHECK(compact.kind == TOK_WORD && compact.offset == 0 && compact.length == 3);
+  compact = lexer_next_compact_token(lexer);
+  CHECK(compact.kind == TOK_NUMBER && compact.offset == 4);
+
+  // The batch starts with the tokens still in the ring
+  token_buffer_t buffer;
+  token_buffer_init(&buffer, true);
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 3);
+  CHECK(buffer.kinds[0] == TOK_WORD && buffer.offsets[0] == 6);
+  CHECK(buffer.lines[0] == 1 && buffer.columns[0] == 7);
+  CHECK(buffer.kinds[1] == TOK_NUMBER && buffer.offsets[1] == 12);
+  CHECK(buffer.kinds[2] == INTERNAL_TOKEN_EOF);
+  token_buffer_free(&buffer);
+
+  // A reset drops the ring
+  lexer_reset(lexer, source, 0, "lookahead");
+  check_peek(lexer, 3, TOK_NUMBER, "4");
+  lexer_reset(lexer, "five", 0, "lookahead");
+  CHECK_TOKEN(lexer, TOK_WORD, "five");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_number(void) {
+  lexer_t *lexer = lookahead_lexer("1 2 3");
+  CHECK_TOKEN(lexer, TOK_NUMBER, "1");
+  check_peek(lexer, 1, TOK_NUMBER, "3");
+  CHECK(lexer_get_number(lexer)->integer == 1);
+  CHECK_TOKEN(lexer, TOK_NUMBER, "2");
+  CHECK(lexer_get_number(lexer)->integer == 2);
+  CHECK_TOKEN(lexer, TOK_NUMBER, "3");
+  CHECK(lexer_get_number(lexer)->integer == 3);
+  lexer_destroy(lexer);
+}
+
+// A peeked token's action switches the mode of the tokens lexed after it
+static void test_mode_switch(void) {
+  action_calls = 0;
+  lexer_t *lexer = lexer_create("a<b c", 0, "lookahead", 0);
+  int32_t tag = lexer_define_mode(lexer, "tag");
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_set_rule_modes(lexer, 0, 1u << LEXER_MODE_DEFAULT | 1u << tag));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "<", TOK_LT, enter_tag));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_TAG, NULL));
+  CHECK(lexer_set_rule_modes(lexer, 3, 1u << tag));
+  check_peek(lexer, 3, TOK_TAG, "c");
+  CHECK(lexer_get_mode(lexer) == (uint32_t)tag);
+  CHECK(action_calls == 1);
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_LT, "<");
+  CHECK_TOKEN(lexer, TOK_TAG, "b");
+  CHECK_TOKEN(lexer, TOK_TAG, "c");
+  CHECK(action_calls == 1);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_window();
+  test_consumers();
+  test_number();
+  test_mode_switch();
+  return test_report();
+}
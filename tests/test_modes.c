@@ -0,0 +1,214 @@
+// Lexer modes: defining and finding modes, rules active in one or several
+// modes, per-mode dispatch (ignored whitespace included), switches taking
+// effect from the next token, and the mode stack limits.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum {
+  TOK_WORD = 2,
+  TOK_TAG,
+  TOK_LT,
+  TOK_GT,
+  TOK_QUOTE,
+  TOK_TEXT,
+  TOK_OPEN,
+  TOK_CLOSE,
+  TOK_SPACE,
+  TOK_BANG
+};
+
+static void add_regex_in_modes(lexer_t *lexer, uint32_t modes,
+                               const char *pattern, uint32_t kind,
+                               token_action_fn action) {
+  CHECK(lexer_add_regex_rule(lexer, pattern, kind, action));
+  CHECK(lexer_set_rule_modes(lexer, lexer_rule_count(lexer) - 1, modes));
+}
+
+static void test_define(void) {
+  lexer_t *lexer = lexer_create("", 0, "define", 0);
+  CHECK(lexer_find_mode(lexer, "default") == LEXER_MODE_DEFAULT);
+  CHECK(lexer_define_mode(lexer, "default") == LEXER_MODE_DEFAULT);
+  CHECK(lexer_find_mode(lexer, "string") == -1);
+  int32_t string = lexer_define_mode(lexer, "string");
+  CHECK(string == 1);
+  CHECK(lexer_define_mode(lexer, "string") == string);
+  CHECK(lexer_find_mode(lexer, "string") == string);
+  CHECK(lexer_define_mode(lexer, "") == -1);
+  CHECK(lexer_define_mode(lexer, NULL) == -1);
+  CHECK(lexer_find_mode(lexer, NULL) == -1);
+
+  char name[16];
+  for (int i = 2; i < LEXER_MODE_MAX; ++i) {
+    snprintf(name, sizeof(name), "mode%d", i);
+    CHECK(lexer_define_mode(lexer, name) == i);
+  }
+  CHECK(lexer_define_mode(lexer, "one too many") == -1);
+  // Existing modes are still found when the table is full
+  CHECK(lexer_define_mode(lexer, "mode31") == 31);
+
+  CHECK(!lexer_set_mode(lexer, LEXER_MODE_MAX));
+  CHECK(!lexer_add_rule_in_mode(lexer, LEXER_MODE_MAX, NULL, NULL));
+  CHECK(!lexer_set_rule_modes(lexer, 0, 1));
+  CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+  lexer_destroy(lexer);
+}
+
+static void test_stack(void) {
+  lexer_t *lexer = lexer_create("", 0, "stack", 0);
+  int32_t other = lexer_define_mode(lexer, "other");
+  CHECK(!lexer_pop_mode(lexer));
+  for (int i = 0; i < LEXER_MODE_STACK_MAX; ++i) {
+    CHECK(lexer_push_mode(lexer, (uint32_t)(i % 2 == 0 ? other : 0)));
+  }
+  CHECK(!lexer_push_mode(lexer, (uint32_t)other));
+  CHECK(lexer_get_mode(lexer) == 0);
+  for (int i = LEXER_MODE_STACK_MAX - 1; i >= 0; --i) {
+    CHECK(lexer_get_mode(lexer) == (uint32_t)(i % 2 == 0 ? other : 0));
+    CHECK(lexer_pop_mode(lexer));
+  }
+  CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+  CHECK(!lexer_pop_mode(lexer));
+  // An unknown mode is not pushed
+  CHECK(!lexer_push_mode(lexer, 5));
+  CHECK(!lexer_pop_mode(lexer));
+  lexer_destroy(lexer);
+}
+
+static void enter_tag(lexer_t *lexer, token_t *token) {
+  (void)token;
+  CHECK(lexer_set_mode(lexer, (uint32_t)lexer_find_mode(lexer, "tag")));
+}
+
+static void leave_tag(lexer_t *lexer, token_t *token) {
+  (void)token;
+  CHECK(lexer_set_mode(lexer, LEXER_MODE_DEFAULT));
+}
+
+// The same bytes lex differently in each mode, and a switch made by an action
+// applies from the next token
+static void test_switch(void) {
+  lexer_t *lexer = lexer_create("a<b c>d <>", 0, "switch", 0);
+  int32_t tag = lexer_define_mode(lexer, "tag");
+  uint32_t both = 1u << LEXER_MODE_DEFAULT | 1u << tag;
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_set_rule_modes(lexer, 0, both));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "<", TOK_LT, enter_tag));
+  add_regex_in_modes(lexer, 1u << tag, "[a-z]+", TOK_TAG, NULL);
+  add_regex_in_modes(lexer, 1u << tag, ">", TOK_GT, leave_tag);
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_LT, "<");
+  CHECK(lexer_get_mode(lexer) == (uint32_t)tag);
+  CHECK_TOKEN(lexer, TOK_TAG, "b");
+  CHECK_TOKEN(lexer, TOK_TAG, "c");
+  CHECK_TOKEN(lexer, TOK_GT, ">");
+  CHECK_TOKEN(lexer, TOK_WORD, "d");
+  CHECK_TOKEN(lexer, TOK_LT, "<");
+  CHECK_TOKEN(lexer, TOK_GT, ">");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // Switching from outside an action
+  lexer = lexer_create("x>", 0, "switch", 0);
+  tag = lexer_define_mode(lexer, "tag");
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  add_regex_in_modes(lexer, 1u << tag, "[a-z]+", TOK_TAG, NULL);
+  add_regex_in_modes(lexer, 1u << tag, ">", TOK_GT, NULL);
+  CHECK(lexer_set_mode(lexer, (uint32_t)tag));
+  CHECK_TOKEN(lexer, TOK_TAG, "x");
+  CHECK_TOKEN(lexer, TOK_GT, ">");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// A quote shared by both modes pushes or pops the string mode, and an
+// interpolation pushes the default mode back
+static void quote(lexer_t *lexer, token_t *token) {
+  (void)token;
+  if (lexer_get_mode(lexer) == LEXER_MODE_DEFAULT) {
+    CHECK(lexer_push_mode(lexer, (uint32_t)lexer_find_mode(lexer, "string")));
+  } else {
+    CHECK(lexer_pop_mode(lexer));
+  }
+}
+
+static void open_interpolation(lexer_t *lexer, token_t *token) {
+  (void)token;
+  CHECK(lexer_push_mode(lexer, LEXER_MODE_DEFAULT));
+}
+
+static void close_interpolation(lexer_t *lexer, token_t *token) {
+  (void)token;
+  CHECK(lexer_pop_mode(lexer));
+}
+
+static bool bang_matcher(lexer_t *lexer, token_t *token) {
+  if (lexer_current(lexer) != '!') {
+    return false;
+  }
+  lexer_advance(lexer);
+  token->kind = TOK_BANG;
+  token->length = 1;
+  return true;
+}
+
+static void test_nesting(void) {
+  lexer_t *lexer =
+      lexer_create("x \"a b{ y \"c{z}\" }!\" !", 0, "nesting", 0);
+  int32_t string = lexer_define_mode(lexer, "string");
+  uint32_t both = 1u << LEXER_MODE_DEFAULT | 1u << string;
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "}", TOK_CLOSE, close_interpolation));
+  add_regex_in_modes(lexer, both, "\"", TOK_QUOTE, quote);
+  add_regex_in_modes(lexer, 1u << string, "[^\"{!]+", TOK_TEXT, NULL);
+  add_regex_in_modes(lexer, 1u << string, "{", TOK_OPEN, open_interpolation);
+  CHECK(lexer_add_rule_in_mode(lexer, (uint32_t)string, bang_matcher, NULL));
+  CHECK_TOKEN(lexer, TOK_WORD, "x");
+  CHECK_TOKEN(lexer, TOK_QUOTE, "\"");
+  // Whitespace is only ignored in the default mode
+  CHECK_TOKEN(lexer, TOK_TEXT, "a b");
+  CHECK_TOKEN(lexer, TOK_OPEN, "{");
+  CHECK_TOKEN(lexer, TOK_WORD, "y");
+  CHECK_TOKEN(lexer, TOK_QUOTE, "\"");
+  CHECK_TOKEN(lexer, TOK_TEXT, "c");
+  CHECK_TOKEN(lexer, TOK_OPEN, "{");
+  CHECK_TOKEN(lexer, TOK_WORD, "z");
+  CHECK_TOKEN(lexer, TOK_CLOSE, "}");
+  CHECK_TOKEN(lexer, TOK_QUOTE, "\"");
+  CHECK_TOKEN(lexer, TOK_CLOSE, "}");
+  CHECK(lexer_get_mode(lexer) == (uint32_t)string);
+  CHECK_TOKEN(lexer, TOK_BANG, "!");
+  CHECK_TOKEN(lexer, TOK_QUOTE, "\"");
+  CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+  // The matcher is not active in the default mode
+  CHECK(lexer_next_token(lexer).kind == INTERNAL_TOKEN_ERROR);
+  lexer_destroy(lexer);
+}
+
+// A rule active in no mode never matches, and moving it back restores it
+static void test_inactive(void) {
+  lexer_t *lexer = lexer_create("ab", 0, "inactive", 0);
+  CHECK(lexer_add_regex_rule(lexer, "a", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]", TOK_TAG, NULL));
+  CHECK(lexer_set_rule_modes(lexer, 0, 0));
+  CHECK_TOKEN(lexer, TOK_TAG, "a");
+  CHECK(lexer_set_rule_modes(lexer, 0, 1u << LEXER_MODE_DEFAULT));
+  lexer_reset(lexer, "ab", 0, "inactive");
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_TAG, "b");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_define();
+  test_stack();
+  test_switch();
+  test_nesting();
+  test_inactive();
+  return test_report();
+}
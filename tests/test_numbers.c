@@ -0,0 +1,219 @@
+// Number rule: literal forms, separators and suffixes, C octal literals,
+// decoded values checked against strtoull/strtod on random literals, and
+// decoding under a locale whose decimal point is not '.'.
+
+#define LEXER_IMPL
+#include "test.h"
+
+#include <locale.h>
+
+enum { TOK_NUMBER = 2, TOK_IDENT, TOK_SPACE, TOK_OTHER };
+
+static lexer_t *number_lexer(const char *source, uint32_t flags,
+                             char separator, const char *suffixes) {
+  lexer_t *lexer = lexer_create(source, 0, "numbers", 0);
+  lexer_number_config_t config = {flags | LEXER_NUMBER_DECODE, separator,
+                                  suffixes};
+  CHECK(lexer_add_number_rule(lexer, &config, TOK_NUMBER, NULL));
+  CHECK(lexer_add_identifier_rule(lexer, TOK_IDENT, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[.+-]", TOK_OTHER, NULL));
+  return lexer;
+}
+
+#define CHECK_INTEGER(lexer, lexeme, value)                                    \
+  do {                                                                         \
+    CHECK_TOKEN(lexer, TOK_NUMBER, lexeme);                                    \
+    CHECK(!lexer_get_number(lexer)->is_float);                                 \
+    CHECK(lexer_get_number(lexer)->integer == (value));                        \
+  } while (0)
+
+#define CHECK_REAL(lexer, lexeme, value)                                       \
+  do {                                                                         \
+    CHECK_TOKEN(lexer, TOK_NUMBER, lexeme);                                    \
+    CHECK(lexer_get_number(lexer)->is_float);                                  \
+    CHECK(lexer_get_number(lexer)->real == (value));                           \
+  } while (0)
+
+static void test_forms(void) {
+  const uint32_t all = LEXER_NUMBER_HEX | LEXER_NUMBER_OCTAL |
+                       LEXER_NUMBER_BINARY | LEXER_NUMBER_FLOAT;
+  lexer_t *lexer = number_lexer(
+      "0 42 0x1F 0XfF 0o17 0b101 1.5 .25 1e3 2.5E-3 7e+2 0x 1e 3.", all, '\0',
+      NULL);
+  CHECK_INTEGER(lexer, "0", 0);
+  CHECK_INTEGER(lexer, "42", 42);
+  CHECK_INTEGER(lexer, "0x1F", 31);
+  CHECK_INTEGER(lexer, "0XfF", 255);
+  CHECK_INTEGER(lexer, "0o17", 15);
+  CHECK_INTEGER(lexer, "0b101", 5);
+  CHECK_REAL(lexer, "1.5", 1.5);
+  CHECK_REAL(lexer, ".25", 0.25);
+  CHECK_REAL(lexer, "1e3", 1000.0);
+  CHECK_REAL(lexer, "2.5E-3", 2.5e-3);
+  CHECK_REAL(lexer, "7e+2", 700.0);
+  // A prefix or exponent without digits is not part of the number
+  CHECK_INTEGER(lexer, "0", 0);
+  CHECK_TOKEN(lexer, TOK_IDENT, "x");
+  CHECK_INTEGER(lexer, "1", 1);
+  CHECK_TOKEN(lexer, TOK_IDENT, "e");
+  CHECK_INTEGER(lexer, "3", 3);
+  CHECK_TOKEN(lexer, TOK_OTHER, ".");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // Forms that are not enabled
+  lexer = number_lexer("0x1F 1.5", 0, '\0', NULL);
+  CHECK_INTEGER(lexer, "0", 0);
+  CHECK_TOKEN(lexer, TOK_IDENT, "x1F");
+  CHECK_INTEGER(lexer, "1", 1);
+  CHECK_TOKEN(lexer, TOK_OTHER, ".");
+  CHECK_INTEGER(lexer, "5", 5);
+  lexer_destroy(lexer);
+}
+
+static void test_separators_and_suffixes(void) {
+  lexer_t *lexer = number_lexer("1_000_000 0xFF_FF 1_0.2_5 10uL 7_ 3f",
+                                LEXER_NUMBER_HEX | LEXER_NUMBER_FLOAT, '_',
+                                "uUlL");
+  CHECK_INTEGER(lexer, "1_000_000", 1000000);
+  CHECK_INTEGER(lexer, "0xFF_FF", 0xFFFF);
+  CHECK_REAL(lexer, "1_0.2_5", 10.25);
+  CHECK_INTEGER(lexer, "10uL", 10);
+  // Separators only between digits, and only the listed suffixes
+  CHECK_INTEGER(lexer, "7", 7);
+  CHECK_TOKEN(lexer, TOK_IDENT, "_");
+  CHECK_INTEGER(lexer, "3", 3);
+  CHECK_TOKEN(lexer, TOK_IDENT, "f");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_c_octal(void) {
+  lexer_t *lexer = number_lexer("017 0 00 08 0912 09.5 0x10",
+                                LEXER_NUMBER_C_OCTAL | LEXER_NUMBER_HEX |
+                                    LEXER_NUMBER_FLOAT,
+                                '\0', NULL);
+  CHECK_INTEGER(lexer, "017", 15);
+  CHECK_INTEGER(lexer, "0", 0);
+  CHECK_INTEGER(lexer, "00", 0);
+  // 8 and 9 make the whole literal one invalid token
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_NUMBER && token.length == 2);
+  CHECK(token.flags & TOKEN_FLAG_INVALID);
+  CHECK(lexer_get_number(lexer)->integer == 8);
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_NUMBER && token.length == 4);
+  CHECK(token.flags & TOKEN_FLAG_INVALID);
+  // A float is decimal even with a leading 0
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_NUMBER && token.length == 4);
+  CHECK(!(token.flags & TOKEN_FLAG_INVALID));
+  CHECK(lexer_get_number(lexer)->real == 9.5);
+  CHECK_INTEGER(lexer, "0x10", 16);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_overflow(void) {
+  lexer_t *lexer = number_lexer(
+      "18446744073709551615 18446744073709551616 0xFFFFFFFFFFFFFFFFF",
+      LEXER_NUMBER_HEX, '\0', NULL);
+  CHECK_INTEGER(lexer, "18446744073709551615", UINT64_MAX);
+  CHECK(!lexer_get_number(lexer)->overflow);
+  CHECK_TOKEN(lexer, TOK_NUMBER, "18446744073709551616");
+  CHECK(lexer_get_number(lexer)->overflow);
+  CHECK(lexer_get_number(lexer)->integer == UINT64_MAX);
+  CHECK_TOKEN(lexer, TOK_NUMBER, "0xFFFFFFFFFFFFFFFFF");
+  CHECK(lexer_get_number(lexer)->overflow);
+  lexer_destroy(lexer);
+}
+
+// Random literals, including long mantissas and exponents outside the fast
+// path, decoded like strtoull/strtod
+static void test_random_values(void) {
+  char literal[64];
+  for (int round = 0; round < 20000; ++round) {
+    size_t length = 0;
+    size_t digits = 1 + test_random() % 24;
+    for (size_t i = 0; i < digits; ++i) {
+      literal[length++] = (char)('0' + test_random() % 10);
+    }
+    if (literal[0] == '0' && digits > 1) {
+      literal[0] = '1';
+    }
+    bool is_float = test_random() % 2;
+    if (is_float) {
+      if (test_random() % 2) {
+        literal[length++] = '.';
+        size_t fraction = 1 + test_random() % 20;
+        for (size_t i = 0; i < fraction; ++i) {
+          literal[length++] = (char)('0' + test_random() % 10);
+        }
+      }
+      if (test_random() % 2) {
+        length += (size_t)sprintf(literal + length, "e%s%u",
+                                  test_random() % 2 ? "-" : "",
+                                  (unsigned)(test_random() % 330));
+      }
+    }
+    literal[length] = '\0';
+    is_float = strpbrk(literal, ".e") != NULL;
+
+    lexer_t *lexer = number_lexer(literal, LEXER_NUMBER_FLOAT, '\0', NULL);
+    token_t token = lexer_next_token(lexer);
+    const lexer_number_t *number = lexer_get_number(lexer);
+    CHECK(token.kind == TOK_NUMBER && token.length == length);
+    CHECK(number->is_float == is_float);
+    if (is_float) {
+      double expected = strtod(literal, NULL);
+      if (number->real != expected) {
+        fprintf(stderr, "%s: got %.17g, expected %.17g\n", literal,
+                number->real, expected);
+        test_failures++;
+      }
+    } else {
+      CHECK(number->integer == strtoull(literal, NULL, 10));
+    }
+    lexer_destroy(lexer);
+  }
+}
+
+// Literals the fast path leaves to strtod still decode with a '.' when
+// LC_NUMERIC uses a decimal comma. Skipped if no such locale is installed.
+static void test_locale(void) {
+  static const char *const names[] = {"de_DE.UTF-8", "de_DE.utf8",
+                                      "fr_FR.UTF-8", "fr_FR.utf8",
+                                      "de_DE",       "fr_FR"};
+  const char *name = NULL;
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]) && !name; ++i) {
+    if (setlocale(LC_NUMERIC, names[i]) != NULL &&
+        strcmp(localeconv()->decimal_point, ".") != 0) {
+      name = names[i];
+    }
+  }
+  if (name == NULL) {
+    setlocale(LC_NUMERIC, "C");
+    fprintf(stderr, "test_locale: no decimal comma locale, skipped\n");
+    return;
+  }
+  lexer_t *lexer = number_lexer("1.2345678901234567890123 2.5e-300 7.5",
+                                LEXER_NUMBER_FLOAT, '\0', NULL);
+  CHECK_REAL(lexer, "1.2345678901234567890123", 1.2345678901234567890123);
+  CHECK_REAL(lexer, "2.5e-300", 2.5e-300);
+  CHECK_REAL(lexer, "7.5", 7.5);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+  setlocale(LC_NUMERIC, "C");
+}
+
+int main(void) {
+  test_forms();
+  test_separators_and_suffixes();
+  test_c_octal();
+  test_overflow();
+  test_random_values();
+  test_locale();
+  return test_report();
+}
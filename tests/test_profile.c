@@ -0,0 +1,115 @@
+// Profile-guided rule ordering: hits are counted with LEXER_FLAG_PROFILE,
+// lexer_optimize_rules only moves order-independent rules ahead, the tokens
+// do not change, and adding a rule restores the registration order.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_A = 2, TOK_B, TOK_C, TOK_KEYWORD, TOK_IDENT, TOK_NUMBER, TOK_SPACE };
+
+static int a_calls = 0;
+static int b_calls = 0;
+
+static bool match_byte(lexer_t *lexer, token_t *token, char c, uint32_t kind) {
+  if (lexer_current(lexer) != c) {
+    return false;
+  }
+  lexer_advance(lexer);
+  token->kind = kind;
+  token->length = 1;
+  return true;
+}
+
+static bool match_a(lexer_t *lexer, token_t *token) {
+  a_calls++;
+  return match_byte(lexer, token, 'a', TOK_A);
+}
+
+static bool match_b(lexer_t *lexer, token_t *token) {
+  b_calls++;
+  return match_byte(lexer, token, 'b', TOK_B);
+}
+
+static bool match_c(lexer_t *lexer, token_t *token) {
+  return match_byte(lexer, token, 'c', TOK_C);
+}
+
+// Lexes the whole source again and returns the calls made to match_a
+static int calls_to_a(lexer_t *lexer, const char *source) {
+  lexer_reset(lexer, source, 0, "profile");
+  a_calls = 0;
+  b_calls = 0;
+  while (lexer_next_token(lexer).kind != INTERNAL_TOKEN_EOF) {
+  }
+  return a_calls;
+}
+
+static void test_reordering(void) {
+  const char *source = "bbbbbbbbba";
+  for (int independent = 0; independent < 2; ++independent) {
+    lexer_t *lexer = lexer_create(source, 0, "profile", LEXER_FLAG_PROFILE);
+    CHECK(lexer_add_rule(lexer, match_a, NULL));
+    CHECK(lexer_add_rule(lexer, match_b, NULL));
+    if (independent) {
+      CHECK(lexer_set_rule_flags(lexer, 1, LEXER_RULE_FLAG_ORDER_INDEPENDENT));
+    }
+    CHECK(calls_to_a(lexer, source) == 10);
+    CHECK(lexer->rules.items[0].hits == 1);
+    CHECK(lexer->rules.items[1].hits == 9);
+
+    // The hotter rule goes first only if the rules may be swapped
+    lexer_optimize_rules(lexer);
+    CHECK(calls_to_a(lexer, source) == (independent ? 1 : 10));
+    CHECK(b_calls == (independent ? 10 : 9));
+    CHECK(lexer->rules.items[1].hits == 18);
+
+    // A new rule rebuilds the lists in registration order
+    CHECK(lexer_add_rule(lexer, match_c, NULL));
+    CHECK(calls_to_a(lexer, source) == 10);
+    lexer_destroy(lexer);
+  }
+}
+
+// Optimizing a lexer whose order-independent rules really are independent
+// gives the same tokens
+static void test_same_tokens(void) {
+  static const char *const words[] = {"if", "iffy", "x", "12", " ", "\n",
+                                      "i",  "f",    "9", "_"};
+  char source[2000];
+  test_random_text(source, sizeof(source), (const char **)words,
+                   sizeof(words) / sizeof(words[0]));
+  lexer_t *lexers[2];
+  for (int i = 0; i < 2; ++i) {
+    lexers[i] = lexer_create(source, 0, "same", LEXER_FLAG_PROFILE);
+    lexer_t *lexer = lexers[i];
+    // The keyword competes with identifiers; numbers and spaces do not
+    CHECK(lexer_add_regex_rule(lexer, "if", TOK_KEYWORD, NULL));
+    CHECK(lexer_add_regex_rule(lexer, "[a-z_][a-z_0-9]*", TOK_IDENT, NULL));
+    CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, NULL));
+    CHECK(lexer_add_regex_rule(lexer, "\\s+", TOK_SPACE, lexer_action_ignore));
+    CHECK(lexer_set_rule_flags(lexer, 2, LEXER_RULE_FLAG_ORDER_INDEPENDENT));
+    CHECK(lexer_set_rule_flags(lexer, 3, LEXER_RULE_FLAG_ORDER_INDEPENDENT));
+    while (lexer_next_token(lexer).kind != INTERNAL_TOKEN_EOF) {
+    }
+    lexer_reset(lexer, source, 0, "same");
+  }
+  CHECK(lexers[1]->rules.items[1].hits > lexers[1]->rules.items[0].hits);
+  lexer_optimize_rules(lexers[1]);
+  for (;;) {
+    token_t a = lexer_next_token(lexers[0]);
+    token_t b = lexer_next_token(lexers[1]);
+    CHECK(a.kind == b.kind && a.length == b.length && a.line == b.line &&
+          a.column == b.column);
+    if (a.kind == INTERNAL_TOKEN_EOF || b.kind == INTERNAL_TOKEN_EOF) {
+      break;
+    }
+  }
+  lexer_destroy(lexers[0]);
+  lexer_destroy(lexers[1]);
+}
+
+int main(void) {
+  test_reordering();
+  test_same_tokens();
+  return test_report();
+}
@@ -0,0 +1,191 @@
+// Regex rules: syntax, counted repetitions, and the longest prefix accepted
+// by random patterns checked against POSIX <regex.h> (leftmost-longest).
+
+#define _POSIX_C_SOURCE 200809L
+#define LEXER_IMPL
+#include "test.h"
+
+#include <regex.h>
+
+enum { TOK_MATCH = 2 };
+
+// Length of the token produced by `pattern` at the start of `input`, 0 if the
+// pattern does not match (or only matches the empty string), -1 if invalid
+static long match_length(const char *pattern, const char *input) {
+  lexer_t *lexer = lexer_create(input, 0, "regex", 0);
+  if (!lexer_add_regex_rule(lexer, pattern, TOK_MATCH, NULL)) {
+    lexer_destroy(lexer);
+    return -1;
+  }
+  token_t token = lexer_next_token(lexer);
+  lexer_destroy(lexer);
+  return token.kind == TOK_MATCH ? (long)token.length : 0;
+}
+
+static void test_syntax(void) {
+  CHECK(match_length("abc", "abcd") == 3);
+  CHECK(match_length("abc", "xabc") == 0);
+  CHECK(match_length("a|ab|abc", "abcd") == 3);
+  CHECK(match_length("a.c", "abc") == 3);
+  CHECK(match_length("a.c", "a\nc") == 0);
+  CHECK(match_length("[a-c]+", "cabd") == 3);
+  CHECK(match_length("[^a-c]+", "xyza") == 3);
+  CHECK(match_length("[]a]+", "]a]b") == 3);
+  CHECK(match_length("\\d+\\s\\w+", "42 foo_1!") == 8);
+  CHECK(match_length("\\D\\S\\W", "a- ") == 3);
+  CHECK(match_length("\\x41\\t\\n", "A\t\n") == 3);
+  CHECK(match_length("[[:digit:][:upper:]]+", "1A2b") == 3);
+  CHECK(match_length("colou?r", "color") == 5);
+  CHECK(match_length("(ab)*c", "ababc") == 5);
+  CHECK(match_length("(ab)+", "abababa") == 6);
+  CHECK(match_length("a*", "bbb") == 0);
+}
+
+static void test_counted_repetitions(void) {
+  CHECK(match_length("a{3}", "aaaa") == 3);
+  CHECK(match_length("a{3}", "aa") == 0);
+  CHECK(match_length("a{2,3}", "aaaa") == 3);
+  CHECK(match_length("a{2,3}", "a") == 0);
+  CHECK(match_length("xa{0,2}y", "xy") == 2);
+  CHECK(match_length("xa{0,2}y", "xaay") == 4);
+  CHECK(match_length("xa{0,2}y", "xaaay") == 0);
+  CHECK(match_length("ab{2,}c", "abbbbbc") == 7);
+  CHECK(match_length("ab{2,}c", "abc") == 0);
+  CHECK(match_length("ab{0,}c", "ac") == 2);
+  CHECK(match_length("(a|bc){2,3}", "abcbca") == 5);
+  CHECK(match_length("(a|bc){2,3}", "bca") == 3);
+  CHECK(match_length("(a|bc){2,3}", "bcx") == 0);
+  CHECK(match_length("(a|bc){2,}d", "abcabcad") == 8);
+  CHECK(match_length("((a|b){2}c){2}", "abcbacb") == 6);
+  CHECK(match_length("((ab?){1,2}c){2,}", "abacacabc") == 9);
+  CHECK(match_length("(a{2}){2}", "aaaaa") == 4);
+  CHECK(match_length("a{1,2}{2}", "aaaaa") == 4);
+}
+
+static void test_invalid(void) {
+  CHECK(match_length("(a", "a") == -1);
+  CHECK(match_length("a)", "a") == -1);
+  CHECK(match_length("[a", "a") == -1);
+  CHECK(match_length("a{3,2}", "a") == -1);
+  CHECK(match_length("a{", "a") == -1);
+  CHECK(match_length("a{x}", "a") == -1);
+  CHECK(match_length("[[:nope:]]", "a") == -1);
+  CHECK(match_length("a\\", "a") == -1);
+}
+
+// Counted repetitions are bounded one by one and in total
+static void test_limits(void) {
+  static char input[300];
+  memset(input, 'x', 299);
+  CHECK(match_length("x{255}", input) == 255);
+  CHECK(match_length("x{256}", input) == -1);
+  CHECK(match_length("x{255}{255}", input) == -1);
+  CHECK(match_length("((x{255}){255}){255}", input) == -1);
+  CHECK(match_length("(x|y){2,}{255}{255}", input) == -1);
+
+  // A rejected pattern leaves the other rules as they were
+  lexer_t *lexer = lexer_create("ab", 0, "regex", 0);
+  CHECK(lexer_add_regex_rule(lexer, "a", TOK_MATCH, NULL));
+  CHECK(!lexer_add_regex_rule(lexer, "b{200}{200}", TOK_MATCH + 1, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "b", TOK_MATCH + 2, NULL));
+  CHECK_TOKEN(lexer, TOK_MATCH, "a");
+  CHECK_TOKEN(lexer, TOK_MATCH + 2, "b");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Random pattern over {a, b, c} using the syntax shared with POSIX EREs
+static void random_pattern(char *out, size_t *length, int depth) {
+  int atoms = 1 + (int)(test_random() % 3);
+  for (int i = 0; i < atoms; ++i) {
+    switch (test_random() % (depth > 0 ? 6 : 4)) {
+    case 0:
+    case 1:
+      out[(*length)++] = "abc"[test_random() % 3];
+      break;
+    case 2:
+      *length += (size_t)sprintf(out + *length, "%s",
+                                 test_random() % 2 ? "[ab]" : "[^a]");
+      break;
+    case 3:
+      out[(*length)++] = '.';
+      break;
+    default:
+      out[(*length)++] = '(';
+      random_pattern(out, length, depth - 1);
+      if (test_random() % 2) {
+        out[(*length)++] = '|';
+        random_pattern(out, length, depth - 1);
+      }
+      out[(*length)++] = ')';
+      break;
+    }
+    unsigned min = test_random() % 3;
+    unsigned max = min + test_random() % 3;
+    switch (test_random() % 9) {
+    case 0:
+      out[(*length)++] = '*';
+      break;
+    case 1:
+      out[(*length)++] = '+';
+      break;
+    case 2:
+      out[(*length)++] = '?';
+      break;
+    case 3:
+      *length += (size_t)sprintf(out + *length, "{%u}", min);
+      break;
+    case 4:
+      *length += (size_t)sprintf(out + *length, "{%u,}", min);
+      break;
+    case 5:
+      *length += (size_t)sprintf(out + *length, "{%u,%u}", min, max);
+      break;
+    default:
+      break;
+    }
+  }
+  out[*length] = '\0';
+}
+
+static void test_against_posix(void) {
+  char pattern[512];
+  char anchored[520];
+  char input[16];
+  for (int round = 0; round < 400; ++round) {
+    size_t length = 0;
+    random_pattern(pattern, &length, 2);
+    snprintf(anchored, sizeof(anchored), "^(%s)", pattern);
+    regex_t posix;
+    if (regcomp(&posix, anchored, REG_EXTENDED) != 0) {
+      continue;
+    }
+    for (int i = 0; i < 20; ++i) {
+      size_t input_length = test_random() % (sizeof(input) - 1);
+      for (size_t j = 0; j < input_length; ++j) {
+        input[j] = "abc"[test_random() % 3];
+      }
+      input[input_length] = '\0';
+      regmatch_t match;
+      long expected = regexec(&posix, input, 1, &match, 0) == 0
+                          ? (long)match.rm_eo
+                          : 0;
+      long got = match_length(pattern, input);
+      if (got != expected) {
+        fprintf(stderr, "/%s/ on '%s': expected %ld, got %ld\n", pattern,
+                input, expected, got);
+        test_failures++;
+      }
+    }
+    regfree(&posix);
+  }
+}
+
+int main(void) {
+  test_syntax();
+  test_counted_repetitions();
+  test_invalid();
+  test_limits();
+  test_against_posix();
+  return test_report();
+}
@@ -0,0 +1,418 @@
+// SIMD scanners (whitespace, identifiers, strings, comments, newline and
+// code point counting) against naive byte-at-a-time versions, on random
+// inputs made of long runs so that every block size is crossed. The Makefile
+// builds this test three ways (default, -mavx2 and -DLEXER_NO_SIMD) and
+// compares the digests they print, so the builds also agree with each other.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum {
+  TOK_BLOCK = 2,
+  TOK_NESTED,
+  TOK_LINE,
+  TOK_STRING,
+  TOK_CHAR,
+  TOK_SPACE,
+  TOK_PUNCT,
+  TOK_IDENT,
+  TOK_XID,
+  TOK_OTHER,
+};
+
+#define SPACE_BYTES " \t\n"
+// More bytes than LEXER_SPACE_SIMD_MAX: scanned through the first-byte set
+#define PUNCT_BYTES "(.,;:!?-+="
+
+// Naive scanners, with the semantics documented for the built-in rules
+
+static bool starts_with(const char *p, size_t length, const char *prefix) {
+  size_t prefix_length = strlen(prefix);
+  return length >= prefix_length && memcmp(p, prefix, prefix_length) == 0;
+}
+
+static size_t naive_block(const char *p, size_t length) {
+  if (!starts_with(p, length, "/*")) {
+    return 0;
+  }
+  for (size_t i = 2; i < length; ++i) {
+    if (starts_with(p + i, length - i, "*/")) {
+      return i + 2;
+    }
+  }
+  return 0;
+}
+
+static size_t naive_nested(const char *p, size_t length) {
+  if (!starts_with(p, length, "(*")) {
+    return 0;
+  }
+  size_t depth = 1;
+  size_t i = 2;
+  while (i < length) {
+    if (starts_with(p + i, length - i, "*)")) {
+      i += 2;
+      if (--depth == 0) {
+        return i;
+      }
+    } else if (starts_with(p + i, length - i, "(*")) {
+      i += 2;
+      depth++;
+    } else {
+      i++;
+    }
+  }
+  return 0;
+}
+
+static size_t naive_line(const char *p, size_t length) {
+  if (!starts_with(p, length, "//")) {
+    return 0;
+  }
+  size_t i = 2;
+  while (i < length && p[i] != '\n') {
+    i++;
+  }
+  return i;
+}
+
+static size_t naive_string(const char *p, size_t length) {
+  if (length == 0 || p[0] != '"') {
+    return 0;
+  }
+  size_t i = 1;
+  while (i < length) {
+    if (p[i] == '"') {
+      return i + 1;
+    }
+    if (p[i] == '\n') {
+      return 0;
+    }
+    i += p[i] == '\\' ? 2 : 1;
+  }
+  return 0;
+}
+
+static size_t naive_char(const char *p, size_t length) {
+  if (length == 0 || p[0] != '\'') {
+    return 0;
+  }
+  for (size_t i = 1; i < length; ++i) {
+    if (p[i] == '\'') {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+static size_t naive_run(const char *p, size_t length, const char *bytes) {
+  size_t i = 0;
+  while (i < length && p[i] != '\0' && strchr(bytes, p[i]) != NULL) {
+    i++;
+  }
+  return i;
+}
+
+static size_t naive_space(const char *p, size_t length) {
+  return naive_run(p, length, SPACE_BYTES);
+}
+
+static size_t naive_punct(const char *p, size_t length) {
+  return naive_run(p, length, PUNCT_BYTES);
+}
+
+static bool naive_is_ident_byte(char c, bool utf8) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' ||
+         (utf8 && (unsigned char)c >= 0x80);
+}
+
+static size_t naive_ident_run(const char *p, size_t length, bool utf8) {
+  size_t i = 0;
+  while (i < length && naive_is_ident_byte(p[i], utf8)) {
+    i++;
+  }
+  return i;
+}
+
+static size_t naive_ident(const char *p, size_t length) {
+  if (length == 0 || (p[0] >= '0' && p[0] <= '9') ||
+      !naive_is_ident_byte(p[0], false)) {
+    return 0;
+  }
+  return naive_ident_run(p, length, false);
+}
+
+static size_t naive_xid(const char *p, size_t length) {
+  size_t i = 0;
+  while (i < length) {
+    uint32_t code_point = (unsigned char)p[i];
+    size_t sequence = 1;
+    if (code_point >= 0x80) {
+      sequence = lexer_utf8_decode(p + i, length - i, &code_point);
+      if (sequence == 0) {
+        break;
+      }
+    }
+    if (i == 0 ? !lexer_is_xid_start(code_point)
+               : !lexer_is_xid_continue(code_point)) {
+      break;
+    }
+    i += sequence;
+  }
+  return i;
+}
+
+static size_t naive_other(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+// Line and column of `offset`, columns counted in bytes or code points
+static void naive_location(const char *p, size_t offset, bool utf8,
+                           size_t *line, size_t *column) {
+  *line = 1;
+  *column = 1;
+  for (size_t i = 0; i < offset; ++i) {
+    if (p[i] == '\n') {
+      (*line)++;
+      *column = 1;
+    } else if (!utf8 || ((unsigned char)p[i] & 0xC0) != 0x80) {
+      (*column)++;
+    }
+  }
+}
+
+// Random input made of runs of every token class, with lengths around the
+// 16/32-byte block sizes
+
+static const char *const utf8_pieces[] = {
+    "\xc3\xa9",         // U+00E9, XID_Start
+    "\xce\xbb",         // U+03BB, XID_Start
+    "\xe2\x82\xac",     // U+20AC, not an identifier
+    "\xe6\x97\xa5",     // U+65E5, XID_Start
+    "\xcc\x81",         // U+0301, XID_Continue only
+    "\xf0\x9d\x90\x80", // U+1D400, XID_Start
+    "\xff",             // Invalid byte
+    "\x80",             // Stray continuation byte
+    "\xe2\x82",         // Truncated sequence
+};
+
+static size_t put(char *out, size_t length, size_t size, const char *bytes,
+                  size_t count) {
+  if (length + count >= size) {
+    return length;
+  }
+  memcpy(out + length, bytes, count);
+  return length + count;
+}
+
+static size_t put_run(char *out, size_t length, size_t size,
+                      const char *alphabet, size_t count) {
+  size_t alphabet_length = strlen(alphabet);
+  for (size_t i = 0; i < count; ++i) {
+    char c = alphabet[test_random() % alphabet_length];
+    length = put(out, length, size, &c, 1);
+  }
+  return length;
+}
+
+static size_t random_source(char *out, size_t size) {
+  static const char ident_bytes[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+  static const char body_bytes[] = "ab \t\n\"'\\/*()x";
+  size_t length = 0;
+  size_t target = 2 + test_random() % (size - 2);
+  while (length + 1 < target) {
+    size_t count = test_random() % 70;
+    switch (test_random() % 9) {
+    case 0:
+      length = put_run(out, length, size, ident_bytes, count + 1);
+      break;
+    case 1:
+      length = put_run(out, length, size, SPACE_BYTES, count + 1);
+      break;
+    case 2:
+      length = put_run(out, length, size, PUNCT_BYTES, count + 1);
+      break;
+    case 3:
+      length = put(out, length, size, "\"", 1);
+      length = put_run(out, length, size, body_bytes, count);
+      break;
+    case 4:
+      length = put(out, length, size, "'", 1);
+      length = put_run(out, length, size, body_bytes, count);
+      break;
+    case 5:
+      length = put(out, length, size, "/*", 2);
+      length = put_run(out, length, size, body_bytes, count);
+      break;
+    case 6:
+      length = put(out, length, size, "(*", 2);
+      length = put_run(out, length, size, body_bytes, count);
+      break;
+    case 7:
+      length = put(out, length, size, "//", 2);
+      length = put_run(out, length, size, body_bytes, count);
+      break;
+    default:
+      for (size_t i = 0; i <= count % 12; ++i) {
+        const char *piece =
+            utf8_pieces[test_random() % (sizeof(utf8_pieces) /
+                                         sizeof(utf8_pieces[0]))];
+        length = put(out, length, size, piece, strlen(piece));
+        length = put_run(out, length, size, ident_bytes, test_random() % 3);
+      }
+      break;
+    }
+  }
+  out[length] = '\0';
+  return length;
+}
+
+// Builds the lexer with either the built-in rules or their naive spans, in
+// the same order and with the same kinds
+static lexer_t *simd_lexer(const char *source, size_t length, uint32_t flags,
+                           bool naive) {
+  lexer_t *lexer = lexer_create(source, length, "simd", flags);
+  const lexer_string_config_t string = {'"', '\\', false};
+  const lexer_string_config_t character = {'\'', '\0', true};
+  if (naive) {
+    CHECK(lexer_add_span_rule(lexer, naive_block, TOK_BLOCK, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_nested, TOK_NESTED, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_line, TOK_LINE, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_string, TOK_STRING, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_char, TOK_CHAR, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_space, TOK_SPACE, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_punct, TOK_PUNCT, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_ident, TOK_IDENT, NULL, NULL));
+    CHECK(lexer_add_span_rule(lexer, naive_xid, TOK_XID, NULL, NULL));
+  } else {
+    CHECK(lexer_add_block_comment_rule(lexer, "/*", "*/", false, TOK_BLOCK,
+                                       NULL));
+    CHECK(lexer_add_block_comment_rule(lexer, "(*", "*)", true, TOK_NESTED,
+                                       NULL));
+    CHECK(lexer_add_line_comment_rule(lexer, "//", TOK_LINE, NULL));
+    CHECK(lexer_add_string_rule(lexer, &string, TOK_STRING, NULL));
+    CHECK(lexer_add_string_rule(lexer, &character, TOK_CHAR, NULL));
+    CHECK(lexer_add_whitespace_rule(lexer, SPACE_BYTES, TOK_SPACE, NULL));
+    CHECK(lexer_add_whitespace_rule(lexer, PUNCT_BYTES, TOK_PUNCT, NULL));
+    CHECK(lexer_add_identifier_rule(lexer, TOK_IDENT, NULL));
+    CHECK(lexer_add_utf8_identifier_rule(lexer, TOK_XID, NULL));
+  }
+  CHECK(lexer_add_span_rule(lexer, naive_other, TOK_OTHER, NULL, NULL));
+  return lexer;
+}
+
+static uint32_t digest = 2166136261u;
+
+static void digest_add(size_t value) {
+  for (int i = 0; i < 4; ++i) {
+    digest = (digest ^ (uint32_t)((value >> (8 * i)) & 0xFF)) * 16777619u;
+  }
+}
+
+// Token streams of the built-in rules and of the naive spans, with the
+// locations checked against a naive count
+static void test_rules(const char *source, size_t length, uint32_t flags) {
+  lexer_t *fast = simd_lexer(source, length, flags, false);
+  lexer_t *naive = simd_lexer(source, length, flags, true);
+  bool utf8 = flags & LEXER_FLAG_UTF8_COLUMNS;
+  for (;;) {
+    token_t a = lexer_next_token(fast);
+    token_t b = lexer_next_token(naive);
+    if (a.kind != b.kind || a.length != b.length ||
+        (a.kind != INTERNAL_TOKEN_EOF && a.lexeme != b.lexeme)) {
+      fprintf(stderr, "at %zu: %u (%zu bytes) instead of %u (%zu bytes)\n",
+              (size_t)(b.lexeme - source), a.kind, a.length, b.kind, b.length);
+      test_failures++;
+      break;
+    }
+    size_t offset = a.kind == INTERNAL_TOKEN_EOF ? length
+                                                 : (size_t)(a.lexeme - source);
+    size_t line = 0;
+    size_t column = 0;
+    naive_location(source, offset, utf8, &line, &column);
+    CHECK(a.line == line && a.column == column);
+    digest_add(a.kind);
+    digest_add(offset);
+    digest_add(a.length);
+    digest_add(a.column);
+    if (a.kind == INTERNAL_TOKEN_EOF) {
+      break;
+    }
+  }
+  lexer_destroy(fast);
+  lexer_destroy(naive);
+}
+
+// lexer_scan_ident, lexer_scan_ident_utf8 and lexer_scan_xid at every
+// position, moved to with lexer_advance_n
+static void test_scans(const char *source, size_t length) {
+  lexer_t *lexer = lexer_create(source, length, "scans", 0);
+  for (size_t i = 0; i < length; ++i) {
+    CHECK(lexer_get_position(lexer) == i);
+    const char *p = source + i;
+    size_t expected = naive_ident_run(p, length - i, false);
+    CHECK(lexer_scan_ident(lexer) == expected);
+    CHECK(lexer_scan_ident_utf8(lexer) == naive_ident_run(p, length - i, true));
+    CHECK(lexer_scan_xid(lexer) == naive_xid(p, length - i));
+    digest_add(expected);
+    lexer_advance_n(lexer, 1);
+  }
+  lexer_destroy(lexer);
+}
+
+// lexer_advance_n and lexer_advance_to by random steps, in bytes and in code
+// points
+static void test_advance(const char *source, size_t length, uint32_t flags) {
+  lexer_t *lexer = lexer_create(source, length, "advance", flags);
+  bool utf8 = flags & LEXER_FLAG_UTF8_COLUMNS;
+  size_t offset = 0;
+  while (offset < length) {
+    size_t step = test_random() % 100;
+    if (test_random() % 2) {
+      lexer_advance_n(lexer, step);
+    } else {
+      lexer_advance_to(lexer, source + (offset + step <= length
+                                            ? offset + step
+                                            : length));
+    }
+    offset = offset + step <= length ? offset + step : length;
+    size_t line = 0;
+    size_t column = 0;
+    naive_location(source, offset, utf8, &line, &column);
+    CHECK(lexer_get_position(lexer) == offset);
+    CHECK(lexer_get_line(lexer) == line && lexer_get_column(lexer) == column);
+    digest_add(lexer_get_column(lexer));
+  }
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+  if (!__builtin_cpu_supports("avx2")) {
+    fprintf(stderr, "test_simd: skipped, no AVX2 on this CPU\n");
+    return 0;
+  }
+#endif
+  enum { SOURCE_SIZE = 600 };
+  char text[SOURCE_SIZE];
+  for (int round = 0; round < 3000; ++round) {
+    // Exact-size copy without a terminator, so that the sanitizer catches
+    // loads past the end
+    size_t length = random_source(text, SOURCE_SIZE);
+    char *source = malloc(length);
+    ASSERT(source != NULL && "No more memory");
+    memcpy(source, text, length);
+    test_rules(source, length, 0);
+    test_rules(source, length, LEXER_FLAG_UTF8_COLUMNS);
+    test_advance(source, length, round % 2 ? LEXER_FLAG_UTF8_COLUMNS : 0);
+    if (round % 10 == 0) {
+      test_scans(source, length);
+    }
+    free(source);
+  }
+  printf("%08x\n", (unsigned)digest);
+  return test_report();
+}
@@ -0,0 +1,191 @@
+// Source registry: registering sources, switching between them, tokens and
+// filenames referring to the registry, resets that keep earlier tokens valid,
+// and locations in any source without switching to it.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_WORD = 2, TOK_SPACE };
+
+static lexer_t *source_lexer(const char *source, const char *filename) {
+  lexer_t *lexer = lexer_create(source, 0, filename, 0);
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  return lexer;
+}
+
+static void check_word(lexer_t *lexer, const char *lexeme, source_id_t id,
+                       size_t line, size_t column) {
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.length == strlen(lexeme) &&
+        memcmp(token.lexeme, lexeme, token.length) == 0);
+  CHECK(token.source == id);
+  CHECK(token.filename == lexer_source_filename(lexer, id));
+  CHECK(token.line == line && token.column == column);
+}
+
+static void test_register(void) {
+  lexer_t *lexer = source_lexer("main", "main.c");
+  CHECK(lexer_source_count(lexer) == 1);
+  CHECK(lexer_get_source_id(lexer) == 0);
+
+  // The filename is copied, the text is not
+  char filename[] = "a.h";
+  const char *a_text = "alpha\nbeta";
+  source_id_t a = lexer_register_source(lexer, filename, a_text, 0);
+  filename[0] = 'x';
+  // An explicit length may stop before the terminator
+  const char *b_text = "gamma delta";
+  source_id_t b = lexer_register_source(lexer, NULL, b_text, 5);
+  CHECK(a == 1 && b == 2);
+  CHECK(lexer_source_count(lexer) == 3);
+  CHECK(strcmp(lexer_source_filename(lexer, 0), "main.c") == 0);
+  CHECK(strcmp(lexer_source_filename(lexer, a), "a.h") == 0);
+  CHECK(lexer_source_filename(lexer, b) == NULL);
+  size_t length = 0;
+  CHECK(lexer_source_text(lexer, a, &length) == a_text && length == 10);
+  CHECK(lexer_source_text(lexer, b, &length) == b_text && length == 5);
+  CHECK(lexer_source_text(lexer, b, NULL) == b_text);
+  // Registering does not switch
+  CHECK(lexer_get_source_id(lexer) == 0);
+
+  CHECK(lexer_register_source(lexer, "null", NULL, 0) ==
+        LEXER_SOURCE_INVALID);
+  CHECK(lexer_register_source(NULL, "null", "x", 0) == LEXER_SOURCE_INVALID);
+  CHECK(!lexer_set_source(lexer, 3));
+  CHECK(!lexer_set_source(lexer, LEXER_SOURCE_INVALID));
+  CHECK(lexer_source_filename(lexer, 3) == NULL);
+  CHECK(lexer_source_text(lexer, 3, &length) == NULL);
+  CHECK(!lexer_source_location(lexer, 3, 0, NULL, NULL));
+  CHECK(lexer_source_count(lexer) == 3);
+  lexer_destroy(lexer);
+}
+
+// Switching restarts at the beginning of the source, with its own filename
+// and locations
+static void test_switch(void) {
+  lexer_t *lexer = source_lexer("one two\nthree", "main.c");
+  source_id_t a = lexer_register_source(lexer, "a.h", "x\n  y", 0);
+  source_id_t b = lexer_register_source(lexer, "b.h", "z", 0);
+  check_word(lexer, "one", 0, 1, 1);
+  check_word(lexer, "two", 0, 1, 5);
+
+  CHECK(lexer_set_source(lexer, a));
+  CHECK(lexer_get_source_id(lexer) == a);
+  CHECK(lexer_get_position(lexer) == 0);
+  check_word(lexer, "x", a, 1, 1);
+  CHECK(lexer_set_source(lexer, b));
+  check_word(lexer, "z", b, 1, 1);
+  CHECK_EOF(lexer);
+
+  CHECK(lexer_set_source(lexer, a));
+  check_word(lexer, "x", a, 1, 1);
+  check_word(lexer, "y", a, 2, 3);
+  CHECK_EOF(lexer);
+  CHECK(lexer_set_source(lexer, 0));
+  check_word(lexer, "one", 0, 1, 1);
+  check_word(lexer, "two", 0, 1, 5);
+  check_word(lexer, "three", 0, 2, 1);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Tokens peeked from the previous source are dropped, and so are modes
+static void test_switch_state(void) {
+  lexer_t *lexer = source_lexer("p q r", "main.c");
+  int32_t other = lexer_define_mode(lexer, "other");
+  source_id_t a = lexer_register_source(lexer, "a.h", "s", 0);
+  CHECK(lexer_peek_token(lexer, 2) != NULL);
+  CHECK(lexer_push_mode(lexer, (uint32_t)other));
+  CHECK(lexer_set_source(lexer, a));
+  CHECK(lexer_get_mode(lexer) == LEXER_MODE_DEFAULT);
+  CHECK(!lexer_pop_mode(lexer));
+  check_word(lexer, "s", a, 1, 1);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Tokens lexed before a reset keep their filename and source id; resetting
+// to a known buffer finds its id again instead of adding an entry
+static void test_reset(void) {
+  const char *first_text = "first";
+  lexer_t *lexer = source_lexer(first_text, "first.c");
+  token_t first = lexer_next_token(lexer);
+  lexer_reset(lexer, "second", 0, "second.c");
+  token_t second = lexer_next_token(lexer);
+  CHECK(first.source != second.source);
+  CHECK(strcmp(first.filename, "first.c") == 0);
+  CHECK(strcmp(second.filename, "second.c") == 0);
+  CHECK(first.filename == lexer_source_filename(lexer, first.source));
+  CHECK(lexer_source_count(lexer) == 2);
+
+  char buffers[2][32];
+  for (int i = 0; i < 1000; i++) {
+    char *buffer = buffers[i % 2];
+    snprintf(buffer, sizeof(buffers[0]), "word%c", 'a' + i % 26);
+    lexer_reset(lexer, buffer, 0, i % 3 == 0 ? "reset.c" : NULL);
+    token_t token = lexer_next_token(lexer);
+    CHECK(token.kind == TOK_WORD && token.length == 5);
+    CHECK(token.filename == lexer_source_filename(lexer, token.source));
+  }
+  // Two buffers times two filenames
+  CHECK(lexer_source_count(lexer) == 6);
+  CHECK(strcmp(first.filename, "first.c") == 0);
+  lexer_reset(lexer, first_text, 0, "first.c");
+  CHECK(lexer_get_source_id(lexer) == first.source);
+  check_word(lexer, "first", first.source, 1, 1);
+
+  // The text of a known buffer may have changed in place: locations follow
+  char text[] = "ab cd";
+  lexer_reset(lexer, text, 0, NULL);
+  size_t line = 0;
+  size_t column = 0;
+  CHECK(lexer_offset_to_location(lexer, 3, &line, &column));
+  CHECK(line == 1 && column == 4);
+  text[2] = '\n';
+  lexer_reset(lexer, text, 0, NULL);
+  CHECK(lexer_offset_to_location(lexer, 3, &line, &column));
+  CHECK(line == 2 && column == 1);
+  lexer_destroy(lexer);
+}
+
+// Locations in any registered source, whichever is being lexed
+static void test_locations(void) {
+  const char *a_text = "ab\n\ncd\n";
+  const char *b_text = "\xc3\xa9t\xc3\xa9\nx";
+  for (int utf8 = 0; utf8 < 2; ++utf8) {
+    lexer_t *lexer = lexer_create("main", 0, "main.c",
+                                  utf8 ? LEXER_FLAG_UTF8_COLUMNS : 0);
+    source_id_t a = lexer_register_source(lexer, "a.h", a_text, 0);
+    source_id_t b = lexer_register_source(lexer, "b.h", b_text, 0);
+    size_t line = 0;
+    size_t column = 0;
+    CHECK(lexer_source_location(lexer, a, 5, &line, &column));
+    CHECK(line == 3 && column == 2);
+    CHECK(lexer_source_location(lexer, b, 5, &line, &column));
+    CHECK(line == 1 && column == (utf8 ? 4 : 6));
+    CHECK(lexer_source_location(lexer, b, 6, &line, &column));
+    CHECK(line == 2 && column == 1);
+    // The end of a source is a valid location, not past it
+    CHECK(lexer_source_location(lexer, a, 7, &line, &column));
+    CHECK(line == 4 && column == 1);
+    CHECK(!lexer_source_location(lexer, a, 8, &line, &column));
+    CHECK(lexer_source_location(lexer, 0, 4, &line, &column));
+    CHECK(line == 1 && column == 5);
+    // lexer_offset_to_location follows the current source
+    CHECK(lexer_set_source(lexer, a));
+    CHECK(lexer_offset_to_location(lexer, 3, &line, &column));
+    CHECK(line == 2 && column == 1);
+    lexer_destroy(lexer);
+  }
+}
+
+int main(void) {
+  test_register();
+  test_switch();
+  test_switch_state();
+  test_reset();
+  test_locations();
+  return test_report();
+}
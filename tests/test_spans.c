@@ -0,0 +1,118 @@
+// Span rules: the matcher sees the remaining input, its `first` set limits
+// where it is tried, a failed span leaves nothing to undo, oversized results
+// are clamped, and the location moves once the match is chosen.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_DIGITS = 2, TOK_GREEDY, TOK_BLOCK, TOK_OTHER, TOK_SPACE };
+
+static const char *seen_input = NULL;
+static size_t seen_length = 0;
+static int digit_calls = 0;
+
+static size_t digits_span(const char *input, size_t length) {
+  digit_calls++;
+  seen_input = input;
+  seen_length = length;
+  size_t i = 0;
+  while (i < length && lexer_is_digit(input[i])) {
+    i++;
+  }
+  return i;
+}
+
+// Claims more than what is left
+static size_t greedy_span(const char *input, size_t length) {
+  (void)input;
+  return input[0] == '!' ? length + 100 : 0;
+}
+
+// "[...]" over several lines
+static size_t block_span(const char *input, size_t length) {
+  if (input[0] != '[') {
+    return 0;
+  }
+  const char *end = memchr(input, ']', length);
+  return end != NULL ? (size_t)(end - input) + 1 : 0;
+}
+
+static size_t other_span(const char *input, size_t length) {
+  (void)input;
+  return length > 0 ? 1 : 0;
+}
+
+static void test_input_and_first(void) {
+  const char *source = "12ab345";
+  lexer_t *lexer = lexer_create(source, 0, "spans", 0);
+  lexer_charset_t digits;
+  lexer_charset_clear(&digits);
+  lexer_charset_add_range(&digits, '0', '9');
+  CHECK(lexer_add_span_rule(lexer, digits_span, TOK_DIGITS, NULL, &digits));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+
+  CHECK_TOKEN(lexer, TOK_DIGITS, "12");
+  CHECK(seen_input == source && seen_length == 7);
+  CHECK_TOKEN(lexer, TOK_OTHER, "a");
+  CHECK_TOKEN(lexer, TOK_OTHER, "b");
+  // Not tried on 'a' and 'b'
+  CHECK(digit_calls == 1);
+  CHECK_TOKEN(lexer, TOK_DIGITS, "345");
+  CHECK(seen_input == source + 4 && seen_length == 3);
+  CHECK(digit_calls == 2);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // Without a first set, the span is tried everywhere
+  digit_calls = 0;
+  lexer = lexer_create(source, 0, "spans", 0);
+  CHECK(lexer_add_span_rule(lexer, digits_span, TOK_DIGITS, NULL, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  while (lexer_next_token(lexer).kind != INTERNAL_TOKEN_EOF) {
+  }
+  CHECK(digit_calls == 4);
+  lexer_destroy(lexer);
+}
+
+static void mark_ignored(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->flags |= TOKEN_FLAG_IGNORE;
+}
+
+static void test_locations_and_actions(void) {
+  lexer_t *lexer = lexer_create("[a\nbc] [\n]x !rest", 0, "spans", 0);
+  CHECK(lexer_add_span_rule(lexer, block_span, TOK_BLOCK, NULL, NULL));
+  CHECK(lexer_add_span_rule(lexer, greedy_span, TOK_GREEDY, NULL, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "\\s+", TOK_SPACE, mark_ignored));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_BLOCK && token.length == 6);
+  CHECK(token.line == 1 && token.column == 1);
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_BLOCK && token.length == 3);
+  CHECK(token.line == 2 && token.column == 5);
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_OTHER && token.line == 3 && token.column == 2);
+  // Clamped to the end of the input
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_GREEDY && token.length == 5);
+  CHECK(token.column == 4);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // An unterminated block fails without moving the lexer
+  lexer = lexer_create("[\n\n", 0, "spans", 0);
+  CHECK(lexer_add_span_rule(lexer, block_span, TOK_BLOCK, NULL, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_OTHER && token.length == 1);
+  CHECK(lexer_get_position(lexer) == 1 && lexer_get_line(lexer) == 1);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_input_and_first();
+  test_locations_and_actions();
+  return test_report();
+}
@@ -0,0 +1,99 @@
+// String literal rules: escapes and their flag, raw newlines, unterminated
+// literals, and rules without an escape byte.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_STRING = 2, TOK_CHAR, TOK_SPACE, TOK_OTHER };
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+static lexer_t *string_lexer(const char *source, char quote, char escape,
+                             bool allow_newlines) {
+  lexer_t *lexer = lexer_create(source, 0, "strings", 0);
+  lexer_string_config_t config = {quote, escape, allow_newlines};
+  CHECK(lexer_add_string_rule(lexer, &config, TOK_STRING, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, " ", TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  return lexer;
+}
+
+static void check_string(lexer_t *lexer, const char *lexeme, bool escapes) {
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_STRING && token.length == strlen(lexeme) &&
+        memcmp(token.lexeme, lexeme, token.length) == 0);
+  CHECK(!(token.flags & TOKEN_FLAG_HAS_ESCAPES) == !escapes);
+}
+
+static void test_escapes(void) {
+  lexer_t *lexer = string_lexer(
+      "\"\" \"abc\" \"a\\\"b\" \"\\\\\" \"x\\\ny\" \"tail\\", '"', '\\', false);
+  check_string(lexer, "\"\"", false);
+  check_string(lexer, "\"abc\"", false);
+  check_string(lexer, "\"a\\\"b\"", true);
+  check_string(lexer, "\"\\\\\"", true);
+  // An escaped newline is allowed even without raw newlines
+  check_string(lexer, "\"x\\\ny\"", true);
+  // Unterminated: the quote is left to the next rule
+  CHECK_TOKEN(lexer, TOK_OTHER, "\"");
+  lexer_destroy(lexer);
+}
+
+static void test_newlines(void) {
+  const char *source = "\"a\nb\" x";
+  lexer_t *lexer = string_lexer(source, '"', '\\', false);
+  CHECK_TOKEN(lexer, TOK_OTHER, "\"");
+  lexer_destroy(lexer);
+
+  lexer = string_lexer(source, '"', '\\', true);
+  check_string(lexer, "\"a\nb\"", false);
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_OTHER && token.line == 2 && token.column == 4);
+  lexer_destroy(lexer);
+}
+
+// Without an escape byte, a backslash is an ordinary byte
+static void test_no_escape(void) {
+  lexer_t *lexer = string_lexer("'a\\' 'b'", '\'', '\0', false);
+  check_string(lexer, "'a\\'", false);
+  check_string(lexer, "'b'", false);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+// Literals of every length up to three blocks, with the escape and closing
+// quote at every offset
+static void test_lengths(void) {
+  char source[128];
+  for (size_t length = 2; length < 100; ++length) {
+    for (size_t escape = 1; escape + 1 < length; ++escape) {
+      memset(source, 'a', length);
+      source[0] = '"';
+      source[escape] = '\\';
+      source[length - 1] = '"';
+      source[length] = '\0';
+      lexer_t *lexer = string_lexer(source, '"', '\\', false);
+      token_t token = lexer_next_token(lexer);
+      // The escape swallows the closing quote when it is right before it
+      if (escape + 2 == length) {
+        CHECK(token.kind == TOK_OTHER);
+      } else {
+        CHECK(token.kind == TOK_STRING && token.length == length);
+        CHECK(token.flags & TOKEN_FLAG_HAS_ESCAPES);
+      }
+      lexer_destroy(lexer);
+    }
+  }
+}
+
+int main(void) {
+  test_escapes();
+  test_newlines();
+  test_no_escape();
+  test_lengths();
+  return test_report();
+}
@@ -0,0 +1,154 @@
+// Token ranges: token_range and basic_token_range<Next> yield the same tokens
+// as their tokenizer with lexemes viewing the source, start at the current
+// position and stop before EOF. Built as C++17 and as C++20, where the range
+// is also checked as a std::ranges view in pipelines.
+
+#include "test.h"
+
+#include "plextrum.hpp"
+
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+using namespace plextrum;
+
+enum { TOK_WORD = 2, TOK_NUMBER, TOK_SPACE };
+
+using digit = char_class<range<'0', '9'>>;
+using compiled_lexer = basic_lexer<
+    LEXER_FLAG_NONE, rule<TOK_WORD, plus<char_class<range<'a', 'z'>>>>,
+    rule<TOK_NUMBER, plus<digit>>,
+    rule<TOK_SPACE, plus<char_class<one_of<' ', '\n'>>>, TOKEN_FLAG_IGNORE>>;
+
+static_assert(std::is_same_v<token_range::iterator::iterator_category,
+                             std::input_iterator_tag>);
+static_assert(std::is_same_v<decltype(*token_range().begin()), const token &>);
+static_assert(std::is_same_v<decltype(token_range().end()), token_sentinel>);
+
+static lexer_t *runtime_lexer(const char *source, uint32_t flags) {
+  lexer_t *lexer = lexer_create(source, 0, "range", flags);
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]+", TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, " \n", TOK_SPACE,
+                                  lexer_action_ignore));
+  return lexer;
+}
+
+// Every token of `range` against the next token of `expected`
+template <typename Range>
+static void compare_tokens(Range range, lexer_t *expected) {
+  size_t count = 0;
+  for (const token &token : range) {
+    const token_t next = lexer_next_token(expected);
+    CHECK(token.kind == next.kind && token.flags == next.flags);
+    CHECK(token.lexeme.data() == next.lexeme);
+    CHECK(token.lexeme.size() == next.length);
+    CHECK(token.line == next.line && token.column == next.column);
+    CHECK(token.source == next.source);
+    count++;
+  }
+  CHECK(count > 0);
+  CHECK(lexer_next_token(expected).kind == INTERNAL_TOKEN_EOF);
+}
+
+static void test_same_tokens(void) {
+  const char *source = "ab 12\n cd ! 3 e";
+  for (int keep = 0; keep < 2; ++keep) {
+    uint32_t flags = keep ? LEXER_FLAG_KEEP_IGNORABLE : 0;
+    lexer_t *lexer = runtime_lexer(source, flags);
+    lexer_t *expected = runtime_lexer(source, flags);
+    compare_tokens(token_range(lexer), expected);
+    CHECK(lexer_is_eof(lexer));
+    lexer_destroy(lexer);
+    lexer_destroy(expected);
+  }
+
+  // The compiled tokenizer, against the equivalent runtime rules
+  const char *compiled_source = "ab 12\n cd";
+  lexer_t *lexer = lexer_create(compiled_source, 0, "range", 0);
+  lexer_t *expected = runtime_lexer(compiled_source, 0);
+  compare_tokens(basic_token_range<compiled_lexer::next_token>(lexer),
+                 expected);
+  lexer_destroy(lexer);
+  lexer_destroy(expected);
+}
+
+static void test_bounds(void) {
+  // Nothing to yield
+  lexer_t *lexer = runtime_lexer("", 0);
+  token_range empty(lexer);
+  CHECK(empty.begin() == empty.end());
+  CHECK(!(empty.begin() != empty.end()));
+  lexer_destroy(lexer);
+
+  // From the current position, with errors yielded like other tokens
+  lexer = runtime_lexer("one two ! 3", 0);
+  CHECK_TOKEN(lexer, TOK_WORD, "one");
+  std::vector<std::string_view> lexemes;
+  std::vector<uint32_t> kinds;
+  for (const token &token : token_range(lexer)) {
+    lexemes.push_back(token.lexeme);
+    kinds.push_back(token.kind);
+  }
+  CHECK((lexemes == std::vector<std::string_view>{"two", "!", "3"}));
+  CHECK((kinds == std::vector<uint32_t>{TOK_WORD, INTERNAL_TOKEN_ERROR,
+                                        TOK_NUMBER}));
+  // A finished lexer gives an empty range
+  token_range done(lexer);
+  CHECK(done.begin() == done.end());
+  lexer_destroy(lexer);
+
+  // Stopping early leaves the rest to the lexer
+  lexer = runtime_lexer("a b c", 0);
+  for (const token &token : token_range(lexer)) {
+    if (token.lexeme == "b") {
+      break;
+    }
+  }
+  CHECK_TOKEN(lexer, TOK_WORD, "c");
+  lexer_destroy(lexer);
+}
+
+#ifdef PLEXTRUM_HAS_RANGES
+static_assert(std::ranges::input_range<token_range>);
+static_assert(std::ranges::view<token_range>);
+static_assert(std::ranges::view<basic_token_range<compiled_lexer::next_token>>);
+static_assert(std::sentinel_for<token_sentinel, token_range::iterator>);
+
+static void test_views(void) {
+  lexer_t *lexer = runtime_lexer("ab 12 cd 3 ef 45", 0);
+  auto numbers = token_range(lexer) |
+                 std::views::filter([](const token &token) {
+                   return token.kind == TOK_NUMBER;
+                 }) |
+                 std::views::transform(
+                     [](const token &token) { return token.lexeme.size(); });
+  std::vector<size_t> lengths;
+  for (size_t length : numbers) {
+    lengths.push_back(length);
+  }
+  CHECK((lengths == std::vector<size_t>{2, 1, 2}));
+  lexer_destroy(lexer);
+
+  lexer = lexer_create("x yz 7", 0, "views", 0);
+  std::vector<std::string_view> words;
+  for (const token &token :
+       basic_token_range<compiled_lexer::next_token>(lexer) |
+           std::views::take(2)) {
+    words.push_back(token.lexeme);
+  }
+  CHECK((words == std::vector<std::string_view>{"x", "yz"}));
+  lexer_destroy(lexer);
+}
+#endif
+
+int main(void) {
+  test_same_tokens();
+  test_bounds();
+#ifdef PLEXTRUM_HAS_RANGES
+  test_views();
+#endif
+  return test_report();
+}
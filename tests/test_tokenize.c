@@ -0,0 +1,168 @@
+// Batch tokenization: lexer_tokenize_all fills the same tokens as
+// lexer_next_token (with and without locations, eager or lazy), ends with an
+// EOF entry, reuses its buffer, records offsets at the match start, and the
+// buffer cursor stops at the EOF entry.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_WORD = 2, TOK_NUMBER, TOK_STRING, TOK_SPACE, TOK_OTHER };
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+static char replaced_lexeme[] = "n";
+
+static void replace_lexeme(lexer_t *lexer, token_t *token) {
+  (void)lexer;
+  token->lexeme = replaced_lexeme;
+  token->length = strlen(replaced_lexeme);
+}
+
+static lexer_t *sample_lexer(const char *source, uint32_t flags,
+                             token_action_fn number_action) {
+  lexer_t *lexer = lexer_create(source, 0, "tokenize", flags);
+  lexer_string_config_t config = {'"', '\\', true};
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_identifier_rule(lexer, TOK_WORD, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[0-9]+", TOK_NUMBER, number_action));
+  CHECK(lexer_add_string_rule(lexer, &config, TOK_STRING, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  return lexer;
+}
+
+// Entry i of `buffer` against the next token of `lexer`
+static void check_entry(lexer_t *lexer, const token_buffer_t *buffer,
+                        size_t i, const char *source) {
+  token_t token = lexer_next_token(lexer);
+  CHECK(buffer->kinds[i] == token.kind);
+  CHECK(buffer->lengths[i] == token.length);
+  CHECK(buffer->flags[i] == token.flags);
+  if (token.kind != INTERNAL_TOKEN_EOF) {
+    CHECK(memcmp(source + buffer->offsets[i], token.lexeme, token.length) ==
+          0);
+  }
+  if (buffer->locations) {
+    CHECK(buffer->lines[i] == token.line);
+    CHECK(buffer->columns[i] == token.column);
+  } else {
+    CHECK(buffer->lines == NULL && buffer->columns == NULL);
+  }
+}
+
+static void test_same_tokens(void) {
+  const char *words[] = {"a", "bc ", "12", " ", "\n", "\"s\\\"\"", "\"x\ny\"",
+                         "+", "==", "\t", "_z9"};
+  static char source[8192];
+  size_t length = test_random_text(source, sizeof(source), words,
+                                   sizeof(words) / sizeof(words[0]));
+  for (int lazy = 0; lazy < 2; ++lazy) {
+    uint32_t flags = lazy ? LEXER_FLAG_LAZY_LOCATION : 0;
+    for (int locations = 0; locations < 2; ++locations) {
+      token_buffer_t buffer;
+      token_buffer_init(&buffer, locations);
+      lexer_t *batch = sample_lexer(source, flags, NULL);
+      CHECK(lexer_tokenize_all(batch, &buffer));
+      // Lazy locations are only computed on request
+      lexer_t *single = sample_lexer(source, 0, NULL);
+      CHECK(buffer.count > 256);
+      for (size_t i = 0; i < buffer.count; ++i) {
+        check_entry(single, &buffer, i, source);
+      }
+      CHECK(buffer.kinds[buffer.count - 1] == INTERNAL_TOKEN_EOF);
+      CHECK(buffer.offsets[buffer.count - 1] == length);
+      CHECK(lexer_is_eof(batch));
+      lexer_destroy(batch);
+      lexer_destroy(single);
+      token_buffer_free(&buffer);
+    }
+  }
+}
+
+static void test_partial_and_reuse(void) {
+  const char *source = "one 2\n three";
+  token_buffer_t buffer;
+  token_buffer_init(&buffer, false);
+  lexer_t *lexer = sample_lexer(source, 0, NULL);
+  // Starts from the current position
+  CHECK_TOKEN(lexer, TOK_WORD, "one");
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 3);
+  CHECK(buffer.kinds[0] == TOK_NUMBER && buffer.offsets[0] == 4);
+  CHECK(buffer.kinds[1] == TOK_WORD && buffer.offsets[1] == 7);
+  CHECK(buffer.kinds[2] == INTERNAL_TOKEN_EOF && buffer.lengths[2] == 0);
+  CHECK(token_buffer_next(&buffer) == 0);
+
+  // Refilled from scratch, with locations added to the existing arrays
+  lexer_reset(lexer, "\"a\"", 0, "reuse");
+  buffer.locations = true;
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 2 && buffer.cursor == 0);
+  CHECK(buffer.kinds[0] == TOK_STRING && buffer.lengths[0] == 3);
+  CHECK(buffer.lines[0] == 1 && buffer.columns[0] == 1);
+  CHECK(buffer.lines[1] == 1 && buffer.columns[1] == 4);
+
+  // An empty input holds the EOF entry only, and so does a finished lexer
+  lexer_reset(lexer, "", 0, "empty");
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 1 && buffer.kinds[0] == INTERNAL_TOKEN_EOF);
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 1 && buffer.kinds[0] == INTERNAL_TOKEN_EOF);
+  CHECK(!lexer_tokenize_all(lexer, NULL));
+  CHECK(!lexer_tokenize_all(NULL, &buffer));
+  lexer_destroy(lexer);
+  token_buffer_free(&buffer);
+  CHECK(buffer.kinds == NULL && buffer.count == 0 && buffer.locations);
+}
+
+// An action replacing the lexeme does not move the recorded offset
+static void test_replaced_lexeme(void) {
+  const char *source = "ab 123 c\n45";
+  token_buffer_t buffer;
+  token_buffer_init(&buffer, true);
+  lexer_t *lexer = sample_lexer(source, 0, replace_lexeme);
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 5);
+  CHECK(buffer.kinds[1] == TOK_NUMBER && buffer.offsets[1] == 3);
+  CHECK(buffer.lengths[1] == 1 && buffer.columns[1] == 4);
+  CHECK(buffer.kinds[2] == TOK_WORD && buffer.offsets[2] == 7);
+  CHECK(buffer.kinds[3] == TOK_NUMBER && buffer.offsets[3] == 9);
+  CHECK(buffer.lines[3] == 2 && buffer.columns[3] == 1);
+  lexer_destroy(lexer);
+  token_buffer_free(&buffer);
+}
+
+static void test_cursor(void) {
+  token_buffer_t buffer;
+  token_buffer_init(&buffer, false);
+  lexer_t *lexer = sample_lexer("a b c", 0, NULL);
+  CHECK(lexer_tokenize_all(lexer, &buffer));
+  CHECK(buffer.count == 4);
+  CHECK(token_buffer_peek(&buffer, 0) == 0);
+  CHECK(token_buffer_peek(&buffer, 2) == 2);
+  CHECK(token_buffer_peek(&buffer, 100) == 3);
+  CHECK(token_buffer_next(&buffer) == 0);
+  size_t mark = token_buffer_mark(&buffer);
+  CHECK(token_buffer_next(&buffer) == 1);
+  CHECK(token_buffer_next(&buffer) == 2);
+  CHECK(token_buffer_peek(&buffer, 1) == 3);
+  // The EOF entry is returned again and again
+  CHECK(token_buffer_next(&buffer) == 3);
+  CHECK(token_buffer_next(&buffer) == 3);
+  token_buffer_rewind(&buffer, mark);
+  CHECK(token_buffer_next(&buffer) == 1);
+  CHECK(buffer.kinds[token_buffer_peek(&buffer, 0)] == TOK_WORD);
+  lexer_destroy(lexer);
+  token_buffer_free(&buffer);
+}
+
+int main(void) {
+  test_same_tokens();
+  test_partial_and_reuse();
+  test_replaced_lexeme();
+  test_cursor();
+  return test_report();
+}
@@ -0,0 +1,96 @@
+// Whitespace rules: the default byte set, custom sets of any size, ignored
+// runs skipped before dispatch only where the rule would be tried first, and
+// LEXER_FLAG_KEEP_IGNORABLE.
+
+#define LEXER_IMPL
+#include "test.h"
+
+enum { TOK_SPACE = 2, TOK_WORD, TOK_INDENT, TOK_OTHER };
+
+static size_t other_span(const char *p, size_t length) {
+  (void)p;
+  return length > 0 ? 1 : 0;
+}
+
+static void test_byte_sets(void) {
+  // NULL is the lexer_is_space set
+  lexer_t *lexer = lexer_create(" \t\n\b\r\v x\f", 0, "spaces", 0);
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  CHECK_TOKEN(lexer, TOK_SPACE, " \t\n\b\r\v ");
+  CHECK_TOKEN(lexer, TOK_OTHER, "x");
+  CHECK_TOKEN(lexer, TOK_OTHER, "\f");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // A set too large for the SIMD comparisons
+  lexer = lexer_create("abcdefghijk-abc", 0, "spaces", 0);
+  CHECK(lexer_add_whitespace_rule(lexer, "abcdefghij", TOK_SPACE, NULL));
+  CHECK(lexer_add_span_rule(lexer, other_span, TOK_OTHER, NULL, NULL));
+  CHECK_TOKEN(lexer, TOK_SPACE, "abcdefghij");
+  CHECK_TOKEN(lexer, TOK_OTHER, "k");
+  CHECK_TOKEN(lexer, TOK_OTHER, "-");
+  CHECK_TOKEN(lexer, TOK_SPACE, "abc");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+static void test_ignored_runs(void) {
+  const char *source = "  a \n\t b";
+  lexer_t *lexer = lexer_create(source, 0, "ignored", 0);
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]", TOK_WORD, NULL));
+  token_t token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.line == 1 && token.column == 3);
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_WORD && token.line == 2 && token.column == 3);
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // Kept, with their flag
+  lexer = lexer_create(source, 0, "kept", LEXER_FLAG_KEEP_IGNORABLE);
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]", TOK_WORD, NULL));
+  token = lexer_next_token(lexer);
+  CHECK(token.kind == TOK_SPACE && token.length == 2);
+  CHECK(token.flags & TOKEN_FLAG_IGNORE);
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_SPACE, " \n\t ");
+  lexer_destroy(lexer);
+}
+
+// An earlier rule starting with a space keeps priority over the skip
+static void test_earlier_rule(void) {
+  lexer_t *lexer = lexer_create("a\n  b  c", 0, "indent", 0);
+  CHECK(lexer_add_regex_rule(lexer, "\\n +", TOK_INDENT, NULL));
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]", TOK_WORD, NULL));
+  CHECK_TOKEN(lexer, TOK_WORD, "a");
+  CHECK_TOKEN(lexer, TOK_INDENT, "\n  ");
+  CHECK_TOKEN(lexer, TOK_WORD, "b");
+  CHECK_TOKEN(lexer, TOK_WORD, "c");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+
+  // With longest match, a later rule matching more than the run wins
+  lexer = lexer_create("  =x  y", 0, "longest", LEXER_FLAG_LONGEST_MATCH);
+  CHECK(lexer_add_whitespace_rule(lexer, NULL, TOK_SPACE,
+                                  lexer_action_ignore));
+  CHECK(lexer_add_regex_rule(lexer, " +=", TOK_INDENT, NULL));
+  CHECK(lexer_add_regex_rule(lexer, "[a-z]", TOK_WORD, NULL));
+  CHECK_TOKEN(lexer, TOK_INDENT, "  =");
+  CHECK_TOKEN(lexer, TOK_WORD, "x");
+  CHECK_TOKEN(lexer, TOK_WORD, "y");
+  CHECK_EOF(lexer);
+  lexer_destroy(lexer);
+}
+
+int main(void) {
+  test_byte_sets();
+  test_ignored_runs();
+  test_earlier_rule();
+  return test_report();
+}